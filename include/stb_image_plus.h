@@ -1,10 +1,13 @@
 #pragma once
 
 #include <array>
+#include <chrono>
 #include <cstddef>
+#include <cstdint>
 #include <initializer_list>
 #include <memory>
 #include <span>
+#include <vector>
 #include <filesystem>
 
 namespace stb_image_plus
@@ -23,6 +26,218 @@ private:
     std::array<std::uint8_t, DesiredChannels> mData;
 };
 
+/* PNG encoder profiles for ImageData::write.
+ * Default picks the best filter for every row and compresses at
+ * EncodeOptions::pngLevel.
+ * Fast is meant for screenshots and debug dumps, where encode time matters
+ * more than file size: one fixed filter (Up) and run-length only deflate,
+ * in the spirit of fpng/fpnge. Expect several times the size of Default
+ * on flat synthetic content, and roughly 2-3x on photographic images.
+ * BandFilter compresses like Default but picks one filter for each band of
+ * rows the encoder works on, scored on a sample of its rows, which skips
+ * most of the per-row filter search at a small cost in size. */
+enum class PngProfile
+{
+    Default,
+    Fast,
+    BandFilter
+};
+
+/* JPEG chroma subsampling. Auto follows stb_image_write: 4:2:0 up to
+ * quality 90, 4:4:4 above. Chroma422 halves chroma horizontally only. */
+enum class JpegSubsampling
+{
+    Auto,
+    Chroma444,
+    Chroma422,
+    Chroma420
+};
+
+/* Output formats for ImageData::writeToMemory. */
+enum class ImageFormat
+{
+    Png,
+    Bmp,
+    Tga,
+    Jpeg
+};
+
+/* Encoder settings for one ImageData::write call. They stand in for the
+ * stb_image_write globals (stbi_write_png_compression_level,
+ * stbi_write_force_png_filter, stbi_write_tga_with_rle and
+ * stbi_flip_vertically_on_write), which ImageData::write does not read, so
+ * concurrent writes with different settings need no locking. Settings for
+ * formats other than the one being written are ignored. */
+struct EncodeOptions
+{
+    PngProfile pngProfile = PngProfile::Default;
+    /* zlib compression level, 0 (store) to 9. Unused by PngProfile::Fast. */
+    int pngLevel = 6;
+    /* -1 selects filters adaptively (per row, or per band with
+     * PngProfile::BandFilter); 0..4 forces that PNG filter on every row. */
+    int pngFilter = -1;
+    bool tgaRle = true;
+    /* Writes the rows bottom to top. */
+    bool flipVertically = false;
+    /* 1..100 */
+    int jpegQuality = 90;
+    JpegSubsampling jpegSubsampling = JpegSubsampling::Auto;
+    /* Puts a restart marker after every this many MCU rows (8 image rows,
+     * 16 with 4:2:0); 0 writes none. The bands between markers are coded
+     * independently, so ImageData::write encodes them in parallel, and
+     * decoders that support restart markers can split the file too. Each
+     * marker costs a few bytes; 4 to 16 suits large images. */
+    int jpegRestartRows = 0;
+    /* Writes Huffman tables fitted to the image instead of the Annex K
+     * ones, typically 5-10% smaller. Takes a second pass over quantized
+     * coefficients kept in memory (2 bytes per sample). StreamEncoder does
+     * not support it. */
+    bool jpegOptimizeHuffman = false;
+    /* Writes a progressive JPEG (libjpeg's default scan script, optimized
+     * tables for every scan) instead of a baseline one. Coefficients are
+     * computed once and kept in memory for all the scans (2 bytes per
+     * sample); jpegRestartRows is ignored. StreamEncoder does not support
+     * it. */
+    bool jpegProgressive = false;
+};
+
+/* Decoder settings for one ImageData::read call. */
+struct DecodeOptions
+{
+    /* Rotates and flips JPEG files the way their EXIF orientation tag asks,
+     * so the pixels come out upright; width and height are swapped for the
+     * orientations that turn the image a quarter. The decoder applies it as
+     * it writes its rows, with no second image buffer or pass. Other formats
+     * are read as stored. */
+    bool applyExifOrientation = false;
+};
+
+/* Resampling filters for ResizeOptions, from stb_image_resize2. Default
+ * is Catmull-Rom when enlarging and Mitchell when reducing. Point is several
+ * times faster than the cubics and fine for previews; Box and Triangle
+ * take a bit over half their time. Box averages whole source pixels at
+ * integer reduction ratios. */
+enum class ResizeFilter
+{
+    Default,
+    Point,
+    Box,
+    Triangle,
+    CubicBSpline,
+    CatmullRom,
+    Mitchell
+};
+
+/* What the filters see past the image borders. Wrap is slower and uses
+ * more memory than the others. */
+enum class ResizeEdge
+{
+    Clamp,
+    Reflect,
+    Wrap,
+    Zero
+};
+
+/* How ImageData<2> (grey, alpha) and ImageData<4> (RGBA) resize their last
+ * channel. Straight alpha weights the colours by it while filtering, so
+ * transparent pixels don't bleed their colour; Premultiplied colours are
+ * filtered as they are, which is also right for a fourth channel that
+ * isn't alpha at all. */
+enum class ResizeAlpha
+{
+    Straight,
+    Premultiplied
+};
+
+/* Where a resize spent its time. The wall clock times are always measured;
+ * the phases come from stb_image_resize2's STBIR_PROFILE counters, in CPU
+ * timestamp ticks (rdtsc on x86, the virtual counter on ARM64), and are
+ * only filled in by builds with the STB_IMAGE_PLUS_RESIZE_PROFILE CMake
+ * option, as `phasesAvailable` tells. */
+struct ResizeProfile
+{
+    /* Building the samplers (filter coefficients and scratch rows). A
+     * resize that reuses samplers, as ResizePlan::run and resizeInto do
+     * after their first call, leaves all of these at 0. */
+    struct SamplerPhases
+    {
+        std::uint64_t total = 0;
+        std::uint64_t build = 0;
+        std::uint64_t alloc = 0;
+        std::uint64_t horizontal = 0;
+        std::uint64_t vertical = 0;
+        std::uint64_t cleanup = 0;
+        std::uint64_t pivot = 0;
+    };
+
+    /* Resampling, summed over the bands resized in parallel, so the total
+     * may exceed the wall clock time. decode and encode are the conversions
+     * from and to the pixel format, alpha and unalpha the alpha weighting. */
+    struct ResamplePhases
+    {
+        std::uint64_t total = 0;
+        std::uint64_t looping = 0;
+        std::uint64_t vertical = 0;
+        std::uint64_t horizontal = 0;
+        std::uint64_t decode = 0;
+        std::uint64_t encode = 0;
+        std::uint64_t alpha = 0;
+        std::uint64_t unalpha = 0;
+    };
+
+    std::chrono::nanoseconds buildTime{0};
+    std::chrono::nanoseconds resampleTime{0};
+    bool phasesAvailable = false;
+    SamplerPhases build;
+    ResamplePhases resample;
+};
+
+/* Settings for ImageData::resize. */
+struct ResizeOptions
+{
+    /* The output is cut into up to this many bands of rows, resized in
+     * parallel on the library's worker pool; 0 uses every pool thread, 1
+     * runs on the calling thread. Small outputs use fewer bands. */
+    std::size_t threads = 0;
+    ResizeFilter filter = ResizeFilter::Default;
+    ResizeEdge edge = ResizeEdge::Clamp;
+    /* Filters in linear light, decoding the colour channels from sRGB and
+     * encoding them back, as resize(width, height) does; false filters
+     * the stored values directly, which is faster and right for data that
+     * isn't sRGB (normal maps, masks). Alpha is always linear. */
+    bool srgb = true;
+    ResizeAlpha alpha = ResizeAlpha::Straight;
+    /* With straight alpha, skips the extra work stb_image_resize2 does to
+     * give fully transparent pixels plausible colours, about 20% faster for
+     * RGBA when those colours don't matter. */
+    bool fastStraightAlpha = false;
+    /* If set, overwritten with the profile of every resize made with these
+     * options; a profile must not be shared by resizes running at once. */
+    ResizeProfile* profile = nullptr;
+};
+
+/* A rectangle of an image for ImageData::resizeRegion, in pixels from its
+ * top left corner. It may start and end between pixels. */
+struct ImageRect
+{
+    double x = 0.0;
+    double y = 0.0;
+    double width = 0.0;
+    double height = 0.0;
+};
+
+/* How ImageData::resizeToBox fits an image into its box. Fit scales the
+ * whole image to lie inside the box, keeping its aspect ratio, so one side
+ * of the result may be shorter than the box; Fill stretches the image to
+ * the box; Cover keeps the aspect ratio and fills the box, cropping the
+ * excess evenly off both sides. */
+enum class BoxFit
+{
+    Fit,
+    Fill,
+    Cover
+};
+
 template <std::size_t DesiredChannels>
 class ImageData
 {
@@ -37,24 +252,41 @@ public:
     ImageData(std::span<Pixel> pixelSpan, std::size_t width, std::size_t height);
     
     /* Initializes the current invalid object by reading an image file. */
-    bool read(const std::filesystem::path& filename);
+    bool read(const std::filesystem::path& filename, const DecodeOptions& options = {});
 
     /* Initializes the current invalid object by decoding image data from memory. */
-    bool readFromMemory(const std::uint8_t* data, std::size_t size);
+    bool readFromMemory(const std::uint8_t* data, std::size_t size, const DecodeOptions& options = {});
     
     /* Encode and write to disk. Format is selected from the filename
      * extension (case-insensitive): .png, .bmp, .tga, .jpg, .jpeg.
-     * Returns false for unsupported extensions or on encoder failure.
-     *
-     * `jpegQuality` controls JPEG output only (1..100, ignored for the
-     * lossless formats). 90 is a reasonable default for photographic
-     * content.
+     * Returns false for an invalid image, unsupported extensions or on
+     * encoder failure; the file is only created or replaced once the image
+     * has been encoded. `options` carries the per format settings, see EncodeOptions.
      *
      * Note: stb_image_write also provides HDR output, but that requires
      * float pixel data; ImageData<N> is uint8-based and therefore can't
      * round-trip HDR. Use the underlying stbi_write_hdr directly for
      * radiance maps. */
-    bool write(const std::filesystem::path& filename, int jpegQuality = 90);
+    bool write(const std::filesystem::path& filename, const EncodeOptions& options = {}) const;
+
+    /* Same as above with default options but for `jpegQuality` (1..100). */
+    bool write(const std::filesystem::path& filename, int jpegQuality) const;
+
+    /* Same as write, but appends the encoded `format` file to `out`.
+     * Capacity for the expected size is reserved up front and `out` is never
+     * shrunk, so a buffer that is cleared and passed again stops reallocating
+     * once it has grown to fit. On failure `out` keeps its previous contents. */
+    bool writeToMemory(ImageFormat format, std::vector<std::uint8_t>& out,
+                       const EncodeOptions& options = {}) const;
+
+    /* Appends to `out` a JPEG of at most `maxBytes` bytes at the highest
+     * quality that fits, and returns that quality (1..100); returns 0, with
+     * `out` unchanged, when not even quality 1 fits. Only `jpegQuality` in
+     * `options` is ignored. Cheaper than trying qualities with writeToMemory:
+     * colour conversion and the DCT run once for the whole search, which
+     * assumes the size grows with the quality. */
+    int encodeJpegToSize(std::size_t maxBytes, std::vector<std::uint8_t>& out,
+                         const EncodeOptions& options = {}) const;
     bool isValid() const;
     std::span<Pixel> pixelSpan();
     std::span<const Pixel> pixelSpan() const;
@@ -71,6 +303,41 @@ public:
     const Pixel& at(std::size_t col, std::size_t row) const;
     Pixel& at(std::size_t col, std::size_t row);
     ImageData<DesiredChannels> resize(std::size_t width, std::size_t height);
+
+    /* Same as above, with the filter, edges, colour space and alpha handling
+     * `options` asks for, multithreaded (by default on every thread of the
+     * worker pool). The result is the same whatever the thread count. Unlike
+     * resize(width, height), ImageData<2> treats its second channel as alpha.
+     * Returns an invalid ImageData on failure. */
+    ImageData<DesiredChannels> resize(std::size_t width, std::size_t height, const ResizeOptions& options) const;
+
+    /* Same as above, but resizes only `region` of this image, sampled in
+     * place without copying it out first; the filters still read the
+     * pixels just outside the region, as they would in a crop of a bigger
+     * resize. Returns an invalid ImageData if `region` is empty or not
+     * within the image, or if this image or the output is too large for
+     * stb_image_resize2 (width * channels or height above INT_MAX). */
+    ImageData<DesiredChannels> resizeRegion(const ImageRect& region, std::size_t width, std::size_t height,
+                                            const ResizeOptions& options = {}) const;
+
+    /* Resizes to a width x height box as `fit` asks, for thumbnails; Cover
+     * crops through resizeRegion. Returns an invalid ImageData on failure. */
+    ImageData<DesiredChannels> resizeToBox(std::size_t width, std::size_t height, BoxFit fit,
+                                           const ResizeOptions& options = {}) const;
+
+    /* Same as resize with `options`, but into the pixels of `destination`,
+     * at its size. The samplers stb_image_resize2 needs are kept per thread
+     * for the last size and options it resized to, so a loop resizing into
+     * the same frame allocates nothing after its first call. Returns false,
+     * leaving `destination` untouched, if either image is invalid or they
+     * are the same image. */
+    bool resizeInto(ImageData<DesiredChannels>& destination, const ResizeOptions& options = {}) const;
+
+    /* Same as above into `destination`, which holds `height` rows of `width`
+     * pixels starting every `stride` pixels, 0 meaning packed rows. Returns
+     * false for a span too small or overlapping this image's pixels. */
+    bool resizeInto(std::span<Pixel> destination, std::size_t width, std::size_t height, std::size_t stride,
+                    const ResizeOptions& options = {}) const;
     ImageData<DesiredChannels> resizeToWidth(std::size_t width);
     ImageData<DesiredChannels> resizeToHeight(std::size_t height);
     ~ImageData();
@@ -10,6 +10,17 @@
 namespace stb_image_plus
 {
 
+/* Palette strategy used when encoding an animation.
+ * Global builds a single 256-color table from all frames, which keeps the
+ * output small for footage with a stable palette. PerFrame quantizes every
+ * frame independently into a local color table, which preserves colors
+ * better when the scene changes a lot. */
+enum class GifPalette
+{
+    Global,
+    PerFrame
+};
+
 struct GifData
 {
     std::size_t width = 0;
@@ -23,6 +34,32 @@ struct GifData
     bool isValid() const;
     std::span<const std::uint8_t> framePixels(std::size_t frameIndex) const;
 
+    /* Resizes every frame to newWidth x newHeight and returns the result as a
+     * new GifData carrying the original frame delays. Frames are resized in
+     * parallel; since they all share the same geometry, each worker builds its
+     * stbir samplers once and reuses them for every frame it processes.
+     * Frames are filtered with the default ResizeOptions: in linear light,
+     * with the last of 2 or 4 channels as alpha.
+     * Returns an invalid GifData if this one is invalid, if either size is
+     * too large for stb_image_resize2 (width * channels or height above
+     * INT_MAX) or on resize failure. */
+    GifData resizeAll(std::size_t newWidth, std::size_t newHeight) const;
+
+    /* Encodes the animation as a looping GIF89a file.
+     * Frames are quantized and LZW-compressed in parallel, a window of frames
+     * at a time, and written out as soon as each window is done, so the whole
+     * encoded animation is never held in memory. Only the rectangle that
+     * changed since the previous frame is stored for each frame. Alpha below
+     * 128 becomes GIF transparency. A frame with no more colors than fit in
+     * a palette keeps them exactly. Delays are rounded to hundredths of a
+     * second, at most 655.35 s.
+     * Returns false if this GifData is invalid, wider or taller than 65535
+     * pixels, or on I/O failure. */
+    bool write(const std::filesystem::path& filename, GifPalette palette = GifPalette::PerFrame) const;
+
+    /* Same as write, but appends the encoded GIF to `out`. */
+    bool writeToMemory(std::vector<std::uint8_t>& out, GifPalette palette = GifPalette::PerFrame) const;
+
 private:
     struct PixelDeleter { void operator()(void* p) const; };
     std::unique_ptr<std::uint8_t, PixelDeleter> mPixels;
@@ -0,0 +1,112 @@
+#pragma once
+
+#include <stb_image_plus.h>
+#include <cstddef>
+#include <memory>
+#include <span>
+#include <vector>
+
+namespace stb_image_plus
+{
+
+/* Read-only pixels of an image owned by something else, with the accessors
+ * of ImageData. Valid only while its owner is alive and unchanged. */
+template <std::size_t Channels>
+class ImageView
+{
+public:
+    using Pixel = PixelT<Channels>;
+
+    ImageView() = default;
+    ImageView(std::span<const Pixel> pixelSpan, std::size_t width, std::size_t height)
+        : mPixels(pixelSpan), mWidth(width), mHeight(height) {}
+
+    bool isValid() const { return not mPixels.empty(); }
+    std::span<const Pixel> pixelSpan() const { return mPixels; }
+    std::size_t width() const { return mWidth; }
+    std::size_t height() const { return mHeight; }
+    const Pixel& at(std::size_t col, std::size_t row) const { return mPixels[mWidth * row + col]; }
+
+    /* Copies the pixels into a new ImageData, e.g. to write them out.
+     * Returns an invalid ImageData if this view is invalid. */
+    ImageData<Channels> copy() const;
+
+private:
+    std::span<const Pixel> mPixels;
+    std::size_t mWidth = 0;
+    std::size_t mHeight = 0;
+};
+
+/* Settings for ImagePyramid. */
+struct PyramidOptions
+{
+    /* Averages the colour channels in linear light, decoding them from sRGB
+     * and encoding them back, so that levels keep the brightness of the
+     * image; false averages the stored values, for textures that aren't
+     * sRGB (normal maps, masks). Alpha is always averaged as stored, and
+     * doesn't weight the colours. */
+    bool srgb = true;
+
+    /* A level whose parent has an odd width or height can't be a plain 2x2
+     * average. By default it is resampled from its parent with
+     * stb_image_resize2's box filter, which takes the odd column or row
+     * into account; false keeps the fast 2x2 path for it, which drops the
+     * parent's last column or row. */
+    bool resampleOddLevels = true;
+
+    /* Levels to build, the full size one included; 0 builds down to 1x1. */
+    std::size_t maxLevels = 0;
+};
+
+/* A mipmap chain: the image followed by levels of half the size of the one
+ * before (rounded down, at least 1) down to 1x1, as GPU APIs lay them out.
+ * All levels live in one allocation, level 0 first, so the whole chain can
+ * be uploaded from pixelSpan in one go. Each level is averaged from the one
+ * before with an SSE2 2x2 box filter, in a fraction of the time of calling
+ * ImageData::resize for every level. sRGB averages are within 1 of exact. */
+template <std::size_t Channels>
+class ImagePyramid
+{
+public:
+    using Pixel = PixelT<Channels>;
+
+    ImagePyramid() = default;
+
+    /* Builds the chain of `image`. Check isValid: an invalid image or a
+     * failure to resample an odd level leaves the pyramid invalid. */
+    explicit ImagePyramid(const ImageData<Channels>& image, const PyramidOptions& options = {});
+
+    bool isValid() const;
+    std::size_t levelCount() const;
+
+    /* Level `index`, 0 being the full size image. Returns an invalid view
+     * for an index past the last level. */
+    ImageView<Channels> level(std::size_t index) const;
+
+    /* Every level, one after the other. */
+    std::span<const Pixel> pixelSpan() const;
+
+private:
+    struct Level
+    {
+        std::size_t offset;
+        std::size_t width;
+        std::size_t height;
+    };
+
+    std::unique_ptr<Pixel[]> mPixels;
+    std::size_t mPixelCount = 0;
+    std::vector<Level> mLevels;
+};
+
+using ImageView1 = ImageView<1>;
+using ImageView2 = ImageView<2>;
+using ImageView3 = ImageView<3>;
+using ImageView4 = ImageView<4>;
+
+using ImagePyramid1 = ImagePyramid<1>;
+using ImagePyramid2 = ImagePyramid<2>;
+using ImagePyramid3 = ImagePyramid<3>;
+using ImagePyramid4 = ImagePyramid<4>;
+
+}
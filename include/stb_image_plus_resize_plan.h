@@ -0,0 +1,65 @@
+#pragma once
+
+#include <stb_image_plus.h>
+#include <cstddef>
+#include <memory>
+#include <span>
+
+namespace stb_image_plus
+{
+
+/* One resize geometry, set up once and then run on any number of images of
+ * the input size, for video or animation frames: the filter coefficients
+ * and scratch rows stb_image_resize2 needs (its samplers) are built by the
+ * constructor instead of on every call, so a run only resamples.
+ *
+ * run may be called from several threads at once. Each concurrent run
+ * takes a set of samplers of its own, built the first time that many runs
+ * overlap and kept for later runs, so a steady workload stops building
+ * them after its first few frames. The output is the same as
+ * ImageData::resize with the same options. A ResizeOptions::profile given
+ * to the constructor receives the profile of every run, which then must
+ * not overlap. */
+template <std::size_t Channels>
+class ResizePlan
+{
+public:
+    using Pixel = PixelT<Channels>;
+
+    /* Check isValid: zero or oversized dimensions, or a failure to build
+     * the samplers, leave the plan invalid. */
+    ResizePlan(std::size_t inputWidth, std::size_t inputHeight, std::size_t outputWidth,
+               std::size_t outputHeight, const ResizeOptions& options = {});
+    ResizePlan(ResizePlan&&) noexcept;
+    ResizePlan& operator=(ResizePlan&&) noexcept;
+    ~ResizePlan();
+
+    bool isValid() const;
+    std::size_t inputWidth() const;
+    std::size_t inputHeight() const;
+    std::size_t outputWidth() const;
+    std::size_t outputHeight() const;
+
+    /* Resizes `input` into a new ImageData. Returns an invalid ImageData if
+     * `input` is not inputWidth x inputHeight or on failure. */
+    ImageData<Channels> run(const ImageData<Channels>& input) const;
+
+    /* Resizes `input` into `output`, which must hold outputHeight rows of
+     * outputWidth pixels; rows start every `inputStride` and `outputStride`
+     * pixels, 0 meaning packed rows. Allocates nothing, the worker pool
+     * hand-off included, once the samplers for this level of concurrency
+     * exist. Returns false for spans too small or on failure. */
+    bool run(std::span<const Pixel> input, std::size_t inputStride, std::span<Pixel> output,
+             std::size_t outputStride) const;
+
+private:
+    struct State;
+    std::unique_ptr<State> mState;
+};
+
+using ResizePlan1 = ResizePlan<1>;
+using ResizePlan2 = ResizePlan<2>;
+using ResizePlan3 = ResizePlan<3>;
+using ResizePlan4 = ResizePlan<4>;
+
+}
@@ -0,0 +1,60 @@
+#pragma once
+
+#include <stb_image_plus.h>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <span>
+
+namespace stb_image_plus
+{
+
+/* Receives encoded bytes, in file order, as soon as they are final.
+ * Returning false aborts the encode. */
+using StreamSink = std::function<bool(std::span<const std::uint8_t>)>;
+
+/* Encodes a PNG or JPEG image that is handed over a batch of rows at a
+ * time, for images generated row by row that are too large to assemble in
+ * an ImageData first. Memory stays bounded by what the format needs to make
+ * progress: a window of bands (a few hundred KiB per pool thread) for PNG,
+ * one MCU row (8 or 16 rows) for JPEG.
+ * The bytes sent to the sink form the same file ImageData::write produces
+ * for the same pixels and options. EncodeOptions::flipVertically is not
+ * supported, since the last row would have to be written first, and neither
+ * are jpegOptimizeHuffman and jpegProgressive, which need the whole image
+ * before the first scan. */
+class StreamEncoder
+{
+public:
+    /* Starts an encode of a width x height image with `channels` (1..4)
+     * interleaved bytes per pixel. The file header goes to the sink right
+     * away. Check isValid: unsupported formats, dimensions or options leave
+     * the encoder invalid. */
+    StreamEncoder(ImageFormat format, std::size_t width, std::size_t height, std::size_t channels,
+                  StreamSink sink, const EncodeOptions& options = {});
+    StreamEncoder(StreamEncoder&&) noexcept;
+    StreamEncoder& operator=(StreamEncoder&&) noexcept;
+    ~StreamEncoder();
+
+    /* Appends the next rows, top to bottom, packed: `rows.size()` must be a
+     * multiple of width * channels. The file is complete once `height` rows
+     * were pushed. Returns false, and leaves the encoder invalid, for a
+     * partial row, rows past the end of the image or a sink that refused
+     * bytes. */
+    bool pushRows(std::span<const std::uint8_t> rows);
+
+    bool isValid() const;
+
+    /* True once every row was pushed and the whole file went to the sink. */
+    bool finished() const;
+
+    /* Rows pushed so far. */
+    std::size_t rowsPushed() const;
+
+private:
+    struct State;
+    std::unique_ptr<State> mState;
+};
+
+}
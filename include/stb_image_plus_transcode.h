@@ -0,0 +1,106 @@
+#pragma once
+
+#include <stb_image_plus.h>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace stb_image_plus
+{
+
+/* Estimates the quality (1..100) a JPEG file was saved at from its
+ * quantization tables, on the scale of EncodeOptions::jpegQuality (which
+ * is libjpeg's). Exact for files written by this library, stb_image_write
+ * or libjpeg with standard tables; for other encoders, the quality whose
+ * tables are closest. Only the headers are read. Returns 0 if `data` is not
+ * a JPEG this library can decode. */
+int estimateJpegQuality(const std::uint8_t* data, std::size_t size);
+
+/* Lossless transforms for transformJpeg; rotations are clockwise. The
+ * values 1..8 from None to Rotate270 are the EXIF orientations that each
+ * transform undoes. FromExif picks the one the file's EXIF orientation
+ * tag asks for, and sets the tag to 1 in the output. */
+enum class JpegTransform
+{
+    None = 1,
+    FlipHorizontal,
+    Rotate180,
+    FlipVertical,
+    Transpose,
+    Rotate90,
+    Transverse,
+    Rotate270,
+    FromExif
+};
+
+/* Settings for transformJpeg. */
+struct JpegTransformOptions
+{
+    JpegTransform transform = JpegTransform::None;
+    /* Crop rectangle in source pixels, applied before the transform; a
+     * width or height of 0 runs to the right or bottom edge. The
+     * origin is moved back to the MCU grid (8 or 16 pixels) and the
+     * rectangle widened to still cover the area asked for. */
+    std::size_t cropX = 0;
+    std::size_t cropY = 0;
+    std::size_t cropWidth = 0;
+    std::size_t cropHeight = 0;
+};
+
+/* Rotates, flips or crops a JPEG file without going through pixels, like
+ * jpegtran: the entropy decoded DCT blocks are moved around (their
+ * coefficients transposed or negated as needed) and coded again, which is
+ * much cheaper than a decode and encode and loses nothing. The output,
+ * appended to `out`, is a baseline JPEG with Huffman tables fitted to the
+ * image, for progressive sources too; APPn and COM segments are copied.
+ * As with jpegtran -trim, a partial MCU at an edge that a flip would move
+ * to the other side is dropped, so the width or height may shrink by less
+ * than an MCU (16 pixels for 4:2:0). Returns false, with `out` unchanged,
+ * for anything but an 8-bit Huffman coded JPEG, corrupt entropy coded
+ * data, a crop rectangle outside the image, or an image smaller than one
+ * MCU along a flipped axis. */
+bool transformJpeg(const std::uint8_t* data, std::size_t size, std::vector<std::uint8_t>& out,
+                   const JpegTransformOptions& options = {});
+
+/* Lowers the quality of a JPEG file without going through pixels: its
+ * entropy decoded DCT coefficients are requantized to the tables
+ * ImageData::write uses for `quality` (1..100) and coded again. That skips
+ * the inverse DCT, upsampling and colour conversion of the decode and all
+ * of the encode but its entropy coding. Table entries finer than the
+ * source's keep the source step, which could add no detail. The output,
+ * appended to `out`, is a baseline JPEG with Huffman tables fitted to the
+ * image and the source's chroma subsampling; APPn and COM segments are
+ * copied. Returns false, with `out` unchanged, for anything but an 8-bit
+ * Huffman coded JPEG or corrupt entropy coded data. */
+bool requantizeJpeg(const std::uint8_t* data, std::size_t size, int quality, std::vector<std::uint8_t>& out);
+
+/* Settings for transcode. */
+struct TranscodeOptions
+{
+    ImageFormat format = ImageFormat::Jpeg;
+    /* Output size; 0 keeps the source width or height. */
+    std::size_t width = 0;
+    std::size_t height = 0;
+    EncodeOptions encode;
+    /* Copies a JPEG source to the output unchanged, without decoding it,
+     * when the output is a JPEG of the same size, unflipped, and
+     * encode.jpegQuality is at least estimateJpegQuality of the source:
+     * re-encoding would only make the file bigger without making it look
+     * any better. The other JPEG settings in `encode` do not apply then. */
+    bool jpegPassthrough = true;
+    /* Lowers the quality of a JPEG source with requantizeJpeg, instead of
+     * decoding and encoding it, when the output is a JPEG of the same size,
+     * unflipped, and encode.jpegQuality is below the source's. Only
+     * encode.jpegQuality applies then. */
+    bool jpegRequantize = true;
+};
+
+/* Decodes an image file held in memory (any format ImageData::read takes),
+ * resizes it if asked to and appends it to `out` encoded as
+ * `options.format`, keeping the channel count of the source. Returns false,
+ * with `out` unchanged, if the source can't be decoded or on encoder
+ * failure. */
+bool transcode(const std::uint8_t* data, std::size_t size, std::vector<std::uint8_t>& out,
+               const TranscodeOptions& options = {});
+
+}
@@ -1,12 +1,22 @@
 #include <stb_image_plus.h>
+#include "stb_image_plus_bmp_tga.h"
+#include "stb_image_plus_jpeg.h"
+#include "stb_image_plus_png.h"
+#include "stb_image_plus_resize.h"
+#include "stb_image_plus_row_encoder.h"
 #include <stb_image.h>
 #include <stb_image_write.h>
 #include <stb_image_resize2.h>
 #include <algorithm>
 #include <cctype>
+#include <climits>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
 #include <fstream>
 #include <cstddef>
 #include <string>
+#include <vector>
 
 void DebugCheck(bool condition)
 {
@@ -19,6 +29,57 @@ void DebugCheck(bool condition)
 namespace stb_image_plus
 {
 
+namespace
+{
+
+// DecodeOptions are stb_image flags; the thread-local ones, so concurrent
+// reads with different options don't race.
+void applyDecodeOptions(const DecodeOptions& options)
+{
+    stbi_set_exif_orientation_on_load_thread(options.applyExifOrientation ? 1 : 0);
+}
+
+using Encoder = bool (*)(stbi_write_func*, void*, const std::uint8_t*, std::size_t, std::size_t,
+                         std::size_t, const EncodeOptions&);
+
+Encoder encoderFor(ImageFormat format)
+{
+    switch (format)
+    {
+        case ImageFormat::Png: return detail::writePng;
+        case ImageFormat::Bmp: return detail::writeBmp;
+        case ImageFormat::Tga: return detail::writeTga;
+        case ImageFormat::Jpeg: return detail::writeJpeg;
+    }
+    return nullptr;
+}
+
+// Bytes writeToMemory reserves for an encode. BMP and uncompressed TGA are
+// exact; the compressed formats get a generous typical size, past which
+// the vector grows as usual.
+std::size_t expectedSize(ImageFormat format, std::size_t width, std::size_t height, std::size_t channels,
+                         const EncodeOptions& options)
+{
+    const std::size_t pixels = width * height;
+    switch (format)
+    {
+        case ImageFormat::Png:
+            // Filtered rows, deflated to about half for photographic content.
+            return 64 + (width * channels + 1) * height / 2;
+        case ImageFormat::Bmp:
+            return channels == 4 ? 122 + pixels * 4 : 54 + (width * 3 + 3) / 4 * 4 * height;
+        case ImageFormat::Tga:
+            // Run-length packets cost at most one byte per 128 pixels.
+            return 18 + pixels * channels + (options.tgaRle ? height * ((width + 127) / 128) : 0);
+        case ImageFormat::Jpeg:
+            // About 4 bits per pixel at the top qualities, 1 to 2 below.
+            return 1024 + (options.jpegQuality >= 90 ? pixels / 2 : options.jpegQuality >= 75 ? pixels / 4 : pixels / 8);
+    }
+    return 0;
+}
+
+}
+
 template <std::size_t DesiredChannels>
 PixelT<DesiredChannels>::PixelT(std::initializer_list<std::uint8_t> values)
 {
@@ -93,7 +154,7 @@ ImageData<DesiredChannels>::ImageData(std::span<Pixel> pixelSpan, std::size_t wi
 }
 
 template <std::size_t DesiredChannels>
-bool ImageData<DesiredChannels>::read(const std::filesystem::path& filename)
+bool ImageData<DesiredChannels>::read(const std::filesystem::path& filename, const DecodeOptions& options)
 {
     DebugCheck(mPixelsPtr != nullptr);
 
@@ -101,6 +162,7 @@ bool ImageData<DesiredChannels>::read(const std::filesystem::path& filename)
     const char* filenameAsCharPtr = reinterpret_cast<const char*>(filenameAsUtf8.c_str());
 
     int width = 0, height = 0, internalChannels = 0;
+    applyDecodeOptions(options);
     stbi_uc* imageDataPtr = stbi_load(filenameAsCharPtr, &width, &height, &internalChannels, DesiredChannels);
     mPixelsPtr->data = reinterpret_cast<std::byte*>(imageDataPtr);
     mWidth = static_cast<std::size_t>(width);
@@ -111,10 +173,12 @@ bool ImageData<DesiredChannels>::read(const std::filesystem::path& filename)
 }
 
 template <std::size_t DesiredChannels>
-bool ImageData<DesiredChannels>::readFromMemory(const std::uint8_t* data, std::size_t size)
+bool ImageData<DesiredChannels>::readFromMemory(const std::uint8_t* data, std::size_t size,
+                                                const DecodeOptions& options)
 {
     DebugCheck(mPixelsPtr != nullptr);
     int width = 0, height = 0, internalChannels = 0;
+    applyDecodeOptions(options);
     stbi_uc* imageDataPtr = stbi_load_from_memory(
         data, static_cast<int>(size), &width, &height, &internalChannels, DesiredChannels);
     mPixelsPtr->data = reinterpret_cast<std::byte*>(imageDataPtr);
@@ -125,37 +189,74 @@ bool ImageData<DesiredChannels>::readFromMemory(const std::uint8_t* data, std::s
 }
 
 template <std::size_t DesiredChannels>
-bool ImageData<DesiredChannels>::write(const std::filesystem::path& filename, int jpegQuality)
+bool ImageData<DesiredChannels>::write(const std::filesystem::path& filename, const EncodeOptions& options) const
 {
     DebugCheck(mPixelsPtr != nullptr);
-    const std::u8string filenameAsUtf8 = filename.u8string();
-    const char* filenameAsCharPtr = reinterpret_cast<const char*>(filenameAsUtf8.c_str());
 
     std::string ext = filename.extension().string();
     std::transform(ext.begin(), ext.end(), ext.begin(),
                    [](unsigned char c) { return static_cast<char>(std::tolower(c)); });
 
-    // Dispatch to the matching stb_image_write encoder. All formats here
-    // operate on the uint8 pixel buffer the class owns; HDR (which needs
-    // float input) is intentionally not included — see header comment.
-    int result = 0;
+    // Dispatch to the matching encoder. All formats here operate on the
+    // uint8 pixel buffer the class owns; HDR (which needs float input) is
+    // intentionally not included — see header comment. The encoders take
+    // their settings from `options` only, never from the stb globals.
+    ImageFormat format;
     if (ext == ".png")
-        result = stbi_write_png(filenameAsCharPtr, width(), height(),
-                                DesiredChannels, mPixelsPtr->data,
-                                width() * DesiredChannels);
+        format = ImageFormat::Png;
     else if (ext == ".bmp")
-        result = stbi_write_bmp(filenameAsCharPtr, width(), height(),
-                                DesiredChannels, mPixelsPtr->data);
+        format = ImageFormat::Bmp;
     else if (ext == ".tga")
-        result = stbi_write_tga(filenameAsCharPtr, width(), height(),
-                                DesiredChannels, mPixelsPtr->data);
+        format = ImageFormat::Tga;
     else if (ext == ".jpg" || ext == ".jpeg")
-        result = stbi_write_jpg(filenameAsCharPtr, width(), height(),
-                                DesiredChannels, mPixelsPtr->data,
-                                jpegQuality);
+        format = ImageFormat::Jpeg;
     else
         return false;   // unsupported extension
-    return result != 0;
+
+    // Encoded before the file is opened, so that a failure leaves an
+    // existing file at that path as it was.
+    std::vector<std::uint8_t> encoded;
+    if (not writeToMemory(format, encoded, options))
+        return false;
+    std::ofstream file(filename, std::ios::binary | std::ios::trunc);
+    return file
+        && file.write(reinterpret_cast<const char*>(encoded.data()), static_cast<std::streamsize>(encoded.size()))
+        && file.flush();
+}
+
+template <std::size_t DesiredChannels>
+bool ImageData<DesiredChannels>::write(const std::filesystem::path& filename, int jpegQuality) const
+{
+    EncodeOptions options;
+    options.jpegQuality = jpegQuality;
+    return write(filename, options);
+}
+
+template <std::size_t DesiredChannels>
+bool ImageData<DesiredChannels>::writeToMemory(ImageFormat format, std::vector<std::uint8_t>& out,
+                                               const EncodeOptions& options) const
+{
+    DebugCheck(mPixelsPtr != nullptr);
+    const Encoder encoder = encoderFor(format);
+    if (encoder == nullptr or not isValid())
+        return false;
+
+    const std::size_t previousSize = out.size();
+    out.reserve(previousSize + expectedSize(format, width(), height(), DesiredChannels, options));
+    if (encoder(detail::writeToVector, &out, reinterpret_cast<const std::uint8_t*>(mPixelsPtr->data),
+                width(), height(), DesiredChannels, options))
+        return true;
+    out.resize(previousSize);
+    return false;
+}
+
+template <std::size_t DesiredChannels>
+int ImageData<DesiredChannels>::encodeJpegToSize(std::size_t maxBytes, std::vector<std::uint8_t>& out,
+                                                 const EncodeOptions& options) const
+{
+    DebugCheck(mPixelsPtr != nullptr);
+    return detail::writeJpegToSize(out, maxBytes, reinterpret_cast<const std::uint8_t*>(mPixelsPtr->data),
+                                   width(), height(), DesiredChannels, options);
 }
 
 template <std::size_t DesiredChannels>
@@ -244,6 +345,122 @@ ImageData<DesiredChannels> ImageData<DesiredChannels>::resize(std::size_t width,
     return {pixelSpan, width, height};
 }
 
+template <std::size_t DesiredChannels>
+ImageData<DesiredChannels> ImageData<DesiredChannels>::resize(std::size_t width, std::size_t height,
+                                                              const ResizeOptions& options) const
+{
+    const ImageRect wholeImage{0.0, 0.0, static_cast<double>(mWidth), static_cast<double>(mHeight)};
+    return resizeRegion(wholeImage, width, height, options);
+}
+
+template <std::size_t DesiredChannels>
+ImageData<DesiredChannels> ImageData<DesiredChannels>::resizeRegion(const ImageRect& region, std::size_t width,
+                                                                    std::size_t height,
+                                                                    const ResizeOptions& options) const
+{
+    // Checked before allocating: stbir would truncate sizes that don't fit.
+    if (not isValid() or width == 0 or height == 0 or not detail::fitsResize(DesiredChannels, mWidth, mHeight)
+        or not detail::fitsResize(DesiredChannels, width, height))
+        return {};
+    const double imageWidth = static_cast<double>(mWidth);
+    const double imageHeight = static_cast<double>(mHeight);
+    if (not (region.x >= 0.0 and region.y >= 0.0 and region.width > 0.0 and region.height > 0.0
+             and region.x + region.width <= imageWidth and region.y + region.height <= imageHeight))
+        return {};
+
+    // Allocated with malloc so that the destructor (stbi_image_free) can release it.
+    auto* output = static_cast<unsigned char*>(std::malloc(width * height * DesiredChannels));
+    if (output == nullptr)
+        return {};
+
+    STBIR_RESIZE resize;
+    // In stbir's normalized input coordinates; the whole image is its default.
+    if (not detail::initResize(resize, DesiredChannels, mPixelsPtr->data, mWidth, mHeight, DesiredChannels * mWidth,
+                               output, width, height, DesiredChannels * width, options)
+        or not stbir_set_input_subrect(&resize, region.x / imageWidth, region.y / imageHeight,
+                                    (region.x + region.width) / imageWidth,
+                                    (region.y + region.height) / imageHeight)
+        or not detail::resizeInParallel(resize, options.threads, options.profile))
+    {
+        std::free(output);
+        return {};
+    }
+
+    using Pixel = typename ImageData<DesiredChannels>::Pixel;
+    std::span<Pixel> pixelSpan(reinterpret_cast<Pixel*>(output), width * height);
+    return {pixelSpan, width, height};
+}
+
+template <std::size_t DesiredChannels>
+ImageData<DesiredChannels> ImageData<DesiredChannels>::resizeToBox(std::size_t width, std::size_t height,
+                                                                   BoxFit fit, const ResizeOptions& options) const
+{
+    if (not isValid() or width == 0 or height == 0)
+        return {};
+
+    const double imageWidth = static_cast<double>(mWidth);
+    const double imageHeight = static_cast<double>(mHeight);
+    const double scaleX = static_cast<double>(width) / imageWidth;
+    const double scaleY = static_cast<double>(height) / imageHeight;
+    switch (fit)
+    {
+        case BoxFit::Fit:
+        {
+            // The side that limits the scale fills the box, the other is rounded.
+            const double scale = std::min(scaleX, scaleY);
+            const auto fitWidth = std::clamp<std::size_t>(std::lround(imageWidth * scale), 1, width);
+            const auto fitHeight = std::clamp<std::size_t>(std::lround(imageHeight * scale), 1, height);
+            return resize(fitWidth, fitHeight, options);
+        }
+        case BoxFit::Fill:
+            return resize(width, height, options);
+        case BoxFit::Cover:
+        {
+            // The region of the box's aspect ratio, as large as the image allows.
+            const double scale = std::max(scaleX, scaleY);
+            const double regionWidth = std::min(static_cast<double>(width) / scale, imageWidth);
+            const double regionHeight = std::min(static_cast<double>(height) / scale, imageHeight);
+            const ImageRect region{(imageWidth - regionWidth) / 2.0, (imageHeight - regionHeight) / 2.0,
+                                   regionWidth, regionHeight};
+            return resizeRegion(region, width, height, options);
+        }
+    }
+    return {};
+}
+
+template <std::size_t DesiredChannels>
+bool ImageData<DesiredChannels>::resizeInto(ImageData<DesiredChannels>& destination,
+                                            const ResizeOptions& options) const
+{
+    if (not destination.isValid())
+        return false;
+    return resizeInto(destination.pixelSpan(), destination.width(), destination.height(), 0, options);
+}
+
+template <std::size_t DesiredChannels>
+bool ImageData<DesiredChannels>::resizeInto(std::span<Pixel> destination, std::size_t width, std::size_t height,
+                                            std::size_t stride, const ResizeOptions& options) const
+{
+    stride = stride != 0 ? stride : width;
+    if (not isValid() or width == 0 or height == 0 or stride < width or width > INT_MAX / DesiredChannels
+        or stride > INT_MAX / DesiredChannels or height > INT_MAX
+        or destination.size() < (height - 1) * stride + width)
+        return false;
+
+    // stbir can't resize in place.
+    const std::span<const Pixel> source = pixelSpan();
+    const auto sourceBegin = reinterpret_cast<std::uintptr_t>(source.data());
+    const auto sourceEnd = reinterpret_cast<std::uintptr_t>(source.data() + source.size());
+    const auto destinationBegin = reinterpret_cast<std::uintptr_t>(destination.data());
+    const auto destinationEnd = reinterpret_cast<std::uintptr_t>(destination.data() + destination.size());
+    if (destinationBegin < sourceEnd and sourceBegin < destinationEnd)
+        return false;
+
+    return detail::resizeWithCachedSamplers(DesiredChannels, source.data(), mWidth, mHeight,
+                                            DesiredChannels * mWidth, destination.data(), width, height,
+                                            DesiredChannels * stride, options);
+}
+
 template <std::size_t DesiredChannels>
 ImageData<DesiredChannels> ImageData<DesiredChannels>::resizeToWidth(std::size_t width)
 {
@@ -0,0 +1,192 @@
+#include "stb_image_plus_bmp_tga.h"
+#include <cstring>
+#include <vector>
+
+namespace stb_image_plus::detail
+{
+
+namespace
+{
+
+// Encoded bytes are handed to the output callback in pieces of about this size.
+constexpr std::size_t kFlushBytes = 64 * 1024;
+
+void put16(std::vector<std::uint8_t>& out, std::uint32_t value)
+{
+    out.push_back(static_cast<std::uint8_t>(value));
+    out.push_back(static_cast<std::uint8_t>(value >> 8));
+}
+
+void put32(std::vector<std::uint8_t>& out, std::uint32_t value)
+{
+    put16(out, value);
+    put16(out, value >> 16);
+}
+
+// Both formats store colour as BGR with alpha last. `expandGrey` writes
+// grey as three equal components (and drops a grey+alpha alpha), for BMP.
+void putPixel(std::vector<std::uint8_t>& out, const std::uint8_t* pixel, std::size_t channels, bool expandGrey)
+{
+    if (channels <= 2)
+    {
+        if (expandGrey)
+            out.insert(out.end(), 3, pixel[0]);
+        else
+            out.insert(out.end(), pixel, pixel + channels);
+        return;
+    }
+    out.insert(out.end(), {pixel[2], pixel[1], pixel[0]});
+    if (channels == 4)
+        out.push_back(pixel[3]);
+}
+
+void flushIfFull(stbi_write_func* func, void* context, std::vector<std::uint8_t>& out)
+{
+    if (out.size() < kFlushBytes)
+        return;
+    func(context, out.data(), static_cast<int>(out.size()));
+    out.clear();
+}
+
+// Both formats store rows bottom-up unless flipped.
+const std::uint8_t* storedRow(const std::uint8_t* pixels, std::size_t index, std::size_t height,
+                              std::size_t rowBytes, bool flip)
+{
+    return pixels + (flip ? index : height - 1 - index) * rowBytes;
+}
+
+// Appends one TGA scanline as run-length packets: up to 128 repeats of one
+// pixel, or up to 128 literal pixels that do not repeat their neighbour.
+void putRleRow(std::vector<std::uint8_t>& out, const std::uint8_t* row, std::size_t width, std::size_t channels)
+{
+    auto same = [&](std::size_t a, std::size_t b)
+    {
+        return std::memcmp(row + a * channels, row + b * channels, channels) == 0;
+    };
+    for (std::size_t i = 0, length = 0; i < width; i += length)
+    {
+        length = 1;
+        const bool run = i + 1 < width and same(i, i + 1);
+        if (i + 1 < width)
+        {
+            ++length;
+            for (std::size_t k = i + 2; k < width and length < 128; ++k)
+            {
+                if (run and same(i, k))
+                    ++length;
+                else if (not run and not same(k - 1, k))
+                    ++length;
+                else
+                {
+                    // A literal packet leaves its last pixel to start the next run.
+                    if (not run)
+                        --length;
+                    break;
+                }
+            }
+        }
+
+        if (run)
+        {
+            out.push_back(static_cast<std::uint8_t>(0x80 | (length - 1)));
+            putPixel(out, row + i * channels, channels, false);
+        }
+        else
+        {
+            out.push_back(static_cast<std::uint8_t>(length - 1));
+            for (std::size_t k = 0; k < length; ++k)
+                putPixel(out, row + (i + k) * channels, channels, false);
+        }
+    }
+}
+
+}
+
+bool writeBmp(stbi_write_func* func, void* context, const std::uint8_t* pixels,
+              std::size_t width, std::size_t height, std::size_t channels,
+              const EncodeOptions& options)
+{
+    if (pixels == nullptr or width == 0 or height == 0 or channels < 1 or channels > 4)
+        return false;
+
+    const bool alpha = channels == 4;
+    const std::size_t pad = alpha ? 0 : (4 - width * 3 % 4) % 4;
+    const std::uint32_t headerBytes = 14 + (alpha ? 108 : 40);
+    const std::size_t rowBytes = width * channels;
+
+    std::vector<std::uint8_t> out;
+    out.reserve(kFlushBytes + width * 4 + pad);
+    // File header
+    out.push_back('B');
+    out.push_back('M');
+    put32(out, static_cast<std::uint32_t>(headerBytes + (width * (alpha ? 4 : 3) + pad) * height));
+    put32(out, 0);
+    put32(out, headerBytes);
+    // Bitmap header; RGBA needs a V4 header with BI_BITFIELDS masks, as
+    // straight BI_RGB with alpha doesn't work in most readers.
+    put32(out, headerBytes - 14);
+    put32(out, static_cast<std::uint32_t>(width));
+    put32(out, static_cast<std::uint32_t>(height));
+    put16(out, 1);
+    put16(out, alpha ? 32 : 24);
+    put32(out, alpha ? 3 : 0);
+    for (int i = 0; i < 5; ++i)
+        put32(out, 0);
+    if (alpha)
+    {
+        for (std::uint32_t mask : {0xFF0000u, 0xFF00u, 0xFFu, 0xFF000000u})
+            put32(out, mask);
+        for (int i = 0; i < 13; ++i)
+            put32(out, 0);
+    }
+
+    for (std::size_t j = 0; j < height; ++j)
+    {
+        const std::uint8_t* row = storedRow(pixels, j, height, rowBytes, options.flipVertically);
+        for (std::size_t i = 0; i < width; ++i)
+            putPixel(out, row + i * channels, channels, true);
+        out.insert(out.end(), pad, 0);
+        flushIfFull(func, context, out);
+    }
+    func(context, out.data(), static_cast<int>(out.size()));
+    return true;
+}
+
+bool writeTga(stbi_write_func* func, void* context, const std::uint8_t* pixels,
+              std::size_t width, std::size_t height, std::size_t channels,
+              const EncodeOptions& options)
+{
+    if (pixels == nullptr or width == 0 or height == 0 or width > 0xFFFF or height > 0xFFFF
+        or channels < 1 or channels > 4)
+        return false;
+
+    const bool alpha = channels == 2 or channels == 4;
+    // Image type 2 is true colour, 3 is grey; +8 for the run-length variants.
+    const std::uint8_t type = static_cast<std::uint8_t>((channels <= 2 ? 3 : 2) + (options.tgaRle ? 8 : 0));
+    const std::size_t rowBytes = width * channels;
+
+    std::vector<std::uint8_t> out;
+    out.reserve(kFlushBytes + width * 5 + 2);
+    out.insert(out.end(), {0, 0, type, 0, 0, 0, 0, 0, 0, 0, 0, 0});
+    put16(out, static_cast<std::uint32_t>(width));
+    put16(out, static_cast<std::uint32_t>(height));
+    out.push_back(static_cast<std::uint8_t>(channels * 8));
+    out.push_back(alpha ? 8 : 0);
+
+    for (std::size_t j = 0; j < height; ++j)
+    {
+        const std::uint8_t* row = storedRow(pixels, j, height, rowBytes, options.flipVertically);
+        if (options.tgaRle)
+            putRleRow(out, row, width, channels);
+        else
+        {
+            for (std::size_t i = 0; i < width; ++i)
+                putPixel(out, row + i * channels, channels, false);
+        }
+        flushIfFull(func, context, out);
+    }
+    func(context, out.data(), static_cast<int>(out.size()));
+    return true;
+}
+
+}
@@ -0,0 +1,27 @@
+#pragma once
+
+#include <stb_image_plus.h>
+#include <stb_image_write.h>
+#include <cstddef>
+#include <cstdint>
+
+namespace stb_image_plus::detail
+{
+
+/* BMP and TGA encoders behind ImageData::write, following stbi_write_bmp
+ * and stbi_write_tga but taking TGA run-length encoding and vertical
+ * flipping from `options` instead of the stb_image_write globals. Output is
+ * identical to stb's except for run-length TGA: stb's literal packets can
+ * swallow the start of a run, these end where the run begins.
+ * `pixels` holds `channels` (1..4) interleaved bytes per pixel, rows packed.
+ * BMP is written as 24 bit BGR, or 32 bit for 4 channels: as in stb, grey
+ * is expanded to BGR and the alpha of grey+alpha is dropped. */
+bool writeBmp(stbi_write_func* func, void* context, const std::uint8_t* pixels,
+              std::size_t width, std::size_t height, std::size_t channels,
+              const EncodeOptions& options);
+
+bool writeTga(stbi_write_func* func, void* context, const std::uint8_t* pixels,
+              std::size_t width, std::size_t height, std::size_t channels,
+              const EncodeOptions& options);
+
+}
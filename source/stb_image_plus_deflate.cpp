@@ -0,0 +1,968 @@
+#include "stb_image_plus_deflate.h"
+#include "stb_image_plus_simd.h"
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cstdlib>
+#include <cstring>
+
+namespace stb_image_plus::detail
+{
+
+namespace
+{
+
+const std::uint16_t kLengthBase[] = {3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31, 35, 43, 51, 59,
+                                     67, 83, 99, 115, 131, 163, 195, 227, 258};
+const std::uint8_t kLengthExtra[] = {0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2, 3, 3, 3, 3,
+                                     4, 4, 4, 4, 5, 5, 5, 5, 0};
+const std::uint16_t kDistanceBase[] = {1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193, 257, 385, 513, 769,
+                                       1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577};
+const std::uint8_t kDistanceExtra[] = {0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6, 7, 7, 8, 8,
+                                       9, 9, 10, 10, 11, 11, 12, 12, 13, 13};
+// Order in which the code length code lengths are sent (RFC 1951, 3.2.7).
+const std::uint8_t kCodeLengthOrder[] = {16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15};
+
+constexpr std::size_t kMinMatch = 3;
+constexpr std::size_t kMaxMatch = 258;
+constexpr std::size_t kMaxDistance = kDeflateWindow - 1;
+constexpr std::size_t kTooFar = 4096; // 3 byte matches further away than this don't pay off
+constexpr int kHashBits = 15;
+constexpr std::uint32_t kNoPosition = ~std::uint32_t(0);
+constexpr std::size_t kBlockSymbols = 16384;
+constexpr std::size_t kLiteralLengthCodes = 286;
+constexpr std::size_t kDistanceCodes = 30;
+constexpr std::size_t kCodeLengthCodes = 19;
+
+// zlib's per level tuning: matches at least `goodLength` long cut the lazy
+// search to a quarter, `maxLazy` stops lazy evaluation (and, for the greedy
+// levels, bounds which matches get their positions hashed), `niceLength`
+// ends the chain walk and `maxChain` bounds it.
+struct LevelConfig
+{
+    std::uint16_t goodLength, maxLazy, niceLength, maxChain;
+    bool lazy;
+};
+constexpr LevelConfig kLevels[10] = {
+    {0, 0, 0, 0, false},
+    {4, 4, 8, 4, false},
+    {4, 5, 16, 8, false},
+    {4, 6, 32, 32, false},
+    {4, 4, 16, 16, true},
+    {8, 16, 32, 32, true},
+    {8, 16, 128, 128, true},
+    {8, 32, 128, 256, true},
+    {32, 128, 258, 1024, true},
+    {32, 258, 258, 4096, true},
+};
+
+int clampLevel(int level)
+{
+    return level < 0 ? 6 : std::min(level, 9);
+}
+
+// LSB-first bit packer as required by deflate. Whole 32 bit words are
+// staged locally and appended to the output in batches. The stage holds
+// words rather than bytes so that its stores can't alias the bit state.
+class BitWriter
+{
+public:
+    explicit BitWriter(std::vector<std::uint8_t>& out) : mOut(out) {}
+
+    // `count` is at most 32.
+    void put(std::uint32_t bits, int count)
+    {
+        mBuffer |= std::uint64_t(bits) << mCount;
+        mCount += count;
+        // Branch free: the word is always stored but only kept once full.
+        const std::uint64_t full = mCount >> 5;
+        mStage[mStaged] = static_cast<std::uint32_t>(mBuffer);
+        mStaged += full;
+        mBuffer >>= 32 * full;
+        mCount -= 32 * full;
+        if (mStaged == kStageWords)
+            drain();
+    }
+
+    // Pads to a byte boundary and hands everything to the output.
+    void alignToByte()
+    {
+        if (mCount % 8 != 0)
+            put(0, static_cast<int>(8 - mCount % 8));
+        drain();
+        for (; mCount > 0; mCount -= 8, mBuffer >>= 8)
+            mOut.push_back(static_cast<std::uint8_t>(mBuffer));
+    }
+
+    // Raw bytes; pads to a byte boundary first.
+    void putBytes(const std::uint8_t* data, std::size_t size)
+    {
+        alignToByte();
+        mOut.insert(mOut.end(), data, data + size);
+    }
+
+private:
+    static constexpr std::size_t kStageWords = 1024;
+
+    void drain()
+    {
+        const std::size_t offset = mOut.size();
+        mOut.resize(offset + 4 * mStaged);
+        for (std::size_t i = 0; i < mStaged; ++i)
+            for (int byte = 0; byte < 4; ++byte)
+                mOut[offset + 4 * i + byte] = static_cast<std::uint8_t>(mStage[i] >> (8 * byte));
+        mStaged = 0;
+    }
+
+    std::vector<std::uint8_t>& mOut;
+    std::uint64_t mBuffer = 0;
+    std::uint64_t mCount = 0;
+    std::size_t mStaged = 0;
+    std::array<std::uint32_t, kStageWords> mStage;
+};
+
+// Canonical Huffman code. Codes are kept bit-reversed so they can go
+// straight into the LSB-first BitWriter.
+template <std::size_t N>
+struct HuffmanCode
+{
+    std::array<std::uint8_t, N> lengths{};
+    std::array<std::uint16_t, N> codes{};
+
+    void assignCodes()
+    {
+        std::array<std::uint16_t, 16> lengthCount{}, nextCode{};
+        for (std::uint8_t length : lengths)
+            lengthCount[length]++;
+        lengthCount[0] = 0;
+        for (int bits = 1, code = 0; bits < 16; ++bits)
+        {
+            code = (code + lengthCount[bits - 1]) << 1;
+            nextCode[bits] = static_cast<std::uint16_t>(code);
+        }
+        for (std::size_t symbol = 0; symbol < N; ++symbol)
+        {
+            const int length = lengths[symbol];
+            if (length == 0)
+                continue;
+            std::uint32_t code = nextCode[length]++, reversed = 0;
+            for (int bit = 0; bit < length; ++bit, code >>= 1)
+                reversed = (reversed << 1) | (code & 1);
+            codes[symbol] = static_cast<std::uint16_t>(reversed);
+        }
+    }
+
+    void put(BitWriter& bits, std::size_t symbol) const { bits.put(codes[symbol], lengths[symbol]); }
+};
+
+// Some decoders reject a tree with a single code, so always give it two.
+template <std::size_t N>
+std::array<std::uint32_t, N> withTwoCodes(std::array<std::uint32_t, N> freqs)
+{
+    std::size_t used = std::count_if(freqs.begin(), freqs.end(), [](std::uint32_t freq) { return freq > 0; });
+    for (std::size_t symbol = 0; used < 2; ++symbol)
+    {
+        if (freqs[symbol] == 0)
+        {
+            freqs[symbol] = 1;
+            used++;
+        }
+    }
+    return freqs;
+}
+
+// Huffman code lengths for the first `count` of `freqs`, no longer than
+// `maxLength` bits. Over-long codes are folded back the way miniz does:
+// clamp, then rebalance the Kraft sum by pushing shorter codes a level down.
+template <std::size_t N>
+void buildCode(const std::array<std::uint32_t, N>& freqs, std::size_t count, int maxLength, HuffmanCode<N>& code)
+{
+    code.lengths.fill(0);
+    std::vector<std::uint16_t> symbols;
+    for (std::size_t symbol = 0; symbol < count; ++symbol)
+        if (freqs[symbol] > 0)
+            symbols.push_back(static_cast<std::uint16_t>(symbol));
+    std::sort(symbols.begin(), symbols.end(), [&](std::uint16_t a, std::uint16_t b)
+              { return freqs[a] != freqs[b] ? freqs[a] < freqs[b] : a < b; });
+
+    // Two-queue Huffman construction: leaves are sorted and internal nodes
+    // are created in non-decreasing weight order.
+    const std::size_t leaves = symbols.size();
+    const std::size_t nodes = 2 * leaves - 1;
+    std::vector<std::uint64_t> weight(nodes);
+    std::vector<std::uint32_t> parent(nodes, 0);
+    for (std::size_t i = 0; i < leaves; ++i)
+        weight[i] = freqs[symbols[i]];
+    std::size_t nextLeaf = 0, nextNode = leaves;
+    for (std::size_t node = leaves; node < nodes; ++node)
+    {
+        auto pick = [&]()
+        {
+            if (nextLeaf < leaves and (nextNode >= node or weight[nextLeaf] <= weight[nextNode]))
+                return nextLeaf++;
+            return nextNode++;
+        };
+        const std::size_t a = pick();
+        const std::size_t b = pick();
+        weight[node] = weight[a] + weight[b];
+        parent[a] = parent[b] = static_cast<std::uint32_t>(node);
+    }
+
+    // Parents always come after their children, so walk back from the root.
+    std::vector<std::uint32_t> depth(nodes, 0);
+    std::array<std::uint32_t, 16> lengthCount{};
+    for (std::size_t node = nodes - 1; node-- > 0;)
+    {
+        depth[node] = depth[parent[node]] + 1;
+        if (node < leaves)
+            lengthCount[std::min<std::uint32_t>(depth[node], maxLength)]++;
+    }
+
+    std::uint32_t kraft = 0;
+    for (int length = 1; length <= maxLength; ++length)
+        kraft += lengthCount[length] << (maxLength - length);
+    while (kraft > (1u << maxLength))
+    {
+        lengthCount[maxLength]--;
+        for (int length = maxLength - 1; length > 0; --length)
+        {
+            if (lengthCount[length] > 0)
+            {
+                lengthCount[length]--;
+                lengthCount[length + 1] += 2;
+                break;
+            }
+        }
+        kraft--;
+    }
+
+    // Rarest symbols get the longest codes.
+    std::size_t next = 0;
+    for (int length = maxLength; length > 0; --length)
+        for (std::uint32_t i = 0; i < lengthCount[length]; ++i)
+            code.lengths[symbols[next++]] = static_cast<std::uint8_t>(length);
+    code.assignCodes();
+}
+
+struct Tables
+{
+    std::array<std::uint8_t, kMaxMatch + 1> lengthCode{};
+    std::array<std::uint8_t, 256> distanceCodeLow{};  // indexed by distance - 1 up to 256
+    std::array<std::uint8_t, 256> distanceCodeHigh{}; // by (distance - 1) >> 7 beyond
+    HuffmanCode<288> fixedLiteralLength;
+    HuffmanCode<kDistanceCodes> fixedDistance;
+
+    std::uint8_t distanceCode(std::size_t distance) const
+    {
+        return distance <= 256 ? distanceCodeLow[distance - 1] : distanceCodeHigh[(distance - 1) >> 7];
+    }
+};
+
+const Tables& tables()
+{
+    static const Tables instance = []()
+    {
+        Tables t;
+        for (std::uint8_t code = 0; code < 29; ++code)
+            for (std::size_t length = kLengthBase[code];
+                 length < kLengthBase[code] + (1u << kLengthExtra[code]) and length < kMaxMatch; ++length)
+                t.lengthCode[length] = code;
+        t.lengthCode[kMaxMatch] = 28;
+        for (std::uint8_t code = 0; code < kDistanceCodes; ++code)
+        {
+            for (std::size_t distance = kDistanceBase[code];
+                 distance < kDistanceBase[code] + (1u << kDistanceExtra[code]); ++distance)
+            {
+                if (distance <= 256)
+                    t.distanceCodeLow[distance - 1] = code;
+                else
+                    t.distanceCodeHigh[(distance - 1) >> 7] = code;
+            }
+        }
+        // Fixed codes (RFC 1951, 3.2.6)
+        for (std::size_t symbol = 0; symbol < 288; ++symbol)
+            t.fixedLiteralLength.lengths[symbol] = symbol < 144 ? 8 : symbol < 256 ? 9 : symbol < 280 ? 7 : 8;
+        t.fixedLiteralLength.assignCodes();
+        t.fixedDistance.lengths.fill(5);
+        t.fixedDistance.assignCodes();
+        return t;
+    }();
+    return instance;
+}
+
+std::uint16_t load16(const std::uint8_t* data)
+{
+    std::uint16_t value;
+    std::memcpy(&value, data, sizeof(value));
+    return value;
+}
+
+// Length of the common prefix of `a` and `b`, at most `limit`.
+std::size_t matchLength(const std::uint8_t* a, const std::uint8_t* b, std::size_t limit)
+{
+    std::size_t length = 0;
+#ifdef STB_IMAGE_PLUS_SSE2
+    while (length + 16 <= limit)
+    {
+        const __m128i x = _mm_loadu_si128(reinterpret_cast<const __m128i*>(a + length));
+        const __m128i y = _mm_loadu_si128(reinterpret_cast<const __m128i*>(b + length));
+        const unsigned mismatch = ~static_cast<unsigned>(_mm_movemask_epi8(_mm_cmpeq_epi8(x, y))) & 0xFFFF;
+        if (mismatch != 0)
+            return length + std::countr_zero(mismatch);
+        length += 16;
+    }
+#endif
+    if constexpr (std::endian::native == std::endian::little)
+    {
+        while (length + 8 <= limit)
+        {
+            std::uint64_t x, y;
+            std::memcpy(&x, a + length, 8);
+            std::memcpy(&y, b + length, 8);
+            if (x != y)
+                return length + std::countr_zero(x ^ y) / 8;
+            length += 8;
+        }
+    }
+    while (length < limit and a[length] == b[length])
+        length++;
+    return length;
+}
+
+struct Symbol
+{
+    std::uint16_t literalOrLength;
+    std::uint16_t distance; // 0 for literals
+};
+
+struct CodeLengthRun
+{
+    std::uint8_t symbol; // 0..15 or one of the repeat codes 16..18
+    std::uint8_t repeat; // extra bits of the repeat codes
+};
+
+// State of one deflate() call: hash chains over the dictionary + data
+// buffer, and symbols gathered into blocks that are flushed with whichever
+// coding is cheapest.
+class Deflater
+{
+public:
+    Deflater(const std::uint8_t* buffer, std::size_t start, std::size_t end, const LevelConfig& config,
+             std::vector<std::uint8_t>& out)
+        : mBuffer(buffer), mEnd(end), mConfig(config), mBits(out), mBlockStart(start), mCovered(start)
+    {
+        mSymbols.reserve(kBlockSymbols);
+    }
+
+    BitWriter& bits() { return mBits; }
+
+    void compressGreedy()
+    {
+        startHashChains();
+        std::size_t position = mCovered;
+        while (position < mEnd)
+        {
+            const std::uint32_t chain = position + kMinMatch <= mEnd ? insert(position) : kNoPosition;
+            std::size_t distance = 0;
+            const std::size_t length = chain == kNoPosition ? 0 : longestMatch(position, chain, kMinMatch - 1, distance);
+            if (length >= kMinMatch)
+            {
+                putMatch(length, distance);
+                if (length <= mConfig.maxLazy)
+                    for (std::size_t k = position + 1; k < position + length and k + kMinMatch <= mEnd; ++k)
+                        insert(k);
+                position += length;
+            }
+            else
+                putLiteral(position++);
+        }
+    }
+
+    // zlib's deflate_slow: a match is only taken once the next position
+    // turns out not to start a longer one.
+    void compressLazy()
+    {
+        startHashChains();
+        std::size_t position = mCovered;
+        std::size_t previousLength = kMinMatch - 1, previousDistance = 0;
+        bool pendingLiteral = false;
+        while (position < mEnd)
+        {
+            const std::uint32_t chain = position + kMinMatch <= mEnd ? insert(position) : kNoPosition;
+            std::size_t length = kMinMatch - 1, distance = 0;
+            if (chain != kNoPosition and previousLength < mConfig.maxLazy)
+            {
+                length = longestMatch(position, chain, previousLength, distance);
+                if (length == kMinMatch and distance > kTooFar)
+                    length = kMinMatch - 1;
+            }
+
+            if (previousLength >= kMinMatch and length <= previousLength)
+            {
+                // The match starts at position - 1; `position` is hashed already.
+                putMatch(previousLength, previousDistance);
+                const std::size_t matchEnd = position - 1 + previousLength;
+                for (std::size_t k = position + 1; k < matchEnd and k + kMinMatch <= mEnd; ++k)
+                    insert(k);
+                position = matchEnd;
+                pendingLiteral = false;
+                previousLength = kMinMatch - 1;
+            }
+            else
+            {
+                if (pendingLiteral)
+                    putLiteral(position - 1);
+                pendingLiteral = true;
+                previousLength = length;
+                previousDistance = distance;
+                ++position;
+            }
+        }
+        if (pendingLiteral)
+            putLiteral(position - 1);
+    }
+
+    // zlib's Z_RLE: only distance 1 matches, i.e. runs of a repeated byte.
+    // No hashing and no history beyond the data itself. Everything goes out
+    // as one block, coded in two passes over the data (count, then emit)
+    // instead of going through the symbol buffer.
+    void compressRle(bool last)
+    {
+        const std::size_t start = mCovered;
+        auto scan = [&](auto&& literal, auto&& run)
+        {
+            std::size_t position = start;
+            if (position < mEnd)
+                literal(mBuffer[position++]);
+#ifdef STB_IMAGE_PLUS_SSE2
+            // Bit i of `runs` marks a run of at least 3 starting at position + i,
+            // so everything before the first set bit is plain literals.
+            while (position + 16 <= mEnd)
+            {
+                const __m128i current = _mm_loadu_si128(reinterpret_cast<const __m128i*>(mBuffer + position));
+                const __m128i previous = _mm_loadu_si128(reinterpret_cast<const __m128i*>(mBuffer + position - 1));
+                const unsigned equal = static_cast<unsigned>(_mm_movemask_epi8(_mm_cmpeq_epi8(current, previous)));
+                const unsigned runs = equal & (equal >> 1) & (equal >> 2);
+                const std::size_t literals = runs == 0 ? 14 : std::countr_zero(runs);
+                for (std::size_t i = 0; i < literals; ++i)
+                    literal(mBuffer[position + i]);
+                position += literals;
+                if (runs != 0)
+                {
+                    const std::size_t limit = std::min(kMaxMatch, mEnd - position);
+                    const std::size_t length = matchLength(mBuffer + position - 1, mBuffer + position, limit);
+                    run(length);
+                    position += length;
+                }
+            }
+#endif
+            while (position < mEnd)
+            {
+                if (mBuffer[position] != mBuffer[position - 1])
+                {
+                    literal(mBuffer[position++]);
+                    continue;
+                }
+                const std::size_t limit = std::min(kMaxMatch, mEnd - position);
+                const std::size_t length = limit >= kMinMatch ? matchLength(mBuffer + position - 1, mBuffer + position, limit) : 0;
+                if (length >= kMinMatch)
+                {
+                    run(length);
+                    position += length;
+                }
+                else
+                    literal(mBuffer[position++]);
+            }
+        };
+
+        BlockStats stats;
+        scan([&](std::uint8_t literal) { stats.addLiteral(literal); },
+             [&](std::size_t length) { stats.addMatch(length, 1); });
+        mCovered = mEnd;
+        putBlock(last, stats, [&](const HuffmanCode<288>& literalLength, const HuffmanCode<kDistanceCodes>& distances)
+        {
+            const Tables& t = tables();
+            scan([&](std::uint8_t literal) { literalLength.put(mBits, literal); },
+                 [&](std::size_t length) { codeMatch(literalLength, distances, t, length, 1); });
+        });
+    }
+
+    // Level 0: everything goes out as stored blocks.
+    void store(bool last)
+    {
+        mCovered = mEnd;
+        putStored(last);
+        mBlockStart = mCovered;
+    }
+
+    void flushBlock(bool last)
+    {
+        BlockStats stats;
+        for (const Symbol& symbol : mSymbols)
+        {
+            if (symbol.distance == 0)
+                stats.addLiteral(symbol.literalOrLength);
+            else
+                stats.addMatch(symbol.literalOrLength, symbol.distance);
+        }
+        putBlock(last, stats, [&](const HuffmanCode<288>& literalLength, const HuffmanCode<kDistanceCodes>& distances)
+        {
+            const Tables& t = tables();
+            for (const Symbol& symbol : mSymbols)
+            {
+                if (symbol.distance == 0)
+                    literalLength.put(mBits, symbol.literalOrLength);
+                else
+                    codeMatch(literalLength, distances, t, symbol.literalOrLength, symbol.distance);
+            }
+        });
+        mSymbols.clear();
+    }
+
+private:
+    struct BlockStats
+    {
+        std::array<std::uint32_t, 288> literalFreqs{};
+        std::array<std::uint32_t, kDistanceCodes> distanceFreqs{};
+        std::uint64_t extraBits = 0;
+
+        void addLiteral(std::uint8_t literal) { literalFreqs[literal]++; }
+
+        void addMatch(std::size_t length, std::size_t distance)
+        {
+            const Tables& t = tables();
+            const std::uint8_t lengthCode = t.lengthCode[length];
+            const std::uint8_t distanceCode = t.distanceCode(distance);
+            literalFreqs[257 + lengthCode]++;
+            distanceFreqs[distanceCode]++;
+            extraBits += kLengthExtra[lengthCode] + kDistanceExtra[distanceCode];
+        }
+    };
+
+    void codeMatch(const HuffmanCode<288>& literalLength, const HuffmanCode<kDistanceCodes>& distances,
+                   const Tables& t, std::size_t length, std::size_t distance)
+    {
+        const std::uint8_t lengthCode = t.lengthCode[length];
+        literalLength.put(mBits, 257 + lengthCode);
+        mBits.put(static_cast<std::uint32_t>(length - kLengthBase[lengthCode]), kLengthExtra[lengthCode]);
+        const std::uint8_t distanceCode = t.distanceCode(distance);
+        distances.put(mBits, distanceCode);
+        mBits.put(static_cast<std::uint32_t>(distance - kDistanceBase[distanceCode]), kDistanceExtra[distanceCode]);
+    }
+
+    // Emits the block covering [mBlockStart, mCovered) with whichever coding
+    // is cheapest for `stats`. `putSymbols(literalLength, distances)` writes
+    // the block's symbols with the chosen codes; the end-of-block code is
+    // added here.
+    template <typename PutSymbols>
+    void putBlock(bool last, BlockStats& stats, PutSymbols putSymbols)
+    {
+        const Tables& t = tables();
+        auto& literalFreqs = stats.literalFreqs;
+        auto& distanceFreqs = stats.distanceFreqs;
+        const std::uint64_t extraBits = stats.extraBits;
+        literalFreqs[256] = 1;
+
+        HuffmanCode<288> literalLength;
+        HuffmanCode<kDistanceCodes> distances;
+        buildCode(withTwoCodes(literalFreqs), kLiteralLengthCodes, 15, literalLength);
+        buildCode(withTwoCodes(distanceFreqs), kDistanceCodes, 15, distances);
+        std::size_t literalCodes = kLiteralLengthCodes, distanceCodes = kDistanceCodes;
+        while (literalCodes > 257 and literalLength.lengths[literalCodes - 1] == 0)
+            literalCodes--;
+        while (distanceCodes > 1 and distances.lengths[distanceCodes - 1] == 0)
+            distanceCodes--;
+
+        // Run-length code the concatenated code lengths with symbols 16..18.
+        std::vector<std::uint8_t> lengths(literalLength.lengths.begin(), literalLength.lengths.begin() + literalCodes);
+        lengths.insert(lengths.end(), distances.lengths.begin(), distances.lengths.begin() + distanceCodes);
+        std::vector<CodeLengthRun> runs;
+        for (std::size_t i = 0; i < lengths.size();)
+        {
+            const std::uint8_t value = lengths[i];
+            std::size_t run = 1;
+            while (i + run < lengths.size() and lengths[i + run] == value)
+                run++;
+            i += run;
+            if (value == 0)
+            {
+                for (std::size_t take; run >= 11; run -= take)
+                {
+                    take = std::min<std::size_t>(run, 138);
+                    runs.push_back({18, static_cast<std::uint8_t>(take - 11)});
+                }
+                if (run >= 3)
+                {
+                    runs.push_back({17, static_cast<std::uint8_t>(run - 3)});
+                    run = 0;
+                }
+            }
+            else
+            {
+                runs.push_back({value, 0});
+                run--;
+                for (std::size_t take; run >= 3; run -= take)
+                {
+                    take = std::min<std::size_t>(run, 6);
+                    runs.push_back({16, static_cast<std::uint8_t>(take - 3)});
+                }
+            }
+            for (; run > 0; run--)
+                runs.push_back({value, 0});
+        }
+        std::array<std::uint32_t, kCodeLengthCodes> codeLengthFreqs{};
+        for (const CodeLengthRun& run : runs)
+            codeLengthFreqs[run.symbol]++;
+        HuffmanCode<kCodeLengthCodes> codeLengths;
+        buildCode(withTwoCodes(codeLengthFreqs), kCodeLengthCodes, 7, codeLengths);
+        std::size_t codeLengthCodes = kCodeLengthCodes;
+        while (codeLengthCodes > 4 and codeLengths.lengths[kCodeLengthOrder[codeLengthCodes - 1]] == 0)
+            codeLengthCodes--;
+
+        // Pick the cheapest of dynamic, fixed and stored.
+        std::uint64_t dynamicBits = 3 + 14 + 3 * codeLengthCodes + extraBits;
+        std::uint64_t fixedBits = 3 + extraBits;
+        for (std::size_t symbol = 0; symbol < kCodeLengthCodes; ++symbol)
+            dynamicBits += std::uint64_t(codeLengthFreqs[symbol]) * codeLengths.lengths[symbol];
+        dynamicBits += 2 * codeLengthFreqs[16] + 3 * codeLengthFreqs[17] + 7 * codeLengthFreqs[18];
+        for (std::size_t symbol = 0; symbol < kLiteralLengthCodes; ++symbol)
+        {
+            dynamicBits += std::uint64_t(literalFreqs[symbol]) * literalLength.lengths[symbol];
+            fixedBits += std::uint64_t(literalFreqs[symbol]) * t.fixedLiteralLength.lengths[symbol];
+        }
+        for (std::size_t symbol = 0; symbol < kDistanceCodes; ++symbol)
+        {
+            dynamicBits += std::uint64_t(distanceFreqs[symbol]) * distances.lengths[symbol];
+            fixedBits += std::uint64_t(distanceFreqs[symbol]) * 5;
+        }
+        const std::size_t rawSize = mCovered - mBlockStart;
+        const std::uint64_t storedBits = (rawSize / 65535 + 1) * (3 + 7 + 32) + 8 * std::uint64_t(rawSize);
+
+        if (storedBits < std::min(dynamicBits, fixedBits))
+            putStored(last);
+        else if (fixedBits <= dynamicBits)
+        {
+            mBits.put(last ? 1 : 0, 1);
+            mBits.put(1, 2);
+            putSymbols(t.fixedLiteralLength, t.fixedDistance);
+            t.fixedLiteralLength.put(mBits, 256);
+        }
+        else
+        {
+            mBits.put(last ? 1 : 0, 1);
+            mBits.put(2, 2);
+            mBits.put(static_cast<std::uint32_t>(literalCodes - 257), 5);
+            mBits.put(static_cast<std::uint32_t>(distanceCodes - 1), 5);
+            mBits.put(static_cast<std::uint32_t>(codeLengthCodes - 4), 4);
+            for (std::size_t i = 0; i < codeLengthCodes; ++i)
+                mBits.put(codeLengths.lengths[kCodeLengthOrder[i]], 3);
+            static const int repeatBits[] = {2, 3, 7};
+            for (const CodeLengthRun& run : runs)
+            {
+                codeLengths.put(mBits, run.symbol);
+                if (run.symbol >= 16)
+                    mBits.put(run.repeat, repeatBits[run.symbol - 16]);
+            }
+            putSymbols(literalLength, distances);
+            literalLength.put(mBits, 256);
+        }
+        mBlockStart = mCovered;
+    }
+
+    // Allocates the chains and hashes the dictionary part of the buffer.
+    void startHashChains()
+    {
+        mHead.assign(std::size_t(1) << kHashBits, kNoPosition);
+        mPrev.assign(kDeflateWindow, kNoPosition);
+        for (std::size_t position = 0; position < mCovered and position + kMinMatch <= mEnd; ++position)
+            insert(position);
+    }
+
+    static std::uint32_t hash(const std::uint8_t* data)
+    {
+        const std::uint32_t value = data[0] | (data[1] << 8) | (data[2] << 16);
+        return (value * 2654435761u) >> (32 - kHashBits);
+    }
+
+    // Links `position` into its chain and returns the previous chain head.
+    std::uint32_t insert(std::size_t position)
+    {
+        std::uint32_t& head = mHead[hash(mBuffer + position)];
+        const std::uint32_t previous = head;
+        mPrev[position & (kDeflateWindow - 1)] = previous;
+        head = static_cast<std::uint32_t>(position);
+        return previous;
+    }
+
+    // Walks the chain from `candidate` for a match longer than `bestLength`.
+    // Returns the best length found, `bestLength` itself if none is longer.
+    std::size_t longestMatch(std::size_t position, std::uint32_t candidate, std::size_t bestLength,
+                             std::size_t& distance) const
+    {
+        const std::size_t limit = std::min(kMaxMatch, mEnd - position);
+        if (bestLength >= limit)
+            return bestLength;
+        std::uint32_t chain = mConfig.maxChain;
+        if (bestLength >= mConfig.goodLength)
+            chain >>= 2;
+        const std::uint8_t* current = mBuffer + position;
+        while (chain-- > 0 and position - candidate <= kMaxDistance)
+        {
+            const std::uint8_t* match = mBuffer + candidate;
+            // Cheap reject: a longer match must agree around bestLength and
+            // at the start (bestLength >= 2 here).
+            if (load16(match + bestLength - 1) == load16(current + bestLength - 1)
+                and load16(match) == load16(current))
+            {
+                const std::size_t length = matchLength(match, current, limit);
+                if (length > bestLength)
+                {
+                    bestLength = length;
+                    distance = position - candidate;
+                    if (length >= mConfig.niceLength or length == limit)
+                        break;
+                }
+            }
+            const std::uint32_t next = mPrev[candidate & (kDeflateWindow - 1)];
+            if (next == kNoPosition or next >= candidate)
+                break;
+            candidate = next;
+        }
+        return bestLength;
+    }
+
+    void putLiteral(std::size_t position)
+    {
+        mSymbols.push_back({mBuffer[position], 0});
+        mCovered++;
+        if (mSymbols.size() == kBlockSymbols)
+            flushBlock(false);
+    }
+
+    void putMatch(std::size_t length, std::size_t distance)
+    {
+        mSymbols.push_back({static_cast<std::uint16_t>(length), static_cast<std::uint16_t>(distance)});
+        mCovered += length;
+        if (mSymbols.size() == kBlockSymbols)
+            flushBlock(false);
+    }
+
+    void putStored(bool last)
+    {
+        const std::size_t size = mCovered - mBlockStart;
+        std::size_t offset = 0;
+        do
+        {
+            const std::size_t blockSize = std::min<std::size_t>(size - offset, 65535);
+            mBits.put(last and offset + blockSize == size ? 1 : 0, 1);
+            mBits.put(0, 2);
+            mBits.alignToByte();
+            mBits.put(static_cast<std::uint32_t>(blockSize), 16);
+            mBits.put(static_cast<std::uint32_t>(~blockSize & 0xFFFF), 16);
+            mBits.putBytes(mBuffer + mBlockStart + offset, blockSize);
+            offset += blockSize;
+        } while (offset < size);
+    }
+
+    const std::uint8_t* mBuffer;
+    std::size_t mEnd;
+    const LevelConfig& mConfig;
+    BitWriter mBits;
+    std::vector<std::uint32_t> mHead;
+    std::vector<std::uint32_t> mPrev;
+    std::vector<Symbol> mSymbols;
+    std::size_t mBlockStart; // first byte not in a flushed block yet
+    std::size_t mCovered;    // first byte not covered by a symbol yet
+};
+
+// Slicing-by-8: eight bytes per step through eight derived tables.
+std::uint32_t crc32Table(std::uint32_t crc, const std::uint8_t* data, std::size_t size)
+{
+    static const std::array<std::array<std::uint32_t, 256>, 8> table = []()
+    {
+        std::array<std::array<std::uint32_t, 256>, 8> entries{};
+        for (std::uint32_t n = 0; n < 256; ++n)
+        {
+            std::uint32_t c = n;
+            for (int k = 0; k < 8; ++k)
+                c = (c & 1) ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+            entries[0][n] = c;
+        }
+        for (std::uint32_t n = 0; n < 256; ++n)
+            for (int slice = 1; slice < 8; ++slice)
+                entries[slice][n] = entries[0][entries[slice - 1][n] & 0xFF] ^ (entries[slice - 1][n] >> 8);
+        return entries;
+    }();
+
+    for (; size >= 8; data += 8, size -= 8)
+    {
+        const std::uint32_t low = crc ^ (data[0] | (data[1] << 8) | (data[2] << 16) | (std::uint32_t(data[3]) << 24));
+        crc = table[7][low & 0xFF] ^ table[6][(low >> 8) & 0xFF] ^ table[5][(low >> 16) & 0xFF] ^ table[4][low >> 24]
+            ^ table[3][data[4]] ^ table[2][data[5]] ^ table[1][data[6]] ^ table[0][data[7]];
+    }
+    for (std::size_t i = 0; i < size; ++i)
+        crc = table[0][(crc ^ data[i]) & 0xFF] ^ (crc >> 8);
+    return crc;
+}
+
+#ifdef STB_IMAGE_PLUS_PCLMUL
+// Carry-less multiply folding (Intel, "Fast CRC Computation for Generic
+// Polynomials Using PCLMULQDQ") with the constants of the Linux
+// crc32-pclmul driver. Folding preserves the remainder of the message, so
+// the last 128 bits are finished with the table instead of a Barrett step.
+// Takes the inverted register and at least 64 bytes, consumes every whole
+// 16 byte block and returns the register for the remaining tail.
+std::uint32_t crc32Fold(std::uint32_t crc, const std::uint8_t*& data, std::size_t& size)
+{
+    const __m128i foldBy4 = _mm_set_epi64x(0x1C6E41596, 0x154442BD4);
+    const __m128i foldBy1 = _mm_set_epi64x(0x0CCAA009E, 0x1751997D0);
+    auto load = [](const std::uint8_t* p) { return _mm_loadu_si128(reinterpret_cast<const __m128i*>(p)); };
+    auto fold = [](__m128i x, __m128i next, __m128i k)
+    {
+        const __m128i low = _mm_clmulepi64_si128(x, k, 0x00);
+        const __m128i high = _mm_clmulepi64_si128(x, k, 0x11);
+        return _mm_xor_si128(_mm_xor_si128(low, high), next);
+    };
+
+    __m128i x0 = _mm_xor_si128(load(data), _mm_cvtsi32_si128(static_cast<int>(crc)));
+    __m128i x1 = load(data + 16), x2 = load(data + 32), x3 = load(data + 48);
+    data += 64;
+    size -= 64;
+    for (; size >= 64; data += 64, size -= 64)
+    {
+        x0 = fold(x0, load(data), foldBy4);
+        x1 = fold(x1, load(data + 16), foldBy4);
+        x2 = fold(x2, load(data + 32), foldBy4);
+        x3 = fold(x3, load(data + 48), foldBy4);
+    }
+    x0 = fold(fold(fold(x0, x1, foldBy1), x2, foldBy1), x3, foldBy1);
+    for (; size >= 16; data += 16, size -= 16)
+        x0 = fold(x0, load(data), foldBy1);
+
+    std::uint8_t remainder[16];
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(remainder), x0);
+    return crc32Table(0, remainder, 16);
+}
+#endif
+
+}
+
+std::uint32_t adler32(std::uint32_t adler, const std::uint8_t* data, std::size_t size)
+{
+    std::uint32_t s1 = adler & 0xFFFF, s2 = adler >> 16;
+    while (size > 0)
+    {
+        // 5552 is the largest run that cannot overflow 32-bit sums.
+        const std::size_t run = std::min<std::size_t>(size, 5552);
+        for (std::size_t i = 0; i < run; ++i)
+        {
+            s1 += data[i];
+            s2 += s1;
+        }
+        s1 %= 65521;
+        s2 %= 65521;
+        data += run;
+        size -= run;
+    }
+    return (s2 << 16) | s1;
+}
+
+std::uint32_t adler32Combine(std::uint32_t adlerA, std::uint32_t adlerB, std::size_t sizeB)
+{
+    constexpr std::uint32_t kBase = 65521;
+    const std::uint32_t remainder = static_cast<std::uint32_t>(sizeB % kBase);
+    std::uint32_t s1 = adlerA & 0xFFFF;
+    std::uint32_t s2 = static_cast<std::uint32_t>((std::uint64_t(remainder) * s1) % kBase);
+    s1 += (adlerB & 0xFFFF) + kBase - 1;
+    s2 += (adlerA >> 16) + (adlerB >> 16) + kBase - remainder;
+    s1 %= kBase;
+    s2 %= kBase;
+    return (s2 << 16) | s1;
+}
+
+std::uint32_t crc32(std::uint32_t crc, const std::uint8_t* data, std::size_t size)
+{
+    crc = ~crc;
+#ifdef STB_IMAGE_PLUS_PCLMUL
+    if (size >= 64)
+        crc = crc32Fold(crc, data, size);
+#endif
+    return ~crc32Table(crc, data, size);
+}
+
+void deflate(std::span<const std::uint8_t> dictionary, std::span<const std::uint8_t> data,
+             int level, bool finalBlock, std::vector<std::uint8_t>& out, DeflateStrategy strategy)
+{
+    level = clampLevel(level);
+    if (dictionary.size() > kDeflateWindow)
+        dictionary = dictionary.last(kDeflateWindow);
+    if (level == 0 or strategy == DeflateStrategy::Rle)
+        dictionary = {}; // no use for history, and joining it would cost a copy
+
+    // Matching works on one contiguous buffer; bands cut from the same
+    // filtered image usually are contiguous already, otherwise copy.
+    std::vector<std::uint8_t> joined;
+    const std::uint8_t* buffer = dictionary.empty() ? data.data() : dictionary.data();
+    if (!dictionary.empty() and dictionary.data() + dictionary.size() != data.data())
+    {
+        joined.reserve(dictionary.size() + data.size());
+        joined.insert(joined.end(), dictionary.begin(), dictionary.end());
+        joined.insert(joined.end(), data.begin(), data.end());
+        buffer = joined.data();
+    }
+
+    Deflater deflater(buffer, dictionary.size(), dictionary.size() + data.size(), kLevels[level], out);
+    if (level == 0)
+        deflater.store(finalBlock);
+    else
+    {
+        if (strategy == DeflateStrategy::Rle)
+            deflater.compressRle(finalBlock);
+        else
+        {
+            if (kLevels[level].lazy)
+                deflater.compressLazy();
+            else
+                deflater.compressGreedy();
+            deflater.flushBlock(finalBlock);
+        }
+    }
+
+    BitWriter& bits = deflater.bits();
+    if (!finalBlock)
+    {
+        // Sync flush: an empty stored block re-aligns the stream to a byte.
+        bits.put(0, 3);
+        bits.alignToByte();
+        bits.put(0x0000, 16);
+        bits.put(0xFFFF, 16);
+    }
+    bits.alignToByte();
+}
+
+void putZlibHeader(int level, std::vector<std::uint8_t>& out)
+{
+    level = clampLevel(level);
+    out.push_back(0x78); // deflate, 32K window
+    out.push_back(level <= 1 ? 0x01 : level <= 5 ? 0x5E : level == 6 ? 0x9C : 0xDA);
+}
+
+unsigned char* zlibCompress(unsigned char* data, int dataLength, int* outLength, int quality)
+{
+    const std::span<const std::uint8_t> input(data, static_cast<std::size_t>(std::max(dataLength, 0)));
+    std::vector<std::uint8_t> stream;
+    putZlibHeader(quality, stream);
+    deflate({}, input, quality, true, stream);
+    const std::uint32_t adler = adler32(1, input.data(), input.size());
+    for (int shift = 24; shift >= 0; shift -= 8)
+        stream.push_back(static_cast<std::uint8_t>(adler >> shift));
+
+    auto* result = static_cast<unsigned char*>(std::malloc(stream.size()));
+    if (result == nullptr)
+        return nullptr;
+    std::memcpy(result, stream.data(), stream.size());
+    *outLength = static_cast<int>(stream.size());
+    return result;
+}
+
+}
@@ -0,0 +1,54 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <vector>
+
+namespace stb_image_plus::detail
+{
+
+/* Deflate window size; also the most dictionary data deflate() looks at. */
+constexpr std::size_t kDeflateWindow = 32768;
+
+/* Running checksums with zlib conventions: start adler32 from 1 and crc32
+ * from 0, then feed the data in order. crc32 uses PCLMUL folding when the
+ * build enables it (see STB_IMAGE_PLUS_AVX2). */
+std::uint32_t adler32(std::uint32_t adler, const std::uint8_t* data, std::size_t size);
+std::uint32_t crc32(std::uint32_t crc, const std::uint8_t* data, std::size_t size);
+
+/* Adler-32 of A followed by B, given adler32(A), adler32(B) and B's length.
+ * Lets independently checksummed pieces of a stream be stitched together. */
+std::uint32_t adler32Combine(std::uint32_t adlerA, std::uint32_t adlerB, std::size_t sizeB);
+
+/* Match finding strategy. Rle only looks for runs of the previous byte
+ * (zlib's Z_RLE), which is cheap and still catches the zero runs of
+ * filtered image rows. */
+enum class DeflateStrategy
+{
+    Default,
+    Rle
+};
+
+/* Compresses `data` as raw deflate blocks appended to `out`.
+ * Matches may reach back into `dictionary`, the (up to 32 KiB of) bytes that
+ * precede `data` in the uncompressed stream. Unless `finalBlock` is set the
+ * output is closed with a sync flush, leaving it byte aligned so that pieces
+ * compressed on different threads can simply be concatenated.
+ *
+ * `level` follows zlib: 0 stores, 1..3 match greedily, 4..9 use lazy
+ * matching with longer hash chains. Each block is emitted with dynamic
+ * Huffman codes, the fixed codes or stored, whichever is smallest.
+ * With DeflateStrategy::Rle any non-zero level behaves the same. */
+void deflate(std::span<const std::uint8_t> dictionary, std::span<const std::uint8_t> data,
+             int level, bool finalBlock, std::vector<std::uint8_t>& out,
+             DeflateStrategy strategy = DeflateStrategy::Default);
+
+/* Appends the two byte zlib stream header advertising `level`. */
+void putZlibHeader(int level, std::vector<std::uint8_t>& out);
+
+/* Drop-in for stbi_zlib_compress, hooked into stb_image_write through
+ * STBIW_ZLIB_COMPRESS. Returns a malloc'd zlib stream, freed by stb. */
+unsigned char* zlibCompress(unsigned char* data, int dataLength, int* outLength, int quality);
+
+}
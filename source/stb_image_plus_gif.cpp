@@ -1,5 +1,10 @@
 #include <stb_image_plus_gif.h>
 #include <stb_image.h>
+#include "stb_image_plus_parallel.h"
+#include "stb_image_plus_resize.h"
+#include <algorithm>
+#include <atomic>
+#include <cstdlib>
 #include <fstream>
 #include <cstring>
 
@@ -71,4 +76,66 @@ std::span<const std::uint8_t> GifData::framePixels(std::size_t frameIndex) const
     return { frameStart, bytesPerFrame };
 }
 
+GifData GifData::resizeAll(std::size_t newWidth, std::size_t newHeight) const
+{
+    GifData resized;
+    if (!isValid() || newWidth == 0 || newHeight == 0 || !detail::fitsResize(channels, width, height)
+        || !detail::fitsResize(channels, newWidth, newHeight))
+        return resized;
+
+    const std::size_t bytesPerFrame = newWidth * newHeight * channels;
+    // Allocated with malloc so that PixelDeleter (stbi_image_free) can release it.
+    auto* resizedPixels = static_cast<std::uint8_t*>(std::malloc(bytesPerFrame * frameCount));
+    if (!resizedPixels)
+        return resized;
+    resized.mPixels.reset(resizedPixels);
+
+    const std::size_t inputStride = width * channels;
+    const std::size_t outputStride = newWidth * channels;
+
+    detail::WorkerPool& pool = detail::WorkerPool::instance();
+    const std::size_t lanes = std::min(frameCount, pool.concurrency());
+    std::atomic<std::size_t> nextFrame{0};
+    std::atomic<bool> failed{false};
+
+    pool.parallelFor(lanes, [&](std::size_t)
+    {
+        // Every lane owns one STBIR_RESIZE. Its samplers (filter coefficients
+        // and scratch memory) are built once and reused for each frame the
+        // lane picks up; only the buffer pointers change between frames.
+        // Default options: sRGB, the last channel of 2 and 4 as straight alpha.
+        STBIR_RESIZE resize;
+        if (!detail::initResize(resize, channels, nullptr, width, height, inputStride,
+                                nullptr, newWidth, newHeight, outputStride, ResizeOptions{})
+            || !stbir_build_samplers(&resize))
+        {
+            failed = true;
+            return;
+        }
+
+        for (std::size_t frame = nextFrame++; frame < frameCount; frame = nextFrame++)
+        {
+            stbir_set_buffer_ptrs(&resize,
+                                  framePixels(frame).data(), static_cast<int>(inputStride),
+                                  resizedPixels + frame * bytesPerFrame, static_cast<int>(outputStride));
+            if (!stbir_resize_extended(&resize))
+                failed = true;
+        }
+        stbir_free_samplers(&resize);
+    });
+
+    if (failed)
+    {
+        resized.mPixels.reset();
+        return resized;
+    }
+
+    resized.width       = newWidth;
+    resized.height      = newHeight;
+    resized.frameCount  = frameCount;
+    resized.channels    = channels;
+    resized.frameDelays = frameDelays;
+    return resized;
+}
+
 }
@@ -0,0 +1,752 @@
+#include <stb_image_plus_gif.h>
+#include "stb_image_plus_parallel.h"
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cstring>
+#include <fstream>
+#include <functional>
+
+namespace stb_image_plus
+{
+
+namespace
+{
+
+using ByteSink = std::function<bool(const std::uint8_t*, std::size_t)>;
+using Color = std::array<std::uint8_t, 3>;
+
+// Colors are bucketed on a 5:5:5 RGB grid for histograms and palette lookups.
+constexpr std::size_t kGridBins = 1 << 15;
+constexpr std::uint8_t kAlphaThreshold = 128;
+// Dimensions and delays are stored in 16 bits.
+constexpr std::size_t kMaxField = 0xFFFF;
+// Frames are quantized and compressed in windows of this many frames per
+// pool thread; only one window of encoded frames is ever kept in memory.
+constexpr std::size_t kFramesPerThread = 2;
+
+struct Rgba
+{
+    std::uint8_t r, g, b, a;
+};
+
+Rgba readPixel(const std::uint8_t* pixel, std::size_t channels)
+{
+    switch (channels)
+    {
+        case 1: return {pixel[0], pixel[0], pixel[0], 255};
+        case 2: return {pixel[0], pixel[0], pixel[0], pixel[1]};
+        case 3: return {pixel[0], pixel[1], pixel[2], 255};
+        default: return {pixel[0], pixel[1], pixel[2], pixel[3]};
+    }
+}
+
+std::size_t gridBin(const Rgba& color)
+{
+    return (std::size_t(color.r >> 3) << 10) | (std::size_t(color.g >> 3) << 5) | std::size_t(color.b >> 3);
+}
+
+struct Rect
+{
+    std::size_t x = 0, y = 0, width = 0, height = 0;
+};
+
+struct Histogram
+{
+    struct Bin
+    {
+        std::uint32_t count = 0;
+        std::uint64_t r = 0, g = 0, b = 0;
+    };
+    std::vector<Bin> bins = std::vector<Bin>(kGridBins);
+
+    void add(const Rgba& color)
+    {
+        Bin& bin = bins[gridBin(color)];
+        bin.count++;
+        bin.r += color.r;
+        bin.g += color.g;
+        bin.b += color.b;
+    }
+
+    void merge(const Histogram& other)
+    {
+        for (std::size_t i = 0; i < kGridBins; ++i)
+        {
+            bins[i].count += other.bins[i].count;
+            bins[i].r += other.bins[i].r;
+            bins[i].g += other.bins[i].g;
+            bins[i].b += other.bins[i].b;
+        }
+    }
+};
+
+struct Palette
+{
+    std::vector<Color> colors;
+    int transparentIndex = -1;
+    // Nearest palette entry per grid bin, -1 until first needed. Exact
+    // palettes hold every color they map, sorted by grid bin, and the
+    // lookup points at the first one of each bin instead.
+    std::vector<std::int16_t> lookup = std::vector<std::int16_t>(kGridBins, -1);
+    bool exact = false;
+
+    std::size_t entries() const { return colors.size() + (transparentIndex >= 0 ? 1 : 0); }
+
+    // log2 of the color table size; GIF tables hold 2..256 entries.
+    int tableBits() const
+    {
+        int bits = 1;
+        while ((std::size_t(1) << bits) < entries())
+            bits++;
+        return bits;
+    }
+
+    std::int16_t nearest(std::size_t bin) const
+    {
+        const int r = int((bin >> 10) & 31) << 3 | 4;
+        const int g = int((bin >> 5) & 31) << 3 | 4;
+        const int b = int(bin & 31) << 3 | 4;
+        int best = 0, bestDistance = 1 << 30;
+        for (std::size_t i = 0; i < colors.size(); ++i)
+        {
+            const int dr = r - colors[i][0], dg = g - colors[i][1], db = b - colors[i][2];
+            const int distance = dr * dr + dg * dg + db * db;
+            if (distance < bestDistance)
+            {
+                bestDistance = distance;
+                best = static_cast<int>(i);
+            }
+        }
+        return static_cast<std::int16_t>(best);
+    }
+
+    std::uint8_t exactIndex(const Rgba& color) const
+    {
+        std::size_t i = static_cast<std::size_t>(lookup[gridBin(color)]);
+        while (colors[i] != Color{color.r, color.g, color.b})
+            i++;
+        return static_cast<std::uint8_t>(i);
+    }
+
+    // Shared (global) palettes are filled up front so concurrent map calls
+    // only ever read the lookup table.
+    void fillLookup()
+    {
+        if (exact)
+            return;
+        const std::size_t chunk = 1024;
+        detail::WorkerPool::instance().parallelFor(kGridBins / chunk, [&](std::size_t block)
+        {
+            for (std::size_t bin = block * chunk; bin < (block + 1) * chunk; ++bin)
+                lookup[bin] = nearest(bin);
+        });
+    }
+
+    // Per-frame palettes are owned by a single thread and fill their lookup
+    // lazily; shared palettes go through the read-only overload below.
+    std::uint8_t map(const Rgba& color)
+    {
+        if (color.a < kAlphaThreshold and transparentIndex >= 0)
+            return static_cast<std::uint8_t>(transparentIndex);
+        if (colors.empty())
+            return 0;
+        if (exact)
+            return exactIndex(color);
+        std::int16_t& entry = lookup[gridBin(color)];
+        if (entry < 0)
+            entry = nearest(gridBin(color));
+        return static_cast<std::uint8_t>(entry);
+    }
+
+    std::uint8_t map(const Rgba& color) const
+    {
+        if (color.a < kAlphaThreshold and transparentIndex >= 0)
+            return static_cast<std::uint8_t>(transparentIndex);
+        if (colors.empty())
+            return 0;
+        if (exact)
+            return exactIndex(color);
+        return static_cast<std::uint8_t>(lookup[gridBin(color)]);
+    }
+};
+
+std::size_t maxPaletteColors(bool withTransparency)
+{
+    return withTransparency ? 255 : 256;
+}
+
+// The distinct colors added, as long as they fit in a palette: frames with
+// few colors (pixel art, UI captures) then keep them exactly rather than
+// through the 5:5:5 grid. An open-addressing set of packed RGB, like the
+// LZW dictionary.
+class ColorSet
+{
+public:
+    explicit ColorSet(bool withTransparency) : mMaxColors(maxPaletteColors(withTransparency)) {}
+
+    bool fits() const { return mColors.size() <= mMaxColors; }
+
+    // Returns false once there are too many colors.
+    bool add(const Rgba& color)
+    {
+        // Packed with a marker bit, so that 0 is an empty slot.
+        const std::uint32_t key = 1u << 24 | std::uint32_t(color.r) << 16 | std::uint32_t(color.g) << 8 | color.b;
+        if (key == mLastKey)
+            return true;
+        mLastKey = key;
+        std::size_t slot = (key * 2654435761u) >> (32 - 10);
+        while (mKeys[slot] != 0 and mKeys[slot] != key)
+            slot = (slot + 1) & (kTableSize - 1);
+        if (mKeys[slot] == 0)
+        {
+            mKeys[slot] = key;
+            mColors.push_back({color.r, color.g, color.b});
+        }
+        return fits();
+    }
+
+    // A palette of exactly these colors.
+    Palette toPalette(bool withTransparency)
+    {
+        Palette palette;
+        std::sort(mColors.begin(), mColors.end(), [](const Color& a, const Color& b)
+        {
+            const std::size_t binA = gridBin({a[0], a[1], a[2], 255}), binB = gridBin({b[0], b[1], b[2], 255});
+            return binA != binB ? binA < binB : a < b;
+        });
+        for (std::size_t i = mColors.size(); i-- > 0;)
+            palette.lookup[gridBin({mColors[i][0], mColors[i][1], mColors[i][2], 255})] =
+                static_cast<std::int16_t>(i);
+        palette.colors = std::move(mColors);
+        palette.exact = true;
+        if (withTransparency)
+            palette.transparentIndex = static_cast<int>(palette.colors.size());
+        return palette;
+    }
+
+private:
+    // At most 257 keys, so the table stays under half full.
+    static constexpr std::size_t kTableSize = 1 << 10;
+
+    std::size_t mMaxColors;
+    std::array<std::uint32_t, kTableSize> mKeys{};
+    std::uint32_t mLastKey = 0;
+    std::vector<Color> mColors;
+};
+
+// Median cut over the occupied histogram bins, weighted by pixel count.
+Palette buildPalette(const Histogram& histogram, bool withTransparency)
+{
+    Palette palette;
+    const std::size_t maxColors = maxPaletteColors(withTransparency);
+
+    std::vector<std::uint16_t> occupied;
+    for (std::size_t bin = 0; bin < kGridBins; ++bin)
+        if (histogram.bins[bin].count > 0)
+            occupied.push_back(static_cast<std::uint16_t>(bin));
+
+    auto axisValue = [](std::uint16_t bin, int axis) { return (bin >> (10 - 5 * axis)) & 31; };
+
+    struct Box
+    {
+        std::size_t begin, end;
+        std::uint64_t pixels;
+        int axis, range;
+    };
+    auto makeBox = [&](std::size_t begin, std::size_t end)
+    {
+        Box box{begin, end, 0, 0, -1};
+        int low[3] = {31, 31, 31}, high[3] = {0, 0, 0};
+        for (std::size_t i = begin; i < end; ++i)
+        {
+            box.pixels += histogram.bins[occupied[i]].count;
+            for (int axis = 0; axis < 3; ++axis)
+            {
+                low[axis] = std::min(low[axis], axisValue(occupied[i], axis));
+                high[axis] = std::max(high[axis], axisValue(occupied[i], axis));
+            }
+        }
+        for (int axis = 0; axis < 3; ++axis)
+            if (high[axis] - low[axis] > box.range)
+            {
+                box.range = high[axis] - low[axis];
+                box.axis = axis;
+            }
+        return box;
+    };
+
+    std::vector<Box> boxes;
+    if (!occupied.empty())
+        boxes.push_back(makeBox(0, occupied.size()));
+
+    while (boxes.size() < maxColors)
+    {
+        // Split the box with the most pixels spread over the widest range.
+        Box* target = nullptr;
+        std::uint64_t bestScore = 0;
+        for (Box& box : boxes)
+        {
+            const std::uint64_t score = box.pixels * std::uint64_t(box.range);
+            if (box.end - box.begin >= 2 and box.range > 0 and score >= bestScore)
+            {
+                bestScore = score;
+                target = &box;
+            }
+        }
+        if (target == nullptr)
+            break;
+
+        const int axis = target->axis;
+        std::sort(occupied.begin() + target->begin, occupied.begin() + target->end,
+                  [&](std::uint16_t a, std::uint16_t b) { return axisValue(a, axis) < axisValue(b, axis); });
+
+        std::uint64_t accumulated = 0;
+        std::size_t split = target->begin + 1;
+        for (std::size_t i = target->begin; i < target->end - 1; ++i)
+        {
+            accumulated += histogram.bins[occupied[i]].count;
+            split = i + 1;
+            if (accumulated * 2 >= target->pixels)
+                break;
+        }
+
+        const std::size_t begin = target->begin, end = target->end;
+        *target = makeBox(begin, split);
+        boxes.push_back(makeBox(split, end));
+    }
+
+    for (const Box& box : boxes)
+    {
+        std::uint64_t r = 0, g = 0, b = 0;
+        for (std::size_t i = box.begin; i < box.end; ++i)
+        {
+            const Histogram::Bin& bin = histogram.bins[occupied[i]];
+            r += bin.r;
+            g += bin.g;
+            b += bin.b;
+        }
+        palette.colors.push_back({static_cast<std::uint8_t>(r / box.pixels),
+                                  static_cast<std::uint8_t>(g / box.pixels),
+                                  static_cast<std::uint8_t>(b / box.pixels)});
+    }
+    if (withTransparency)
+        palette.transparentIndex = static_cast<int>(palette.colors.size());
+    return palette;
+}
+
+// GIF flavoured LZW: variable code width up to 12 bits, clear code emitted
+// when the dictionary fills up. The dictionary is an open-addressing hash of
+// (prefix code, next index) pairs.
+class LzwEncoder
+{
+public:
+    LzwEncoder(int minCodeSize, std::vector<std::uint8_t>& out) :
+        mOut(out),
+        mMinCodeSize(minCodeSize),
+        mClearCode(1 << minCodeSize),
+        mKeys(kTableSize),
+        mCodes(kTableSize)
+    {
+        resetDictionary();
+        emit(mClearCode);
+    }
+
+    void encode(const std::uint8_t* indices, std::size_t count, std::size_t stride, std::size_t rows)
+    {
+        int prefix = -1;
+        for (std::size_t row = 0; row < rows; ++row)
+        {
+            const std::uint8_t* line = indices + row * stride;
+            for (std::size_t i = 0; i < count; ++i)
+            {
+                const int symbol = line[i];
+                if (prefix < 0)
+                {
+                    prefix = symbol;
+                    continue;
+                }
+
+                const std::uint32_t key = (std::uint32_t(prefix) << 8 | std::uint32_t(symbol)) + 1;
+                std::size_t slot = hash(key);
+                while (mKeys[slot] != 0 and mKeys[slot] != key)
+                    slot = (slot + 1) & (kTableSize - 1);
+                if (mKeys[slot] == key)
+                {
+                    prefix = mCodes[slot];
+                    continue;
+                }
+
+                emit(prefix);
+                if (mNextCode >= kMaxCode)
+                {
+                    emit(mClearCode);
+                    resetDictionary();
+                }
+                else
+                {
+                    mKeys[slot] = key;
+                    mCodes[slot] = static_cast<std::uint16_t>(mNextCode++);
+                }
+                prefix = symbol;
+            }
+        }
+        if (prefix >= 0)
+            emit(prefix);
+        emit(mClearCode + 1);
+        if (mBitCount > 0)
+            mOut.push_back(static_cast<std::uint8_t>(mBitBuffer));
+    }
+
+private:
+    static constexpr std::size_t kTableSize = 1 << 13;
+    static constexpr int kMaxCode = 4095;
+
+    static std::size_t hash(std::uint32_t key)
+    {
+        return (key * 2654435761u) >> (32 - 13);
+    }
+
+    void resetDictionary()
+    {
+        std::fill(mKeys.begin(), mKeys.end(), 0u);
+        mNextCode = mClearCode + 2;
+        mCodeSize = mMinCodeSize + 1;
+    }
+
+    void emit(int code)
+    {
+        mBitBuffer |= std::uint32_t(code) << mBitCount;
+        mBitCount += mCodeSize;
+        while (mBitCount >= 8)
+        {
+            mOut.push_back(static_cast<std::uint8_t>(mBitBuffer));
+            mBitBuffer >>= 8;
+            mBitCount -= 8;
+        }
+        // Widen codes as soon as the next dictionary entry no longer fits,
+        // matching the decoder's deferred table update.
+        if (mNextCode >= (1 << mCodeSize) and mCodeSize < 12)
+            mCodeSize++;
+    }
+
+    std::vector<std::uint8_t>& mOut;
+    int mMinCodeSize, mClearCode, mNextCode = 0, mCodeSize = 0;
+    std::uint32_t mBitBuffer = 0;
+    int mBitCount = 0;
+    std::vector<std::uint32_t> mKeys;
+    std::vector<std::uint16_t> mCodes;
+};
+
+struct EncodedFrame
+{
+    Rect rect;
+    Palette localPalette;
+    bool hasLocalPalette = false;
+    int transparentIndex = -1;
+    int minCodeSize = 2;
+    std::vector<std::uint8_t> lzw;
+};
+
+class GifEncoder
+{
+public:
+    GifEncoder(const GifData& gif, GifPalette paletteMode, const ByteSink& sink) :
+        mGif(gif), mPaletteMode(paletteMode), mSink(sink), mOk(true)
+    {
+    }
+
+    bool run()
+    {
+        detail::WorkerPool& pool = detail::WorkerPool::instance();
+        mTransparent = detectTransparency();
+        if (mPaletteMode == GifPalette::Global)
+        {
+            ColorSet colors(mTransparent);
+            for (std::size_t frame = 0; frame < mGif.frameCount and colors.fits(); ++frame)
+                addToColors(colors, frame, {0, 0, mGif.width, mGif.height});
+            mGlobalPalette = colors.fits() ? colors.toPalette(mTransparent)
+                                           : buildPalette(globalHistogram(), mTransparent);
+            mGlobalPalette.fillLookup();
+        }
+
+        writeHeader();
+
+        const std::size_t window = pool.concurrency() * kFramesPerThread;
+        std::vector<EncodedFrame> frames(window);
+        for (std::size_t first = 0; first < mGif.frameCount and mOk; first += window)
+        {
+            const std::size_t count = std::min(window, mGif.frameCount - first);
+            pool.parallelFor(count, [&](std::size_t i) { encodeFrame(first + i, frames[i]); });
+            for (std::size_t i = 0; i < count and mOk; ++i)
+            {
+                writeFrame(first + i, frames[i]);
+                frames[i] = EncodedFrame();
+            }
+        }
+
+        put({0x3B});
+        return mOk;
+    }
+
+private:
+    const std::uint8_t* pixelAt(std::size_t frame, std::size_t x, std::size_t y) const
+    {
+        return mGif.framePixels(frame).data() + (y * mGif.width + x) * mGif.channels;
+    }
+
+    bool detectTransparency() const
+    {
+        if (mGif.channels != 2 and mGif.channels != 4)
+            return false;
+        std::atomic<bool> found{false};
+        detail::WorkerPool::instance().parallelFor(mGif.frameCount, [&](std::size_t frame)
+        {
+            std::span<const std::uint8_t> pixels = mGif.framePixels(frame);
+            for (std::size_t i = mGif.channels - 1; i < pixels.size() and not found; i += mGif.channels)
+                if (pixels[i] < kAlphaThreshold)
+                    found = true;
+        });
+        return found;
+    }
+
+    Histogram globalHistogram() const
+    {
+        detail::WorkerPool& pool = detail::WorkerPool::instance();
+        const std::size_t lanes = std::min(mGif.frameCount, pool.concurrency());
+        std::vector<Histogram> partial(lanes);
+        std::atomic<std::size_t> nextFrame{0};
+        pool.parallelFor(lanes, [&](std::size_t lane)
+        {
+            for (std::size_t frame = nextFrame++; frame < mGif.frameCount; frame = nextFrame++)
+                addToHistogram(partial[lane], frame, {0, 0, mGif.width, mGif.height});
+        });
+        for (std::size_t lane = 1; lane < lanes; ++lane)
+            partial[0].merge(partial[lane]);
+        return std::move(partial[0]);
+    }
+
+    void addToHistogram(Histogram& histogram, std::size_t frame, const Rect& rect) const
+    {
+        for (std::size_t y = rect.y; y < rect.y + rect.height; ++y)
+            for (std::size_t x = rect.x; x < rect.x + rect.width; ++x)
+            {
+                const Rgba color = readPixel(pixelAt(frame, x, y), mGif.channels);
+                if (color.a >= kAlphaThreshold or not mTransparent)
+                    histogram.add(color);
+            }
+    }
+
+    // Stops early once the colors no longer fit.
+    void addToColors(ColorSet& colors, std::size_t frame, const Rect& rect) const
+    {
+        for (std::size_t y = rect.y; y < rect.y + rect.height; ++y)
+            for (std::size_t x = rect.x; x < rect.x + rect.width; ++x)
+            {
+                const Rgba color = readPixel(pixelAt(frame, x, y), mGif.channels);
+                if ((color.a >= kAlphaThreshold or not mTransparent) and not colors.add(color))
+                    return;
+            }
+    }
+
+    // Bounding box of the pixels that differ from the previous frame. With
+    // transparency every frame is stored whole and disposed to background,
+    // since transparent pixels would otherwise show the previous frame.
+    Rect changedRect(std::size_t frame) const
+    {
+        Rect full{0, 0, mGif.width, mGif.height};
+        if (frame == 0 or mTransparent)
+            return full;
+
+        const std::size_t rowBytes = mGif.width * mGif.channels;
+        auto rowDiffers = [&](std::size_t y)
+        {
+            return std::memcmp(pixelAt(frame, 0, y), pixelAt(frame - 1, 0, y), rowBytes) != 0;
+        };
+        auto columnDiffers = [&](std::size_t x, std::size_t top, std::size_t bottom)
+        {
+            for (std::size_t y = top; y < bottom; ++y)
+                if (std::memcmp(pixelAt(frame, x, y), pixelAt(frame - 1, x, y), mGif.channels) != 0)
+                    return true;
+            return false;
+        };
+
+        std::size_t top = 0, bottom = mGif.height;
+        while (top < bottom and not rowDiffers(top))
+            top++;
+        if (top == bottom)
+            return {0, 0, 1, 1}; // identical frame; keep a 1x1 patch to carry the delay
+        while (not rowDiffers(bottom - 1))
+            bottom--;
+
+        std::size_t left = 0, right = mGif.width;
+        while (not columnDiffers(left, top, bottom))
+            left++;
+        while (not columnDiffers(right - 1, top, bottom))
+            right--;
+        return {left, top, right - left, bottom - top};
+    }
+
+    void encodeFrame(std::size_t frame, EncodedFrame& encoded) const
+    {
+        encoded.rect = changedRect(frame);
+        const Rect& rect = encoded.rect;
+
+        if (mPaletteMode == GifPalette::PerFrame)
+        {
+            ColorSet colors(mTransparent);
+            addToColors(colors, frame, rect);
+            if (colors.fits())
+                encoded.localPalette = colors.toPalette(mTransparent);
+            else
+            {
+                Histogram histogram;
+                addToHistogram(histogram, frame, rect);
+                encoded.localPalette = buildPalette(histogram, mTransparent);
+            }
+            encoded.hasLocalPalette = true;
+        }
+        const Palette& palette = encoded.hasLocalPalette ? encoded.localPalette : mGlobalPalette;
+        encoded.transparentIndex = palette.transparentIndex;
+        encoded.minCodeSize = std::max(2, palette.tableBits());
+
+        std::vector<std::uint8_t> indices(rect.width * rect.height);
+        for (std::size_t y = 0; y < rect.height; ++y)
+            for (std::size_t x = 0; x < rect.width; ++x)
+            {
+                const Rgba color = readPixel(pixelAt(frame, rect.x + x, rect.y + y), mGif.channels);
+                indices[y * rect.width + x] = encoded.hasLocalPalette ? encoded.localPalette.map(color)
+                                                                      : mGlobalPalette.map(color);
+            }
+
+        encoded.lzw.reserve(indices.size() / 2);
+        LzwEncoder lzw(encoded.minCodeSize, encoded.lzw);
+        lzw.encode(indices.data(), rect.width, rect.width, rect.height);
+    }
+
+    void put(std::initializer_list<std::uint8_t> bytes)
+    {
+        putBytes(bytes.begin(), bytes.size());
+    }
+
+    void putBytes(const std::uint8_t* bytes, std::size_t size)
+    {
+        if (mOk and size > 0)
+            mOk = mSink(bytes, size);
+    }
+
+    void put16(std::size_t value)
+    {
+        put({static_cast<std::uint8_t>(value & 0xFF), static_cast<std::uint8_t>((value >> 8) & 0xFF)});
+    }
+
+    void putColorTable(const Palette& palette)
+    {
+        std::vector<std::uint8_t> table(std::size_t(3) << palette.tableBits(), 0);
+        for (std::size_t i = 0; i < palette.colors.size(); ++i)
+            std::memcpy(&table[i * 3], palette.colors[i].data(), 3);
+        putBytes(table.data(), table.size());
+    }
+
+    void writeHeader()
+    {
+        const std::uint8_t signature[] = {'G', 'I', 'F', '8', '9', 'a'};
+        putBytes(signature, sizeof(signature));
+        put16(mGif.width);
+        put16(mGif.height);
+        if (mPaletteMode == GifPalette::Global)
+        {
+            put({static_cast<std::uint8_t>(0xF0 | (mGlobalPalette.tableBits() - 1)), 0, 0});
+            putColorTable(mGlobalPalette);
+        }
+        else
+            put({0x70, 0, 0});
+
+        if (mGif.frameCount > 1)
+        {
+            // NETSCAPE2.0 application extension: loop forever.
+            const std::uint8_t loop[] = {0x21, 0xFF, 0x0B, 'N', 'E', 'T', 'S', 'C', 'A', 'P', 'E', '2', '.', '0',
+                                         0x03, 0x01, 0x00, 0x00, 0x00};
+            putBytes(loop, sizeof(loop));
+        }
+    }
+
+    void writeFrame(std::size_t frame, const EncodedFrame& encoded)
+    {
+        const int delayMs = frame < mGif.frameDelays.size() ? mGif.frameDelays[frame] : 0;
+        // In hundredths of a second, saturating rather than wrapping around.
+        const std::size_t delay = std::min(static_cast<std::size_t>(std::max(0, delayMs) + 5) / 10, kMaxField);
+        const std::uint8_t disposal = mTransparent ? 2 : 1;
+        const bool transparent = encoded.transparentIndex >= 0;
+
+        // Graphic control extension
+        put({0x21, 0xF9, 0x04, static_cast<std::uint8_t>(disposal << 2 | (transparent ? 1 : 0))});
+        put16(delay);
+        put({static_cast<std::uint8_t>(transparent ? encoded.transparentIndex : 0), 0x00});
+
+        // Image descriptor
+        put({0x2C});
+        put16(encoded.rect.x);
+        put16(encoded.rect.y);
+        put16(encoded.rect.width);
+        put16(encoded.rect.height);
+        if (encoded.hasLocalPalette)
+        {
+            put({static_cast<std::uint8_t>(0x80 | (encoded.localPalette.tableBits() - 1))});
+            putColorTable(encoded.localPalette);
+        }
+        else
+            put({0x00});
+
+        // Image data as 255-byte sub-blocks
+        put({static_cast<std::uint8_t>(encoded.minCodeSize)});
+        for (std::size_t offset = 0; offset < encoded.lzw.size(); offset += 255)
+        {
+            const std::size_t blockSize = std::min<std::size_t>(255, encoded.lzw.size() - offset);
+            put({static_cast<std::uint8_t>(blockSize)});
+            putBytes(encoded.lzw.data() + offset, blockSize);
+        }
+        put({0x00});
+    }
+
+    const GifData& mGif;
+    GifPalette mPaletteMode;
+    const ByteSink& mSink;
+    bool mOk;
+    bool mTransparent = false;
+    Palette mGlobalPalette;
+};
+
+}
+
+bool GifData::write(const std::filesystem::path& filename, GifPalette palette) const
+{
+    if (!isValid() or width > kMaxField or height > kMaxField)
+        return false;
+
+    std::ofstream file(filename, std::ios::binary | std::ios::trunc);
+    if (!file)
+        return false;
+
+    const ByteSink sink = [&file](const std::uint8_t* bytes, std::size_t size)
+    {
+        file.write(reinterpret_cast<const char*>(bytes), static_cast<std::streamsize>(size));
+        return static_cast<bool>(file);
+    };
+    return GifEncoder(*this, palette, sink).run() && static_cast<bool>(file.flush());
+}
+
+bool GifData::writeToMemory(std::vector<std::uint8_t>& out, GifPalette palette) const
+{
+    if (!isValid() or width > kMaxField or height > kMaxField)
+        return false;
+
+    const ByteSink sink = [&out](const std::uint8_t* bytes, std::size_t size)
+    {
+        out.insert(out.end(), bytes, bytes + size);
+        return true;
+    };
+    return GifEncoder(*this, palette, sink).run();
+}
+
+}
@@ -0,0 +1,1698 @@
+#include "stb_image_plus_jpeg.h"
+#include "stb_image_plus_parallel.h"
+#include "stb_image_plus_simd.h"
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cstdlib>
+#include <cstring>
+#include <utility>
+#include <vector>
+
+namespace stb_image_plus::detail
+{
+
+namespace
+{
+
+// Encoded bytes are handed to the output callback in pieces of about this size.
+constexpr std::size_t kFlushBytes = 64 * 1024;
+
+constexpr std::uint8_t kZigZag[64] = {
+    0, 1, 5, 6, 14, 15, 27, 28, 2, 4, 7, 13, 16, 26, 29, 42, 3, 8, 12, 17, 25, 30, 41, 43, 9, 11, 18,
+    24, 31, 40, 44, 53, 10, 19, 23, 32, 39, 45, 52, 54, 20, 22, 33, 38, 46, 51, 55, 60, 21, 34, 37, 47, 50, 56, 59, 61,
+    35, 36, 48, 49, 57, 58, 62, 63};
+
+// Annex K quantization tables, in natural order.
+constexpr int kLumaQuant[64] = {
+    16, 11, 10, 16, 24, 40, 51, 61, 12, 12, 14, 19, 26, 58, 60, 55, 14, 13, 16, 24, 40, 57, 69, 56, 14, 17, 22, 29,
+    51, 87, 80, 62, 18, 22, 37, 56, 68, 109, 103, 77, 24, 35, 55, 64, 81, 104, 113, 92, 49, 64, 78, 87, 103, 121, 120,
+    101, 72, 92, 95, 98, 112, 100, 103, 99};
+constexpr int kChromaQuant[64] = {
+    17, 18, 24, 47, 99, 99, 99, 99, 18, 21, 26, 66, 99, 99, 99, 99, 24, 26, 56, 99, 99, 99, 99, 99, 47, 66, 99, 99,
+    99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99,
+    99, 99, 99, 99, 99, 99, 99, 99};
+
+// AAN scale factors, folded into the quantization divisors.
+constexpr float kAanScale[8] = {
+    1.0f * 2.828427125f, 1.387039845f * 2.828427125f, 1.306562965f * 2.828427125f, 1.175875602f * 2.828427125f,
+    1.0f * 2.828427125f, 0.785694958f * 2.828427125f, 0.541196100f * 2.828427125f, 0.275899379f * 2.828427125f};
+
+// Annex K Huffman tables as written to DHT: code counts for lengths 1..16,
+// then the symbols in code order.
+constexpr std::uint8_t kLumaDcCounts[16] = {0, 1, 5, 1, 1, 1, 1, 1, 1, 0, 0, 0, 0, 0, 0, 0};
+constexpr std::uint8_t kLumaDcSymbols[12] = {0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11};
+constexpr std::uint8_t kLumaAcCounts[16] = {0, 2, 1, 3, 3, 2, 4, 3, 5, 5, 4, 4, 0, 0, 1, 0x7d};
+constexpr std::uint8_t kLumaAcSymbols[162] = {
+    0x01, 0x02, 0x03, 0x00, 0x04, 0x11, 0x05, 0x12, 0x21, 0x31, 0x41, 0x06, 0x13, 0x51, 0x61, 0x07, 0x22, 0x71, 0x14,
+    0x32, 0x81, 0x91, 0xa1, 0x08, 0x23, 0x42, 0xb1, 0xc1, 0x15, 0x52, 0xd1, 0xf0, 0x24, 0x33, 0x62, 0x72, 0x82, 0x09,
+    0x0a, 0x16, 0x17, 0x18, 0x19, 0x1a, 0x25, 0x26, 0x27, 0x28, 0x29, 0x2a, 0x34, 0x35, 0x36, 0x37, 0x38, 0x39, 0x3a,
+    0x43, 0x44, 0x45, 0x46, 0x47, 0x48, 0x49, 0x4a, 0x53, 0x54, 0x55, 0x56, 0x57, 0x58, 0x59, 0x5a, 0x63, 0x64, 0x65,
+    0x66, 0x67, 0x68, 0x69, 0x6a, 0x73, 0x74, 0x75, 0x76, 0x77, 0x78, 0x79, 0x7a, 0x83, 0x84, 0x85, 0x86, 0x87, 0x88,
+    0x89, 0x8a, 0x92, 0x93, 0x94, 0x95, 0x96, 0x97, 0x98, 0x99, 0x9a, 0xa2, 0xa3, 0xa4, 0xa5, 0xa6, 0xa7, 0xa8, 0xa9,
+    0xaa, 0xb2, 0xb3, 0xb4, 0xb5, 0xb6, 0xb7, 0xb8, 0xb9, 0xba, 0xc2, 0xc3, 0xc4, 0xc5, 0xc6, 0xc7, 0xc8, 0xc9, 0xca,
+    0xd2, 0xd3, 0xd4, 0xd5, 0xd6, 0xd7, 0xd8, 0xd9, 0xda, 0xe1, 0xe2, 0xe3, 0xe4, 0xe5, 0xe6, 0xe7, 0xe8, 0xe9, 0xea,
+    0xf1, 0xf2, 0xf3, 0xf4, 0xf5, 0xf6, 0xf7, 0xf8, 0xf9, 0xfa};
+constexpr std::uint8_t kChromaDcCounts[16] = {0, 3, 1, 1, 1, 1, 1, 1, 1, 1, 1, 0, 0, 0, 0, 0};
+constexpr std::uint8_t kChromaDcSymbols[12] = {0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11};
+constexpr std::uint8_t kChromaAcCounts[16] = {0, 2, 1, 2, 4, 4, 3, 4, 7, 5, 4, 4, 0, 1, 2, 0x77};
+constexpr std::uint8_t kChromaAcSymbols[162] = {
+    0x00, 0x01, 0x02, 0x03, 0x11, 0x04, 0x05, 0x21, 0x31, 0x06, 0x12, 0x41, 0x51, 0x07, 0x61, 0x71, 0x13, 0x22, 0x32,
+    0x81, 0x08, 0x14, 0x42, 0x91, 0xa1, 0xb1, 0xc1, 0x09, 0x23, 0x33, 0x52, 0xf0, 0x15, 0x62, 0x72, 0xd1, 0x0a, 0x16,
+    0x24, 0x34, 0xe1, 0x25, 0xf1, 0x17, 0x18, 0x19, 0x1a, 0x26, 0x27, 0x28, 0x29, 0x2a, 0x35, 0x36, 0x37, 0x38, 0x39,
+    0x3a, 0x43, 0x44, 0x45, 0x46, 0x47, 0x48, 0x49, 0x4a, 0x53, 0x54, 0x55, 0x56, 0x57, 0x58, 0x59, 0x5a, 0x63, 0x64,
+    0x65, 0x66, 0x67, 0x68, 0x69, 0x6a, 0x73, 0x74, 0x75, 0x76, 0x77, 0x78, 0x79, 0x7a, 0x82, 0x83, 0x84, 0x85, 0x86,
+    0x87, 0x88, 0x89, 0x8a, 0x92, 0x93, 0x94, 0x95, 0x96, 0x97, 0x98, 0x99, 0x9a, 0xa2, 0xa3, 0xa4, 0xa5, 0xa6, 0xa7,
+    0xa8, 0xa9, 0xaa, 0xb2, 0xb3, 0xb4, 0xb5, 0xb6, 0xb7, 0xb8, 0xb9, 0xba, 0xc2, 0xc3, 0xc4, 0xc5, 0xc6, 0xc7, 0xc8,
+    0xc9, 0xca, 0xd2, 0xd3, 0xd4, 0xd5, 0xd6, 0xd7, 0xd8, 0xd9, 0xda, 0xe2, 0xe3, 0xe4, 0xe5, 0xe6, 0xe7, 0xe8, 0xe9,
+    0xea, 0xf2, 0xf3, 0xf4, 0xf5, 0xf6, 0xf7, 0xf8, 0xf9, 0xfa};
+
+// One Huffman table as DHT stores it: code counts for lengths 1..16, then
+// the symbols in code order.
+struct HuffmanSpec
+{
+    std::array<std::uint8_t, 16> counts{};
+    std::vector<std::uint8_t> symbols;
+};
+
+// Code and length for every symbol of one Huffman table.
+struct HuffmanCode
+{
+    std::array<std::uint16_t, 256> code{};
+    std::array<std::uint8_t, 256> length{};
+};
+
+// Canonical code assignment of ITU T.81 annex C.
+HuffmanCode buildCode(const HuffmanSpec& spec)
+{
+    HuffmanCode result;
+    std::uint16_t code = 0;
+    std::size_t symbol = 0;
+    for (int length = 1; length <= 16; ++length)
+    {
+        for (int i = 0; i < spec.counts[length - 1]; ++i, ++symbol)
+        {
+            result.code[spec.symbols[symbol]] = code++;
+            result.length[spec.symbols[symbol]] = static_cast<std::uint8_t>(length);
+        }
+        code <<= 1;
+    }
+    return result;
+}
+
+// Table slots, in the order DHT lists them.
+constexpr int kLumaDc = 0, kLumaAc = 1, kChromaDc = 2, kChromaAc = 3;
+constexpr std::uint8_t kTableIds[4] = {0x00, 0x10, 0x01, 0x11};
+
+struct HuffmanTables
+{
+    std::array<HuffmanSpec, 4> specs;
+    std::array<HuffmanCode, 4> codes;
+};
+
+template <std::size_t SymbolCount>
+HuffmanSpec makeSpec(const std::uint8_t (&counts)[16], const std::uint8_t (&symbols)[SymbolCount])
+{
+    HuffmanSpec spec;
+    std::copy_n(counts, 16, spec.counts.begin());
+    spec.symbols.assign(symbols, symbols + SymbolCount);
+    return spec;
+}
+
+const HuffmanTables& standardTables()
+{
+    static const HuffmanTables tables = []
+    {
+        HuffmanTables result;
+        result.specs = {makeSpec(kLumaDcCounts, kLumaDcSymbols), makeSpec(kLumaAcCounts, kLumaAcSymbols),
+                        makeSpec(kChromaDcCounts, kChromaDcSymbols), makeSpec(kChromaAcCounts, kChromaAcSymbols)};
+        for (int i = 0; i < 4; ++i)
+            result.codes[i] = buildCode(result.specs[i]);
+        return result;
+    }();
+    return tables;
+}
+
+using SymbolFrequencies = std::array<std::uint32_t, 256>;
+
+// Huffman table fitted to symbol frequencies, with code lengths limited to
+// 16 bits (T.81 annex K.2, as libjpeg's jpeg_gen_optimal_table). A reserved
+// symbol keeps any code from being all ones.
+HuffmanSpec optimalSpec(const SymbolFrequencies& frequencies)
+{
+    std::uint64_t frequency[257];
+    int codeSize[257] = {};
+    int others[257];
+    std::copy(frequencies.begin(), frequencies.end(), frequency);
+    frequency[256] = 1;
+    std::fill_n(others, 257, -1);
+
+    // Merge the two least frequent trees until one is left; ties go to the
+    // higher symbol.
+    for (;;)
+    {
+        int c1 = -1, c2 = -1;
+        for (int i = 0; i < 257; ++i)
+        {
+            if (frequency[i] != 0 and (c1 < 0 or frequency[i] <= frequency[c1]))
+                c1 = i;
+        }
+        for (int i = 0; i < 257; ++i)
+        {
+            if (frequency[i] != 0 and i != c1 and (c2 < 0 or frequency[i] <= frequency[c2]))
+                c2 = i;
+        }
+        if (c2 < 0)
+            break;
+        frequency[c1] += frequency[c2];
+        frequency[c2] = 0;
+        for (++codeSize[c1]; others[c1] >= 0; ++codeSize[c1])
+            c1 = others[c1];
+        others[c1] = c2;
+        for (++codeSize[c2]; others[c2] >= 0; ++codeSize[c2])
+            c2 = others[c2];
+    }
+
+    // 257 leaves make a tree at most 256 deep.
+    int lengthCounts[257] = {};
+    for (int i = 0; i < 257; ++i)
+    {
+        if (codeSize[i] != 0)
+            ++lengthCounts[codeSize[i]];
+    }
+    // Move codes longer than 16 bits up the tree, pairwise.
+    for (int i = 256; i > 16; --i)
+    {
+        while (lengthCounts[i] > 0)
+        {
+            int j = i - 2;
+            while (lengthCounts[j] == 0)
+                --j;
+            lengthCounts[i] -= 2;
+            ++lengthCounts[i - 1];
+            lengthCounts[j + 1] += 2;
+            --lengthCounts[j];
+        }
+    }
+    // Drop the reserved symbol, which has the longest code.
+    int longest = 16;
+    while (lengthCounts[longest] == 0)
+        --longest;
+    --lengthCounts[longest];
+
+    HuffmanSpec spec;
+    for (int length = 1; length <= 16; ++length)
+        spec.counts[length - 1] = static_cast<std::uint8_t>(lengthCounts[length]);
+    for (int length = 1; length <= 256; ++length)
+    {
+        for (int symbol = 0; symbol < 256; ++symbol)
+        {
+            if (codeSize[symbol] == length)
+                spec.symbols.push_back(static_cast<std::uint8_t>(symbol));
+        }
+    }
+    return spec;
+}
+
+// Entropy coded output with 0xFF byte stuffing. Bits gather MSB first in a
+// 64 bit accumulator and are stored 32 at a time.
+class JpegWriter
+{
+public:
+    JpegWriter(stbi_write_func* func, void* context) :
+        mFunc(func),
+        mContext(context),
+        mBuffer(kFlushBytes + 64)
+    {
+    }
+
+    void putByte(std::uint8_t byte)
+    {
+        mBuffer[mLength++] = byte;
+        flushIfFull();
+    }
+
+    void putBytes(const std::uint8_t* data, std::size_t size)
+    {
+        while (size > 0)
+        {
+            const std::size_t count = std::min(size, mBuffer.size() - mLength);
+            std::memcpy(mBuffer.data() + mLength, data, count);
+            mLength += count;
+            data += count;
+            size -= count;
+            flushIfFull();
+        }
+    }
+
+    // `bits` must fit in `length` (at most 32) bits.
+    void putBits(std::uint32_t bits, int length)
+    {
+        mBitBuffer = (mBitBuffer << length) | bits;
+        mBitCount += length;
+        if (mBitCount >= 32)
+        {
+            mBitCount -= 32;
+            putWord(static_cast<std::uint32_t>(mBitBuffer >> mBitCount));
+        }
+    }
+
+    // Pads the last byte with ones, as T.81 asks before a marker.
+    void alignToByte()
+    {
+        putBits(0x7F, 7);
+        while (mBitCount >= 8)
+        {
+            mBitCount -= 8;
+            putStuffed(static_cast<std::uint8_t>(mBitBuffer >> mBitCount));
+        }
+        mBitCount = 0;
+        flushIfFull();
+    }
+
+    void flush()
+    {
+        if (mLength != 0)
+            mFunc(mContext, mBuffer.data(), static_cast<int>(mLength));
+        mLength = 0;
+    }
+
+private:
+    // Every put leaves less than kFlushBytes buffered, which leaves room
+    // for the few bytes putBits and alignToByte add before they check.
+    void flushIfFull()
+    {
+        if (mLength >= kFlushBytes)
+            flush();
+    }
+
+    void putStuffed(std::uint8_t byte)
+    {
+        mBuffer[mLength++] = byte;
+        if (byte == 0xFF)
+            mBuffer[mLength++] = 0;
+    }
+
+    void putWord(std::uint32_t word)
+    {
+        // Only a word with a 0xFF byte (a zero byte in ~word) needs stuffing.
+        if (((~word - 0x01010101u) & word & 0x80808080u) == 0)
+        {
+            std::uint8_t* out = mBuffer.data() + mLength;
+            out[0] = static_cast<std::uint8_t>(word >> 24);
+            out[1] = static_cast<std::uint8_t>(word >> 16);
+            out[2] = static_cast<std::uint8_t>(word >> 8);
+            out[3] = static_cast<std::uint8_t>(word);
+            mLength += 4;
+        }
+        else
+        {
+            for (int shift = 24; shift >= 0; shift -= 8)
+                putStuffed(static_cast<std::uint8_t>(word >> shift));
+        }
+        flushIfFull();
+    }
+
+    stbi_write_func* mFunc;
+    void* mContext;
+    std::vector<std::uint8_t> mBuffer;
+    std::size_t mLength = 0;
+    std::uint64_t mBitBuffer = 0;
+    int mBitCount = 0;
+};
+
+// Arithmetic for fdct8, so the same butterfly runs on one value or on a
+// vector of them.
+inline float add(float a, float b) { return a + b; }
+inline float sub(float a, float b) { return a - b; }
+inline float mul(float a, float k) { return a * k; }
+
+#ifdef STB_IMAGE_PLUS_SSE2
+inline __m128 add(__m128 a, __m128 b) { return _mm_add_ps(a, b); }
+inline __m128 sub(__m128 a, __m128 b) { return _mm_sub_ps(a, b); }
+inline __m128 mul(__m128 a, float k) { return _mm_mul_ps(a, _mm_set1_ps(k)); }
+#endif
+
+#ifdef STB_IMAGE_PLUS_AVX2
+inline __m256 add(__m256 a, __m256 b) { return _mm256_add_ps(a, b); }
+inline __m256 sub(__m256 a, __m256 b) { return _mm256_sub_ps(a, b); }
+inline __m256 mul(__m256 a, float k) { return _mm256_mul_ps(a, _mm256_set1_ps(k)); }
+#endif
+
+// One dimensional AAN forward DCT of d0..d7. The operations and their
+// order are those of stb's scalar version, so every variant rounds the same.
+template <typename T>
+void fdct8(T& d0, T& d1, T& d2, T& d3, T& d4, T& d5, T& d6, T& d7)
+{
+    const T tmp0 = add(d0, d7), tmp7 = sub(d0, d7);
+    const T tmp1 = add(d1, d6), tmp6 = sub(d1, d6);
+    const T tmp2 = add(d2, d5), tmp5 = sub(d2, d5);
+    const T tmp3 = add(d3, d4), tmp4 = sub(d3, d4);
+
+    // Even part
+    T tmp10 = add(tmp0, tmp3);
+    const T tmp13 = sub(tmp0, tmp3);
+    T tmp11 = add(tmp1, tmp2);
+    T tmp12 = sub(tmp1, tmp2);
+
+    d0 = add(tmp10, tmp11);
+    d4 = sub(tmp10, tmp11);
+    const T z1 = mul(add(tmp12, tmp13), 0.707106781f);
+    d2 = add(tmp13, z1);
+    d6 = sub(tmp13, z1);
+
+    // Odd part. The rotator is modified from fig 4-8 of the AAN paper to
+    // avoid extra negations.
+    tmp10 = add(tmp4, tmp5);
+    tmp11 = add(tmp5, tmp6);
+    tmp12 = add(tmp6, tmp7);
+
+    const T z5 = mul(sub(tmp10, tmp12), 0.382683433f);
+    const T z2 = add(mul(tmp10, 0.541196100f), z5);
+    const T z4 = add(mul(tmp12, 1.306562965f), z5);
+    const T z3 = mul(tmp11, 0.707106781f);
+    const T z11 = add(tmp7, z3);
+    const T z13 = sub(tmp7, z3);
+
+    d5 = add(z13, z2);
+    d3 = sub(z13, z2);
+    d1 = add(z11, z4);
+    d7 = sub(z11, z4);
+}
+
+template <typename T>
+void fdct8(T* d)
+{
+    fdct8(d[0], d[1], d[2], d[3], d[4], d[5], d[6], d[7]);
+}
+
+#if defined(STB_IMAGE_PLUS_AVX2)
+
+void transpose8x8(__m256* rows)
+{
+    const __m256 t0 = _mm256_unpacklo_ps(rows[0], rows[1]), t1 = _mm256_unpackhi_ps(rows[0], rows[1]);
+    const __m256 t2 = _mm256_unpacklo_ps(rows[2], rows[3]), t3 = _mm256_unpackhi_ps(rows[2], rows[3]);
+    const __m256 t4 = _mm256_unpacklo_ps(rows[4], rows[5]), t5 = _mm256_unpackhi_ps(rows[4], rows[5]);
+    const __m256 t6 = _mm256_unpacklo_ps(rows[6], rows[7]), t7 = _mm256_unpackhi_ps(rows[6], rows[7]);
+    const __m256 s0 = _mm256_shuffle_ps(t0, t2, _MM_SHUFFLE(1, 0, 1, 0));
+    const __m256 s1 = _mm256_shuffle_ps(t0, t2, _MM_SHUFFLE(3, 2, 3, 2));
+    const __m256 s2 = _mm256_shuffle_ps(t1, t3, _MM_SHUFFLE(1, 0, 1, 0));
+    const __m256 s3 = _mm256_shuffle_ps(t1, t3, _MM_SHUFFLE(3, 2, 3, 2));
+    const __m256 s4 = _mm256_shuffle_ps(t4, t6, _MM_SHUFFLE(1, 0, 1, 0));
+    const __m256 s5 = _mm256_shuffle_ps(t4, t6, _MM_SHUFFLE(3, 2, 3, 2));
+    const __m256 s6 = _mm256_shuffle_ps(t5, t7, _MM_SHUFFLE(1, 0, 1, 0));
+    const __m256 s7 = _mm256_shuffle_ps(t5, t7, _MM_SHUFFLE(3, 2, 3, 2));
+    rows[0] = _mm256_permute2f128_ps(s0, s4, 0x20);
+    rows[1] = _mm256_permute2f128_ps(s1, s5, 0x20);
+    rows[2] = _mm256_permute2f128_ps(s2, s6, 0x20);
+    rows[3] = _mm256_permute2f128_ps(s3, s7, 0x20);
+    rows[4] = _mm256_permute2f128_ps(s0, s4, 0x31);
+    rows[5] = _mm256_permute2f128_ps(s1, s5, 0x31);
+    rows[6] = _mm256_permute2f128_ps(s2, s6, 0x31);
+    rows[7] = _mm256_permute2f128_ps(s3, s7, 0x31);
+}
+
+#elif defined(STB_IMAGE_PLUS_SSE2)
+
+// An 8x8 block as the left and right halves of its rows.
+struct Block8x8
+{
+    __m128 left[8], right[8];
+};
+
+void transpose8x8(Block8x8& b)
+{
+    _MM_TRANSPOSE4_PS(b.left[0], b.left[1], b.left[2], b.left[3]);
+    _MM_TRANSPOSE4_PS(b.left[4], b.left[5], b.left[6], b.left[7]);
+    _MM_TRANSPOSE4_PS(b.right[0], b.right[1], b.right[2], b.right[3]);
+    _MM_TRANSPOSE4_PS(b.right[4], b.right[5], b.right[6], b.right[7]);
+    for (int i = 0; i < 4; ++i)
+        std::swap(b.left[4 + i], b.right[i]);
+}
+
+#endif
+
+#ifdef STB_IMAGE_PLUS_SSE2
+
+// Multiplies 4 coefficients by their divisors and rounds half away from
+// zero, as (int)(v < 0 ? v - 0.5f : v + 0.5f) does.
+inline __m128i quantize(__m128 values, const float* divisors)
+{
+    const __m128 scaled = _mm_mul_ps(values, _mm_loadu_ps(divisors));
+    const __m128 half = _mm_or_ps(_mm_and_ps(scaled, _mm_set1_ps(-0.0f)), _mm_set1_ps(0.5f));
+    return _mm_cvttps_epi32(_mm_add_ps(scaled, half));
+}
+
+#endif
+
+// Forward DCT of the 8x8 block at `block` (rows `stride` floats apart) into
+// `out`, in natural order and still scaled by the AAN factors. `block` may
+// be overwritten.
+void forwardDct(float* block, std::size_t stride, float* out)
+{
+#if defined(STB_IMAGE_PLUS_AVX2)
+    // One row per vector: a transpose turns the row pass into a butterfly
+    // across vectors, a second one restores rows for the column pass.
+    __m256 rows[8];
+    for (std::size_t y = 0; y < 8; ++y)
+        rows[y] = _mm256_loadu_ps(block + y * stride);
+    transpose8x8(rows);
+    fdct8(rows);
+    transpose8x8(rows);
+    fdct8(rows);
+    for (std::size_t y = 0; y < 8; ++y)
+        _mm256_storeu_ps(out + y * 8, rows[y]);
+#elif defined(STB_IMAGE_PLUS_SSE2)
+    Block8x8 b;
+    for (std::size_t y = 0; y < 8; ++y)
+    {
+        b.left[y] = _mm_loadu_ps(block + y * stride);
+        b.right[y] = _mm_loadu_ps(block + y * stride + 4);
+    }
+    transpose8x8(b);
+    fdct8(b.left);
+    fdct8(b.right);
+    transpose8x8(b);
+    fdct8(b.left);
+    fdct8(b.right);
+    for (std::size_t y = 0; y < 8; ++y)
+    {
+        _mm_storeu_ps(out + y * 8, b.left[y]);
+        _mm_storeu_ps(out + y * 8 + 4, b.right[y]);
+    }
+#else
+    for (std::size_t row = 0; row < 8; ++row)
+    {
+        float* d = block + row * stride;
+        fdct8(d[0], d[1], d[2], d[3], d[4], d[5], d[6], d[7]);
+    }
+    for (std::size_t column = 0; column < 8; ++column)
+    {
+        float* d = block + column;
+        fdct8(d[0], d[stride], d[stride * 2], d[stride * 3], d[stride * 4], d[stride * 5], d[stride * 6],
+              d[stride * 7]);
+    }
+    for (std::size_t y = 0; y < 8; ++y)
+        std::copy_n(block + y * stride, 8, out + y * 8);
+#endif
+}
+
+// Quantizes the output of forwardDct into `coefficients`, in zigzag order.
+void quantizeBlock(const float* dct, const float* divisors, std::int16_t* coefficients)
+{
+    alignas(16) std::int16_t natural[64];
+#ifdef STB_IMAGE_PLUS_SSE2
+    for (std::size_t i = 0; i < 64; i += 8)
+    {
+        const __m128i low = quantize(_mm_loadu_ps(dct + i), divisors + i);
+        const __m128i high = quantize(_mm_loadu_ps(dct + i + 4), divisors + i + 4);
+        _mm_store_si128(reinterpret_cast<__m128i*>(natural + i), _mm_packs_epi32(low, high));
+    }
+#else
+    for (std::size_t i = 0; i < 64; ++i)
+    {
+        const float value = dct[i] * divisors[i];
+        natural[i] = static_cast<std::int16_t>(value < 0 ? value - 0.5f : value + 0.5f);
+    }
+#endif
+    for (std::size_t i = 0; i < 64; ++i)
+        coefficients[kZigZag[i]] = natural[i];
+}
+
+// Transforms and quantizes the 8x8 block at `block` (rows `stride` floats
+// apart, overwritten) into `coefficients`, in zigzag order.
+void transformBlock(float* block, std::size_t stride, const float* divisors, std::int16_t* coefficients)
+{
+    alignas(32) float dct[64];
+    forwardDct(block, stride, dct);
+    quantizeBlock(dct, divisors, coefficients);
+}
+
+// Bit i is set when coefficient i is not zero.
+std::uint64_t nonzeroMask(const std::int16_t* coefficients)
+{
+    std::uint64_t mask = 0;
+#ifdef STB_IMAGE_PLUS_SSE2
+    const __m128i zero = _mm_setzero_si128();
+    for (int i = 0; i < 8; ++i)
+    {
+        const __m128i values = _mm_loadu_si128(reinterpret_cast<const __m128i*>(coefficients + i * 8));
+        const __m128i isZero = _mm_cmpeq_epi16(values, zero);
+        const int zeroBits = _mm_movemask_epi8(_mm_packs_epi16(isZero, zero));
+        mask |= static_cast<std::uint64_t>(~zeroBits & 0xFF) << (i * 8);
+    }
+#else
+    for (int i = 0; i < 64; ++i)
+        mask |= static_cast<std::uint64_t>(coefficients[i] != 0) << i;
+#endif
+    return mask;
+}
+
+// Huffman codes blocks into a JpegWriter.
+class BlockCoder
+{
+public:
+    BlockCoder(JpegWriter& writer, const HuffmanTables& tables) :
+        mWriter(writer),
+        mCodes(tables.codes)
+    {
+    }
+
+    void symbol(int table, int symbol)
+    {
+        mWriter.putBits(mCodes[table].code[symbol], mCodes[table].length[symbol]);
+    }
+
+    // A symbol and the `length` value bits that follow it, in one put.
+    void symbol(int table, int symbol, std::uint32_t bits, int length)
+    {
+        const int codeLength = mCodes[table].length[symbol];
+        mWriter.putBits(static_cast<std::uint32_t>(mCodes[table].code[symbol]) << length | bits, codeLength + length);
+    }
+
+    void bits(std::uint32_t bits, int length)
+    {
+        mWriter.putBits(bits, length);
+    }
+
+private:
+    JpegWriter& mWriter;
+    const std::array<HuffmanCode, 4>& mCodes;
+};
+
+// Counts the symbols blocks would be coded with, for optimized tables.
+struct SymbolCounter
+{
+    std::array<SymbolFrequencies, 4> frequencies{};
+
+    void symbol(int table, int symbol)
+    {
+        ++frequencies[table][symbol];
+    }
+
+    void symbol(int table, int symbol, std::uint32_t, int)
+    {
+        ++frequencies[table][symbol];
+    }
+
+    void bits(std::uint32_t, int)
+    {
+    }
+};
+
+// Magnitude category of `value` and its additional bits (T.81 F.1.2.1).
+template <typename Coder>
+void codeValue(Coder& coder, int table, int symbolHigh, int value)
+{
+    const unsigned magnitude = static_cast<unsigned>(value < 0 ? -value : value);
+    const int bits = value < 0 ? value - 1 : value;
+    const int length = std::bit_width(magnitude);
+    coder.symbol(table, symbolHigh | length, static_cast<std::uint32_t>(bits) & ((1u << length) - 1), length);
+}
+
+// Codes the quantized block `coefficients` (zigzag order) with the DC table
+// `dcTable` and the AC table that follows it. Returns its DC value for the
+// next block's prediction.
+template <typename Coder>
+int codeBlock(Coder& coder, const std::int16_t* coefficients, int previousDc, int dcTable)
+{
+    const int acTable = dcTable + 1;
+    const int dcDelta = coefficients[0] - previousDc;
+    if (dcDelta == 0)
+        coder.symbol(dcTable, 0);
+    else
+        codeValue(coder, dcTable, 0, dcDelta);
+
+    // Walk the nonzero AC coefficients; the gaps between them are the runs.
+    int last = 0;
+    for (std::uint64_t nonzero = nonzeroMask(coefficients) & ~std::uint64_t(1); nonzero != 0;
+         nonzero &= nonzero - 1)
+    {
+        const int i = std::countr_zero(nonzero);
+        int zeros = i - last - 1;
+        for (; zeros >= 16; zeros -= 16)
+            coder.symbol(acTable, 0xF0);
+        codeValue(coder, acTable, zeros << 4, coefficients[i]);
+        last = i;
+    }
+    if (last != 63)
+        coder.symbol(acTable, 0x00);
+    return coefficients[0];
+}
+
+// Writes a DHT segment with the tables of `tables` that have symbols.
+void putDht(JpegWriter& writer, const HuffmanTables& tables)
+{
+    std::size_t length = 2;
+    for (const HuffmanSpec& spec : tables.specs)
+    {
+        if (not spec.symbols.empty())
+            length += 1 + spec.counts.size() + spec.symbols.size();
+    }
+    const std::uint8_t dht[] = {0xFF, 0xC4, static_cast<std::uint8_t>(length >> 8), static_cast<std::uint8_t>(length)};
+    writer.putBytes(dht, sizeof(dht));
+    for (int i = 0; i < 4; ++i)
+    {
+        const HuffmanSpec& spec = tables.specs[i];
+        if (spec.symbols.empty())
+            continue;
+        writer.putByte(kTableIds[i]);
+        writer.putBytes(spec.counts.data(), spec.counts.size());
+        writer.putBytes(spec.symbols.data(), spec.symbols.size());
+    }
+}
+
+// Tables fitted to counted symbols; tables without any stay empty.
+HuffmanTables optimalTables(const SymbolCounter& counter)
+{
+    HuffmanTables tables;
+    for (int i = 0; i < 4; ++i)
+    {
+        const SymbolFrequencies& frequencies = counter.frequencies[i];
+        if (std::all_of(frequencies.begin(), frequencies.end(), [](std::uint32_t n) { return n == 0; }))
+            continue;
+        tables.specs[i] = optimalSpec(frequencies);
+        tables.codes[i] = buildCode(tables.specs[i]);
+    }
+    return tables;
+}
+
+// One scan of a progressive JPEG (T.81 G.1.1): its components, the
+// spectral band ss..se and the successive approximation bit positions.
+struct ProgressiveScan
+{
+    int componentCount;
+    int components[3];
+    int ss, se, ah, al;
+};
+
+// The script of libjpeg's jpeg_simple_progression for YCbCr: DC and a few
+// low luma frequencies first, the least significant AC bits last.
+constexpr ProgressiveScan kProgressiveScans[] = {
+    {3, {0, 1, 2}, 0, 0, 0, 1},
+    {1, {0}, 1, 5, 0, 2},
+    {1, {2}, 1, 63, 0, 1},
+    {1, {1}, 1, 63, 0, 1},
+    {1, {0}, 6, 63, 0, 2},
+    {1, {0}, 1, 63, 2, 1},
+    {3, {0, 1, 2}, 0, 0, 1, 0},
+    {1, {2}, 1, 63, 1, 0},
+    {1, {1}, 1, 63, 1, 0},
+    {1, {0}, 1, 63, 1, 0},
+};
+
+// Codes the blocks of one progressive scan with a BlockCoder or a
+// SymbolCounter (T.81 G.1.2, as libjpeg's jcphuff.c). DC scans use the
+// luma and chroma DC tables, AC scans (one component each) the luma AC
+// table.
+template <typename Coder>
+class ProgressiveScanCoder
+{
+public:
+    ProgressiveScanCoder(Coder& coder, const ProgressiveScan& scan) :
+        mCoder(coder),
+        mScan(scan)
+    {
+    }
+
+    void code(const std::int16_t* block, int component)
+    {
+        if (mScan.ss == 0)
+        {
+            if (mScan.ah == 0)
+                dcFirst(block, component);
+            else
+                mCoder.bits(static_cast<std::uint32_t>(block[0] >> mScan.al) & 1, 1);
+        }
+        else if (mScan.ah == 0)
+            acFirst(block);
+        else
+            acRefine(block);
+    }
+
+    // Codes what is left of the end-of-band run.
+    void finish()
+    {
+        putEobRun();
+    }
+
+private:
+    // Longest end-of-band run and most buffered correction bits libjpeg
+    // allows before it codes the run.
+    static constexpr std::uint32_t kMaxEobRun = 0x7FFF;
+    static constexpr std::size_t kMaxCorrections = 1000 - 64 + 1;
+
+    void dcFirst(const std::int16_t* block, int component)
+    {
+        const int dc = block[0] >> mScan.al;
+        codeValue(mCoder, component == 0 ? kLumaDc : kChromaDc, 0, dc - mDc[component]);
+        mDc[component] = dc;
+    }
+
+    void acFirst(const std::int16_t* block)
+    {
+        int run = 0;
+        for (int k = mScan.ss; k <= mScan.se; ++k)
+        {
+            // The point transform shifts magnitudes, not the signed value.
+            const int magnitude = std::abs(block[k]) >> mScan.al;
+            if (magnitude == 0)
+            {
+                ++run;
+                continue;
+            }
+            putEobRun();
+            for (; run >= 16; run -= 16)
+                mCoder.symbol(kLumaAc, 0xF0);
+            codeValue(mCoder, kLumaAc, run << 4, block[k] < 0 ? -magnitude : magnitude);
+            run = 0;
+        }
+        if (run > 0 and ++mEobRun == kMaxEobRun)
+            putEobRun();
+    }
+
+    void acRefine(const std::int16_t* block)
+    {
+        int magnitudes[64];
+        int lastNew = 0; // last coefficient that becomes nonzero in this scan
+        for (int k = mScan.ss; k <= mScan.se; ++k)
+        {
+            magnitudes[k] = std::abs(block[k]) >> mScan.al;
+            if (magnitudes[k] == 1)
+                lastNew = k;
+        }
+
+        int run = 0;
+        for (int k = mScan.ss; k <= mScan.se; ++k)
+        {
+            if (magnitudes[k] == 0)
+            {
+                ++run;
+                continue;
+            }
+            // Runs are only broken up ahead of a new coefficient; past the
+            // last one they become part of the end-of-band.
+            while (run > 15 and k <= lastNew)
+            {
+                putEobRun();
+                mCoder.symbol(kLumaAc, 0xF0);
+                run -= 16;
+                putCorrections();
+            }
+            if (magnitudes[k] > 1)
+            {
+                // Already nonzero: only its next bit, sent with the next symbol.
+                mCorrections.push_back(static_cast<std::uint8_t>(magnitudes[k] & 1));
+                continue;
+            }
+            putEobRun();
+            mCoder.symbol(kLumaAc, run << 4 | 1);
+            mCoder.bits(block[k] < 0 ? 0 : 1, 1);
+            putCorrections();
+            run = 0;
+        }
+        if (run > 0 or mCorrections.size() > mEobCorrections)
+        {
+            ++mEobRun;
+            mEobCorrections = mCorrections.size();
+            if (mEobRun == kMaxEobRun or mEobCorrections > kMaxCorrections)
+                putEobRun();
+        }
+    }
+
+    // Codes the pending end-of-band run, then the correction bits of the
+    // blocks in it.
+    void putEobRun()
+    {
+        if (mEobRun == 0)
+            return;
+        const int length = std::bit_width(mEobRun) - 1;
+        mCoder.symbol(kLumaAc, length << 4);
+        if (length > 0)
+            mCoder.bits(mEobRun & ((1u << length) - 1), length);
+        mEobRun = 0;
+        for (std::size_t i = 0; i < mEobCorrections; ++i)
+            mCoder.bits(mCorrections[i], 1);
+        mCorrections.erase(mCorrections.begin(), mCorrections.begin() + static_cast<std::ptrdiff_t>(mEobCorrections));
+        mEobCorrections = 0;
+    }
+
+    // Codes the correction bits buffered for the current block.
+    void putCorrections()
+    {
+        for (std::uint8_t bit : mCorrections)
+            mCoder.bits(bit, 1);
+        mCorrections.clear();
+    }
+
+    Coder& mCoder;
+    const ProgressiveScan& mScan;
+    std::array<int, 3> mDc{};
+    std::uint32_t mEobRun = 0;
+    std::vector<std::uint8_t> mCorrections; // of the end-of-band run, then of the current block
+    std::size_t mEobCorrections = 0;       // how many belong to the end-of-band run
+};
+
+// Y, Cb and Cr of `count` pixels from their R, G and B; `count` is a multiple
+// of 8. The scalar and vector paths compute in the same order.
+void convertToYcc(const float* r, const float* g, const float* b, std::size_t count, float* Y, float* U, float* V)
+{
+    std::size_t i = 0;
+#if defined(STB_IMAGE_PLUS_AVX2)
+    const auto k = [](float value) { return _mm256_set1_ps(value); };
+    for (; i < count; i += 8)
+    {
+        const __m256 R = _mm256_loadu_ps(r + i), G = _mm256_loadu_ps(g + i), B = _mm256_loadu_ps(b + i);
+        _mm256_storeu_ps(Y + i, _mm256_sub_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(k(0.29900f), R),
+                                                                          _mm256_mul_ps(k(0.58700f), G)),
+                                                            _mm256_mul_ps(k(0.11400f), B)),
+                                              k(128)));
+        _mm256_storeu_ps(U + i, _mm256_add_ps(_mm256_sub_ps(_mm256_mul_ps(k(-0.16874f), R),
+                                                            _mm256_mul_ps(k(0.33126f), G)),
+                                              _mm256_mul_ps(k(0.50000f), B)));
+        _mm256_storeu_ps(V + i, _mm256_sub_ps(_mm256_sub_ps(_mm256_mul_ps(k(0.50000f), R),
+                                                            _mm256_mul_ps(k(0.41869f), G)),
+                                              _mm256_mul_ps(k(0.08131f), B)));
+    }
+#elif defined(STB_IMAGE_PLUS_SSE2)
+    const auto k = [](float value) { return _mm_set1_ps(value); };
+    for (; i < count; i += 4)
+    {
+        const __m128 R = _mm_loadu_ps(r + i), G = _mm_loadu_ps(g + i), B = _mm_loadu_ps(b + i);
+        _mm_storeu_ps(Y + i, _mm_sub_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(k(0.29900f), R), _mm_mul_ps(k(0.58700f), G)),
+                                                   _mm_mul_ps(k(0.11400f), B)),
+                                        k(128)));
+        _mm_storeu_ps(U + i, _mm_add_ps(_mm_sub_ps(_mm_mul_ps(k(-0.16874f), R), _mm_mul_ps(k(0.33126f), G)),
+                                        _mm_mul_ps(k(0.50000f), B)));
+        _mm_storeu_ps(V + i, _mm_sub_ps(_mm_sub_ps(_mm_mul_ps(k(0.50000f), R), _mm_mul_ps(k(0.41869f), G)),
+                                        _mm_mul_ps(k(0.08131f), B)));
+    }
+#endif
+    for (; i < count; ++i)
+    {
+        Y[i] = +0.29900f * r[i] + 0.58700f * g[i] + 0.11400f * b[i] - 128;
+        U[i] = -0.16874f * r[i] - 0.33126f * g[i] + 0.50000f * b[i];
+        V[i] = +0.50000f * r[i] - 0.41869f * g[i] - 0.08131f * b[i];
+    }
+}
+
+// Averages each 2x2 square of the 16x16 `full` into the 8x8 `half` (4:2:0).
+void downsample420(const float* full, float* half)
+{
+    for (std::size_t yy = 0; yy < 8; ++yy)
+    {
+        const float* top = full + yy * 32;
+        const float* bottom = top + 16;
+        std::size_t xx = 0;
+#ifdef STB_IMAGE_PLUS_SSE2
+        for (; xx < 8; xx += 4)
+        {
+            const __m128 t0 = _mm_loadu_ps(top + xx * 2), t1 = _mm_loadu_ps(top + xx * 2 + 4);
+            const __m128 b0 = _mm_loadu_ps(bottom + xx * 2), b1 = _mm_loadu_ps(bottom + xx * 2 + 4);
+            const __m128 topEven = _mm_shuffle_ps(t0, t1, _MM_SHUFFLE(2, 0, 2, 0));
+            const __m128 topOdd = _mm_shuffle_ps(t0, t1, _MM_SHUFFLE(3, 1, 3, 1));
+            const __m128 bottomEven = _mm_shuffle_ps(b0, b1, _MM_SHUFFLE(2, 0, 2, 0));
+            const __m128 bottomOdd = _mm_shuffle_ps(b0, b1, _MM_SHUFFLE(3, 1, 3, 1));
+            const __m128 sum = _mm_add_ps(_mm_add_ps(_mm_add_ps(topEven, topOdd), bottomEven), bottomOdd);
+            _mm_storeu_ps(half + yy * 8 + xx, _mm_mul_ps(sum, _mm_set1_ps(0.25f)));
+        }
+#endif
+        for (; xx < 8; ++xx)
+            half[yy * 8 + xx] = (top[xx * 2] + top[xx * 2 + 1] + bottom[xx * 2] + bottom[xx * 2 + 1]) * 0.25f;
+    }
+}
+
+// Averages each horizontal pair of the 16x8 `full` into the 8x8 `half` (4:2:2).
+void downsample422(const float* full, float* half)
+{
+    std::size_t i = 0;
+#ifdef STB_IMAGE_PLUS_SSE2
+    for (; i < 64; i += 4)
+    {
+        const __m128 a = _mm_loadu_ps(full + i * 2), b = _mm_loadu_ps(full + i * 2 + 4);
+        const __m128 sum = _mm_add_ps(_mm_shuffle_ps(a, b, _MM_SHUFFLE(2, 0, 2, 0)),
+                                      _mm_shuffle_ps(a, b, _MM_SHUFFLE(3, 1, 3, 1)));
+        _mm_storeu_ps(half + i, _mm_mul_ps(sum, _mm_set1_ps(0.5f)));
+    }
+#endif
+    for (; i < 64; ++i)
+        half[i] = (full[i * 2] + full[i * 2 + 1]) * 0.5f;
+}
+
+// Encodes one MCU row (8 image rows, 16 with 4:2:0) at a time.
+class JpegEncoder final : public RowEncoder
+{
+public:
+    JpegEncoder(stbi_write_func* func, void* context, std::size_t width, std::size_t height,
+                std::size_t channels, const EncodeOptions& options) :
+        mWriter(func, context),
+        mWidth(width),
+        mHeight(height),
+        mChannels(channels),
+        mRowBytes(width * channels),
+        mOptimizeHuffman(options.jpegOptimizeHuffman),
+        mProgressive(options.jpegProgressive)
+    {
+        int quality = options.jpegQuality ? options.jpegQuality : 90;
+        JpegSubsampling subsampling = options.jpegSubsampling;
+        if (subsampling == JpegSubsampling::Auto)
+            subsampling = quality <= 90 ? JpegSubsampling::Chroma420 : JpegSubsampling::Chroma444;
+        mMcuWidth = subsampling == JpegSubsampling::Chroma444 ? 8 : 16;
+        mMcuRows = subsampling == JpegSubsampling::Chroma420 ? 16 : 8;
+        mMcusPerRow = (width + mMcuWidth - 1) / mMcuWidth;
+        quality = std::clamp(quality, 1, 100);
+        quality = quality < 50 ? 5000 / quality : 200 - quality * 2;
+
+        for (int i = 0; i < 64; ++i)
+        {
+            mLumaTable[kZigZag[i]] = static_cast<std::uint8_t>(std::clamp((kLumaQuant[i] * quality + 50) / 100, 1, 255));
+            mChromaTable[kZigZag[i]] = static_cast<std::uint8_t>(std::clamp((kChromaQuant[i] * quality + 50) / 100, 1, 255));
+        }
+        for (int row = 0, k = 0; row < 8; ++row)
+        {
+            for (int column = 0; column < 8; ++column, ++k)
+            {
+                mLumaDivisors[k] = 1 / (mLumaTable[kZigZag[k]] * kAanScale[row] * kAanScale[column]);
+                mChromaDivisors[k] = 1 / (mChromaTable[kZigZag[k]] * kAanScale[row] * kAanScale[column]);
+            }
+        }
+        // The DRI interval counts MCUs and has to fit 16 bits.
+        if (options.jpegRestartRows > 0 and not mProgressive)
+            mRestartRows = std::min(static_cast<std::size_t>(options.jpegRestartRows), 0xFFFF / mMcusPerRow);
+
+        // Optimized tables are only known once the whole image was seen.
+        if (not mOptimizeHuffman and not mProgressive)
+            writeHeader();
+    }
+
+    bool pushRows(const std::uint8_t* rows, std::size_t count) override
+    {
+        if (count > mHeight - rowsPushed())
+            return false;
+        while (count > 0)
+        {
+            const std::size_t take = std::min(count, mMcuRows - mPending.size() / mRowBytes);
+            mPending.insert(mPending.end(), rows, rows + take * mRowBytes);
+            rows += take * mRowBytes;
+            count -= take;
+            if (mPending.size() < mMcuRows * mRowBytes and rowsPushed() < mHeight)
+                break;
+
+            const std::size_t firstStaged = mNextRow;
+            encodeMcuRow(mWriter, mDc, mNextRow, [&](std::size_t y)
+            {
+                return mPending.data() + (y - firstStaged) * mRowBytes;
+            });
+            finishMcuRow();
+            mPending.clear();
+        }
+        return true;
+    }
+
+    std::size_t rowsPushed() const override
+    {
+        return mNextRow + mPending.size() / mRowBytes;
+    }
+
+    // Encodes the whole image straight from `pixels`, without staging.
+    void encode(const std::uint8_t* pixels, bool flip)
+    {
+        const auto rowAt = [&](std::size_t y)
+        {
+            return pixels + (flip ? mHeight - 1 - y : y) * mRowBytes;
+        };
+        if (not mOptimizeHuffman and not mProgressive)
+        {
+            codeIntervals([&](JpegWriter& writer, std::size_t first, std::size_t end)
+            {
+                DcPredictors dc{};
+                for (std::size_t y = first; y < end; y += mMcuRows)
+                    encodeMcuRow(writer, dc, y, rowAt);
+            });
+            return;
+        }
+        encodeCoefficients(transformImage(rowAt));
+    }
+
+    // Forward DCT of the whole image, before quantization, for encoding it
+    // at several qualities with encodeDct. Encoders with the same
+    // subsampling produce the same result.
+    std::vector<float> dctImage(const std::uint8_t* pixels, bool flip) const
+    {
+        const auto rowAt = [&](std::size_t y)
+        {
+            return pixels + (flip ? mHeight - 1 - y : y) * mRowBytes;
+        };
+        std::vector<float> dct(mcuRowCount() * rowCoefficients());
+        WorkerPool::instance().parallelFor(mcuRowCount(), [&](std::size_t row)
+        {
+            float* out = dct.data() + row * rowCoefficients();
+            forEachBlock(row * mMcuRows, rowAt, [&](int, float* block, std::size_t stride)
+            {
+                forwardDct(block, stride, out);
+                out += 64;
+            });
+        });
+        return dct;
+    }
+
+    // Encodes the image from dctImage, quantized at this encoder's quality.
+    void encodeDct(const std::vector<float>& dct)
+    {
+        encodeCoefficients(quantizeImage(dct));
+    }
+
+    // Luma blocks per MCU; each MCU adds one Cb and one Cr block.
+    std::size_t blocksPerMcu() const
+    {
+        return mMcuWidth / 8 * (mMcuRows / 8);
+    }
+
+private:
+    // DC values of the previous block of each component, reset at every
+    // restart marker.
+    using DcPredictors = std::array<int, 3>;
+
+    // Encodes from coefficients kept in memory: progressive, or baseline
+    // with the standard tables or tables fitted to them.
+    void encodeCoefficients(const std::vector<std::int16_t>& coefficients)
+    {
+        if (mProgressive)
+        {
+            encodeProgressive(coefficients);
+            return;
+        }
+
+        const auto codeRows = [&](auto& coder, std::size_t first, std::size_t end)
+        {
+            DcPredictors dc{};
+            const std::int16_t* block = coefficients.data() + first / mMcuRows * rowCoefficients();
+            const std::int16_t* endBlock = coefficients.data() + (end + mMcuRows - 1) / mMcuRows * rowCoefficients();
+            while (block != endBlock)
+            {
+                for (std::size_t i = 0; i < blocksPerMcu(); ++i, block += 64)
+                    dc[0] = codeBlock(coder, block, dc[0], kLumaDc);
+                for (int component = 1; component <= 2; ++component, block += 64)
+                    dc[component] = codeBlock(coder, block, dc[component], kChromaDc);
+            }
+        };
+        if (mOptimizeHuffman)
+        {
+            // First pass: count the symbols the coefficients code to.
+            SymbolCounter counter;
+            const std::size_t intervalRows = mRestartRows > 0 ? mRestartRows * mMcuRows : mHeight;
+            for (std::size_t first = 0; first < mHeight; first += intervalRows)
+                codeRows(counter, first, std::min(mHeight, first + intervalRows));
+            mOptimizedTables = optimalTables(counter);
+            mTables = &mOptimizedTables;
+            writeHeader();
+        }
+        codeIntervals([&](JpegWriter& writer, std::size_t first, std::size_t end)
+        {
+            BlockCoder coder(writer, *mTables);
+            codeRows(coder, first, end);
+        });
+    }
+
+    // SOI, JFIF APP0, DQT, SOF0, DHT, DRI and SOS. A progressive file gets
+    // SOF2 instead and its DHT and SOS segments with each scan.
+    void writeHeader()
+    {
+        static const std::uint8_t head0[] = {0xFF, 0xD8, 0xFF, 0xE0, 0, 0x10, 'J', 'F', 'I', 'F', 0, 1, 1, 0, 0, 1, 0,
+                                             1, 0, 0, 0xFF, 0xDB, 0, 0x84, 0};
+        static const std::uint8_t head2[] = {0xFF, 0xDA, 0, 0xC, 3, 1, 0, 2, 0x11, 3, 0x11, 0, 0x3F, 0};
+        const std::uint8_t lumaSampling = static_cast<std::uint8_t>(mMcuWidth / 8 << 4 | mMcuRows / 8);
+        const std::uint8_t head1[] = {0xFF, static_cast<std::uint8_t>(mProgressive ? 0xC2 : 0xC0), 0, 0x11, 8,
+                                      static_cast<std::uint8_t>(mHeight >> 8), static_cast<std::uint8_t>(mHeight),
+                                      static_cast<std::uint8_t>(mWidth >> 8), static_cast<std::uint8_t>(mWidth),
+                                      3, 1, lumaSampling, 0, 2, 0x11, 1, 3, 0x11, 1};
+        mWriter.putBytes(head0, sizeof(head0));
+        mWriter.putBytes(mLumaTable, sizeof(mLumaTable));
+        mWriter.putByte(1);
+        mWriter.putBytes(mChromaTable, sizeof(mChromaTable));
+        mWriter.putBytes(head1, sizeof(head1));
+
+        if (mProgressive)
+        {
+            mWriter.flush();
+            return;
+        }
+
+        putDht(mWriter, *mTables);
+        if (mRestartRows > 0)
+        {
+            const std::size_t interval = mRestartRows * mMcusPerRow;
+            const std::uint8_t dri[] = {0xFF, 0xDD, 0, 4, static_cast<std::uint8_t>(interval >> 8),
+                                        static_cast<std::uint8_t>(interval)};
+            mWriter.putBytes(dri, sizeof(dri));
+        }
+        mWriter.putBytes(head2, sizeof(head2));
+        mWriter.flush();
+    }
+
+    // Coefficients of each MCU row, quantized or not, are kept in one array:
+    // blocks in scan order, MCU rows one after another.
+    std::size_t mcuRowCount() const
+    {
+        return (mHeight + mMcuRows - 1) / mMcuRows;
+    }
+
+    std::size_t rowCoefficients() const
+    {
+        return mMcusPerRow * (blocksPerMcu() + 2) * 64;
+    }
+
+    // Transforms and quantizes every MCU row, in parallel.
+    template <typename RowAt>
+    std::vector<std::int16_t> transformImage(const RowAt& rowAt) const
+    {
+        std::vector<std::int16_t> coefficients(mcuRowCount() * rowCoefficients());
+        WorkerPool::instance().parallelFor(mcuRowCount(), [&](std::size_t row)
+        {
+            std::int16_t* out = coefficients.data() + row * rowCoefficients();
+            forEachBlock(row * mMcuRows, rowAt, [&](int component, float* block, std::size_t stride)
+            {
+                transformBlock(block, stride, divisorsFor(component), out);
+                out += 64;
+            });
+        });
+        return coefficients;
+    }
+
+    // Quantizes the output of dctImage.
+    std::vector<std::int16_t> quantizeImage(const std::vector<float>& dct) const
+    {
+        std::vector<std::int16_t> coefficients(dct.size());
+        const std::size_t mcuBlocks = blocksPerMcu() + 2;
+        WorkerPool::instance().parallelFor(mcuRowCount(), [&](std::size_t row)
+        {
+            const std::size_t first = row * rowCoefficients(), end = first + rowCoefficients();
+            for (std::size_t i = first, block = 0; i < end; i += 64, ++block)
+            {
+                const int component = block % mcuBlocks < blocksPerMcu() ? 0 : 1;
+                quantizeBlock(dct.data() + i, divisorsFor(component), coefficients.data() + i);
+            }
+        });
+        return coefficients;
+    }
+
+    // Writes the image as the scans of kProgressiveScans, each with its own
+    // optimized tables. The scans only read the shared coefficients, so they
+    // are counted and coded in parallel.
+    void encodeProgressive(const std::vector<std::int16_t>& coefficients)
+    {
+        const std::size_t lumaWidth = mMcuWidth / 8, lumaHeight = mMcuRows / 8;
+        const std::size_t mcuBlocks = blocksPerMcu() + 2;
+        const auto blockAt = [&](int component, std::size_t x, std::size_t y)
+        {
+            std::size_t mcu = y * mMcusPerRow + x;
+            std::size_t index = blocksPerMcu() + component - 1;
+            if (component == 0)
+            {
+                mcu = y / lumaHeight * mMcusPerRow + x / lumaWidth;
+                index = y % lumaHeight * lumaWidth + x % lumaWidth;
+            }
+            return coefficients.data() + (mcu * mcuBlocks + index) * 64;
+        };
+        const auto codeScan = [&](auto& coder, const ProgressiveScan& scan)
+        {
+            ProgressiveScanCoder scanCoder(coder, scan);
+            if (scan.componentCount > 1)
+            {
+                // Interleaved: MCU by MCU, padding blocks included.
+                for (std::size_t y = 0; y < mcuRowCount(); ++y)
+                {
+                    for (std::size_t x = 0; x < mMcusPerRow; ++x)
+                    {
+                        for (std::size_t i = 0; i < blocksPerMcu(); ++i)
+                            scanCoder.code(blockAt(0, x * lumaWidth + i % lumaWidth, y * lumaHeight + i / lumaWidth), 0);
+                        scanCoder.code(blockAt(1, x, y), 1);
+                        scanCoder.code(blockAt(2, x, y), 2);
+                    }
+                }
+            }
+            else
+            {
+                // A single component covers just the blocks of its own size.
+                const int component = scan.components[0];
+                const std::size_t width = component == 0 ? mWidth : (mWidth + lumaWidth - 1) / lumaWidth;
+                const std::size_t height = component == 0 ? mHeight : (mHeight + lumaHeight - 1) / lumaHeight;
+                for (std::size_t y = 0; y < (height + 7) / 8; ++y)
+                {
+                    for (std::size_t x = 0; x < (width + 7) / 8; ++x)
+                        scanCoder.code(blockAt(component, x, y), component);
+                }
+            }
+            scanCoder.finish();
+        };
+
+        constexpr std::size_t scanCount = std::size(kProgressiveScans);
+        std::vector<std::uint8_t> scanBytes[scanCount];
+        WorkerPool::instance().parallelFor(scanCount, [&](std::size_t i)
+        {
+            const ProgressiveScan& scan = kProgressiveScans[i];
+            SymbolCounter counter;
+            codeScan(counter, scan);
+            const HuffmanTables tables = optimalTables(counter);
+
+            JpegWriter writer(writeToVector, &scanBytes[i]);
+            if (scan.ss != 0 or scan.ah == 0)
+                putDht(writer, tables);
+            const std::uint8_t length = static_cast<std::uint8_t>(6 + 2 * scan.componentCount);
+            const std::uint8_t sos[] = {0xFF, 0xDA, 0, length, static_cast<std::uint8_t>(scan.componentCount)};
+            writer.putBytes(sos, sizeof(sos));
+            for (int c = 0; c < scan.componentCount; ++c)
+            {
+                // DC scans use table 0 for luma and 1 for chroma, AC scans table 0.
+                const int component = scan.components[c];
+                writer.putByte(static_cast<std::uint8_t>(component + 1));
+                writer.putByte(static_cast<std::uint8_t>(scan.ss == 0 and component > 0 ? 0x10 : 0x00));
+            }
+            const std::uint8_t spectral[] = {static_cast<std::uint8_t>(scan.ss), static_cast<std::uint8_t>(scan.se),
+                                             static_cast<std::uint8_t>(scan.ah << 4 | scan.al)};
+            writer.putBytes(spectral, sizeof(spectral));
+
+            BlockCoder coder(writer, tables);
+            codeScan(coder, scan);
+            writer.alignToByte();
+            writer.flush();
+        });
+
+        writeHeader();
+        for (const std::vector<std::uint8_t>& bytes : scanBytes)
+        {
+            mWriter.putBytes(bytes.data(), bytes.size());
+            mWriter.flush();
+        }
+        mNextRow = mHeight;
+        mWriter.putByte(0xFF);
+        mWriter.putByte(0xD9);
+        mWriter.flush();
+    }
+
+    // Converts the width x height block at (x, y) to YCbCr, repeating the
+    // last row and column past the image edges.
+    template <typename RowAt>
+    void loadBlock(const RowAt& rowAt, std::size_t x, std::size_t y, std::size_t width, std::size_t height,
+                   float* Y, float* U, float* V) const
+    {
+        // Grey (+ alpha) reads the same byte for all three of R, G and B.
+        const std::size_t offsetG = mChannels > 2 ? 1 : 0, offsetB = mChannels > 2 ? 2 : 0;
+        for (std::size_t row = y; row < y + height; ++row)
+        {
+            const std::uint8_t* line = rowAt(std::min(row, mHeight - 1));
+            float r[16], g[16], b[16];
+            for (std::size_t column = x, i = 0; column < x + width; ++column, ++i)
+            {
+                const std::uint8_t* pixel = line + std::min(column, mWidth - 1) * mChannels;
+                r[i] = pixel[0];
+                g[i] = pixel[offsetG];
+                b[i] = pixel[offsetB];
+            }
+            const std::size_t pos = (row - y) * width;
+            convertToYcc(r, g, b, width, Y + pos, U + pos, V + pos);
+        }
+    }
+
+    // Converts the MCU row starting at image row y to YCbCr and hands each
+    // of its blocks to `sink(component, block, stride)`, in scan order. The
+    // sink may overwrite the block. `rowAt(y)` returns row y for the rows of
+    // the MCU row that lie inside the image.
+    template <typename RowAt, typename BlockSink>
+    void forEachBlock(std::size_t y, const RowAt& rowAt, const BlockSink& sink) const
+    {
+        for (std::size_t x = 0; x < mWidth; x += mMcuWidth)
+        {
+            float Y[256], U[256], V[256];
+            loadBlock(rowAt, x, y, mMcuWidth, mMcuRows, Y, U, V);
+            for (std::size_t blockY = 0; blockY < mMcuRows; blockY += 8)
+            {
+                for (std::size_t blockX = 0; blockX < mMcuWidth; blockX += 8)
+                    sink(0, Y + blockY * mMcuWidth + blockX, mMcuWidth);
+            }
+
+            float subU[64], subV[64];
+            float* chromaU = U;
+            float* chromaV = V;
+            if (mMcuRows == 16)
+            {
+                downsample420(U, chromaU = subU);
+                downsample420(V, chromaV = subV);
+            }
+            else if (mMcuWidth == 16)
+            {
+                downsample422(U, chromaU = subU);
+                downsample422(V, chromaV = subV);
+            }
+            sink(1, chromaU, std::size_t(8));
+            sink(2, chromaV, std::size_t(8));
+        }
+    }
+
+    const float* divisorsFor(int component) const
+    {
+        return component == 0 ? mLumaDivisors : mChromaDivisors;
+    }
+
+    // Transforms and entropy codes the MCU row starting at image row y.
+    template <typename RowAt>
+    void encodeMcuRow(JpegWriter& writer, DcPredictors& dc, std::size_t y, const RowAt& rowAt) const
+    {
+        BlockCoder coder(writer, *mTables);
+        alignas(16) std::int16_t coefficients[64];
+        forEachBlock(y, rowAt, [&](int component, float* block, std::size_t stride)
+        {
+            transformBlock(block, stride, divisorsFor(component), coefficients);
+            dc[component] = codeBlock(coder, coefficients, dc[component], component == 0 ? kLumaDc : kChromaDc);
+        });
+    }
+
+    // Codes the scan as restart intervals of mRestartRows MCU rows, or as a
+    // single interval without restart markers, with
+    // `codeRows(writer, firstRow, endRow)`, and writes them out with their
+    // markers. Several intervals are coded on the worker pool, a window of
+    // them at a time.
+    template <typename CodeRows>
+    void codeIntervals(const CodeRows& codeRows)
+    {
+        WorkerPool& pool = WorkerPool::instance();
+        if (mRestartRows == 0 or pool.concurrency() == 1)
+        {
+            const std::size_t intervalRows = mRestartRows > 0 ? mRestartRows * mMcuRows : mHeight;
+            while (mNextRow < mHeight)
+            {
+                const std::size_t end = std::min(mHeight, mNextRow + intervalRows);
+                codeRows(mWriter, mNextRow, end);
+                mNextRow = end;
+                mWriter.alignToByte();
+                finishInterval();
+                mWriter.flush();
+            }
+            return;
+        }
+
+        const std::size_t intervalRows = mRestartRows * mMcuRows;
+        std::vector<std::vector<std::uint8_t>> intervals(pool.concurrency());
+        while (mNextRow < mHeight)
+        {
+            const std::size_t first = mNextRow;
+            const std::size_t count = std::min(intervals.size(), (mHeight - first + intervalRows - 1) / intervalRows);
+            pool.parallelFor(count, [&](std::size_t i)
+            {
+                std::vector<std::uint8_t>& bytes = intervals[i];
+                bytes.clear();
+                JpegWriter writer(writeToVector, &bytes);
+                const std::size_t start = first + i * intervalRows;
+                codeRows(writer, start, std::min(mHeight, start + intervalRows));
+                writer.alignToByte();
+                writer.flush();
+            });
+            for (std::size_t i = 0; i < count; ++i)
+            {
+                mWriter.putBytes(intervals[i].data(), intervals[i].size());
+                mNextRow = std::min(mHeight, mNextRow + intervalRows);
+                finishInterval();
+                mWriter.flush();
+            }
+        }
+    }
+
+    // Moves past the MCU row just coded into mWriter, closing its restart
+    // interval or the scan when it was the last row of either.
+    void finishMcuRow()
+    {
+        mNextRow = std::min(mHeight, mNextRow + mMcuRows);
+        if (mNextRow == mHeight or (mRestartRows > 0 and mNextRow / mMcuRows % mRestartRows == 0))
+        {
+            mWriter.alignToByte();
+            finishInterval();
+        }
+        mWriter.flush();
+    }
+
+    // Follows a byte aligned restart interval ending at mNextRow with the
+    // next RSTn marker, or with EOI after the last one.
+    void finishInterval()
+    {
+        mWriter.putByte(0xFF);
+        if (mNextRow == mHeight)
+        {
+            mWriter.putByte(0xD9);
+            return;
+        }
+        mWriter.putByte(static_cast<std::uint8_t>(0xD0 + mRestartMarkers++ % 8));
+        mDc = {};
+    }
+
+    JpegWriter mWriter;
+    std::size_t mWidth, mHeight, mChannels, mRowBytes;
+    bool mOptimizeHuffman;
+    bool mProgressive;
+    std::size_t mMcuWidth = 8, mMcuRows = 8;
+    std::size_t mMcusPerRow = 0;
+    std::size_t mRestartRows = 0; // MCU rows per restart interval, 0 for none
+    std::uint8_t mLumaTable[64], mChromaTable[64]; // DQT, zigzag order
+    float mLumaDivisors[64], mChromaDivisors[64];
+    const HuffmanTables* mTables = &standardTables();
+    HuffmanTables mOptimizedTables;
+    DcPredictors mDc{};
+    unsigned mRestartMarkers = 0;       // RSTn markers written so far
+    std::size_t mNextRow = 0;           // rows encoded so far
+    std::vector<std::uint8_t> mPending; // rows pushed but not yet encoded
+};
+
+bool validGeometry(std::size_t width, std::size_t height, std::size_t channels)
+{
+    return width > 0 and height > 0 and width <= 0xFFFF and height <= 0xFFFF and channels >= 1 and channels <= 4;
+}
+
+}
+
+bool writeJpeg(stbi_write_func* func, void* context, const std::uint8_t* pixels,
+               std::size_t width, std::size_t height, std::size_t channels,
+               const EncodeOptions& options)
+{
+    if (pixels == nullptr or not validGeometry(width, height, channels))
+        return false;
+    JpegEncoder(func, context, width, height, channels, options).encode(pixels, options.flipVertically);
+    return true;
+}
+
+int writeJpegToSize(std::vector<std::uint8_t>& out, std::size_t maxBytes, const std::uint8_t* pixels,
+                    std::size_t width, std::size_t height, std::size_t channels, const EncodeOptions& options)
+{
+    if (pixels == nullptr or not validGeometry(width, height, channels))
+        return 0;
+
+    // The DCT only depends on the subsampling, which Auto switches at
+    // quality 90, so at most two are needed; keyed by luma blocks per MCU.
+    std::vector<float> dct[3];
+    std::vector<std::uint8_t> attempt, best;
+    int bestQuality = 0;
+    for (int low = 1, high = 100; low <= high;)
+    {
+        const int quality = (low + high) / 2;
+        EncodeOptions attemptOptions = options;
+        attemptOptions.jpegQuality = quality;
+        attempt.clear();
+        JpegEncoder encoder(writeToVector, &attempt, width, height, channels, attemptOptions);
+        std::vector<float>& layoutDct = dct[encoder.blocksPerMcu() / 2];
+        if (layoutDct.empty())
+            layoutDct = encoder.dctImage(pixels, options.flipVertically);
+        encoder.encodeDct(layoutDct);
+
+        if (attempt.size() <= maxBytes)
+        {
+            bestQuality = quality;
+            best.swap(attempt);
+            low = quality + 1;
+        }
+        else
+            high = quality - 1;
+    }
+    out.insert(out.end(), best.begin(), best.end());
+    return bestQuality;
+}
+
+std::array<std::uint16_t, 64> jpegQuantTable(int quality, bool chroma)
+{
+    quality = std::clamp(quality, 1, 100);
+    const int scale = quality < 50 ? 5000 / quality : 200 - quality * 2;
+    const int* base = chroma ? kChromaQuant : kLumaQuant;
+    std::array<std::uint16_t, 64> table;
+    for (int i = 0; i < 64; ++i)
+        table[i] = static_cast<std::uint16_t>(std::clamp((base[i] * scale + 50) / 100, 1, 255));
+    return table;
+}
+
+int estimateJpegQuality(const JpegFile& file)
+{
+    if (file.components.empty())
+        return 0;
+    const int lumaTable = file.components[0].quantTable;
+    const int chromaTable = file.components.size() >= 3 ? file.components[1].quantTable : lumaTable;
+
+    // Distance to the tables the encoder uses for `quality`.
+    const auto distance = [&](int quality)
+    {
+        const std::array<std::uint16_t, 64> luma = jpegQuantTable(quality, false);
+        const std::array<std::uint16_t, 64> chroma = jpegQuantTable(quality, true);
+        long error = 0;
+        for (int i = 0; i < 64; ++i)
+        {
+            error += std::abs(file.quantTables[lumaTable][i] - luma[i]);
+            if (chromaTable != lumaTable)
+                error += std::abs(file.quantTables[chromaTable][i] - chroma[i]);
+        }
+        return error;
+    };
+    int best = 100;
+    long bestError = distance(best);
+    for (int quality = 99; quality >= 1 and bestError > 0; --quality)
+    {
+        const long error = distance(quality);
+        if (error < bestError)
+        {
+            best = quality;
+            bestError = error;
+        }
+    }
+    return best;
+}
+
+bool writeJpegCoefficients(stbi_write_func* func, void* context, const JpegFile& file)
+{
+    if (file.components.empty() or file.width == 0 or file.height == 0 or file.width > 0xFFFF
+        or file.height > 0xFFFF)
+        return false;
+
+    // Blocks in scan order: one component codes its own blocks row by row,
+    // several are interleaved by MCU.
+    const bool interleaved = file.components.size() > 1;
+    const auto forEachBlock = [&](auto&& code)
+    {
+        const std::size_t unitsWide = interleaved ? file.mcusWide() : (file.width + 7) / 8;
+        const std::size_t unitsHigh = interleaved ? file.mcusHigh() : (file.height + 7) / 8;
+        for (std::size_t y = 0; y < unitsHigh; ++y)
+        {
+            for (std::size_t x = 0; x < unitsWide; ++x)
+            {
+                for (std::size_t c = 0; c < file.components.size(); ++c)
+                {
+                    const JpegComponent& component = file.components[c];
+                    const int wide = interleaved ? component.horizontalSampling : 1;
+                    const int high = interleaved ? component.verticalSampling : 1;
+                    for (int v = 0; v < high; ++v)
+                    {
+                        for (int h = 0; h < wide; ++h)
+                        {
+                            const std::size_t index = (y * high + v) * component.blocksWide + x * wide + h;
+                            code(c, component.coefficients.data() + index * 64);
+                        }
+                    }
+                }
+            }
+        }
+    };
+    for (const JpegComponent& component : file.components)
+    {
+        if (component.coefficients.size() < component.blocksWide * component.blocksHigh * 64
+            or component.blocksWide < (interleaved ? file.mcusWide() * component.horizontalSampling
+                                                   : (file.width + 7) / 8)
+            or component.blocksHigh < (interleaved ? file.mcusHigh() * component.verticalSampling
+                                                   : (file.height + 7) / 8))
+            return false;
+    }
+
+    // The first component gets the luma tables, the others the chroma ones.
+    SymbolCounter counter;
+    std::array<int, 4> dc{};
+    forEachBlock([&](std::size_t c, const std::int16_t* block)
+    {
+        dc[c] = codeBlock(counter, block, dc[c], c == 0 ? kLumaDc : kChromaDc);
+    });
+    const HuffmanTables tables = optimalTables(counter);
+
+    JpegWriter writer(func, context);
+    writer.putByte(0xFF);
+    writer.putByte(0xD8);
+    for (const std::vector<std::uint8_t>& segment : file.segments)
+        writer.putBytes(segment.data(), segment.size());
+
+    // Tables with entries past 255 need 16-bit precision, and so SOF1.
+    bool extended = false;
+    for (int id = 0; id < 4; ++id)
+    {
+        const bool used = std::any_of(file.components.begin(), file.components.end(),
+                                      [&](const JpegComponent& component) { return component.quantTable == id; });
+        if (not used)
+            continue;
+        const std::array<std::uint16_t, 64>& table = file.quantTables[id];
+        const bool wide = std::any_of(table.begin(), table.end(), [](std::uint16_t q) { return q > 255; });
+        extended = extended or wide;
+        const std::size_t length = 3 + 64 * (wide ? 2 : 1);
+        const std::uint8_t dqt[] = {0xFF, 0xDB, 0, static_cast<std::uint8_t>(length),
+                                    static_cast<std::uint8_t>((wide ? 0x10 : 0) | id)};
+        writer.putBytes(dqt, sizeof(dqt));
+        std::uint16_t zigzag[64];
+        for (int i = 0; i < 64; ++i)
+            zigzag[kZigZag[i]] = table[i];
+        for (std::uint16_t q : zigzag)
+        {
+            if (wide)
+                writer.putByte(static_cast<std::uint8_t>(q >> 8));
+            writer.putByte(static_cast<std::uint8_t>(q));
+        }
+    }
+
+    const std::size_t count = file.components.size();
+    const std::uint8_t sof[] = {0xFF, static_cast<std::uint8_t>(extended ? 0xC1 : 0xC0), 0,
+                                static_cast<std::uint8_t>(8 + 3 * count), 8,
+                                static_cast<std::uint8_t>(file.height >> 8), static_cast<std::uint8_t>(file.height),
+                                static_cast<std::uint8_t>(file.width >> 8), static_cast<std::uint8_t>(file.width),
+                                static_cast<std::uint8_t>(count)};
+    writer.putBytes(sof, sizeof(sof));
+    for (const JpegComponent& component : file.components)
+    {
+        writer.putByte(static_cast<std::uint8_t>(component.id));
+        writer.putByte(static_cast<std::uint8_t>(component.horizontalSampling << 4 | component.verticalSampling));
+        writer.putByte(static_cast<std::uint8_t>(component.quantTable));
+    }
+    putDht(writer, tables);
+
+    const std::uint8_t sos[] = {0xFF, 0xDA, 0, static_cast<std::uint8_t>(6 + 2 * count),
+                                static_cast<std::uint8_t>(count)};
+    writer.putBytes(sos, sizeof(sos));
+    for (std::size_t c = 0; c < count; ++c)
+    {
+        writer.putByte(static_cast<std::uint8_t>(file.components[c].id));
+        writer.putByte(c == 0 ? 0x00 : 0x11);
+    }
+    // Spectral selection 0..63, no successive approximation.
+    writer.putByte(0);
+    writer.putByte(0x3F);
+    writer.putByte(0);
+
+    BlockCoder coder(writer, tables);
+    dc = {};
+    forEachBlock([&](std::size_t c, const std::int16_t* block)
+    {
+        dc[c] = codeBlock(coder, block, dc[c], c == 0 ? kLumaDc : kChromaDc);
+    });
+    writer.alignToByte();
+    writer.putByte(0xFF);
+    writer.putByte(0xD9);
+    writer.flush();
+    return true;
+}
+
+std::unique_ptr<RowEncoder> makeJpegRowEncoder(stbi_write_func* func, void* context,
+                                               std::size_t width, std::size_t height, std::size_t channels,
+                                               const EncodeOptions& options)
+{
+    if (not validGeometry(width, height, channels) or options.jpegOptimizeHuffman or options.jpegProgressive)
+        return nullptr;
+    return std::make_unique<JpegEncoder>(func, context, width, height, channels, options);
+}
+
+}
@@ -0,0 +1,66 @@
+#pragma once
+
+#include <stb_image_plus.h>
+#include "stb_image_plus_jpeg_read.h"
+#include "stb_image_plus_row_encoder.h"
+#include <stb_image_write.h>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+namespace stb_image_plus::detail
+{
+
+/* Baseline JPEG encoder behind ImageData::write, derived from the
+ * stb_image_write one (itself based on Jon Olick's jo_jpeg). Output for
+ * JpegSubsampling::Auto matches stbi_write_jpg byte for byte (builds that
+ * contract to FMA may differ in the rounding of a few coefficients); unlike
+ * it, quality, subsampling and flipping come from `options`, not from
+ * globals. Colour conversion, downsampling, the DCT and quantization use
+ * SSE2 or AVX2 when available.
+ * `pixels` holds `channels` (1..4) interleaved bytes per pixel, rows packed;
+ * alpha is ignored. */
+bool writeJpeg(stbi_write_func* func, void* context, const std::uint8_t* pixels,
+               std::size_t width, std::size_t height, std::size_t channels,
+               const EncodeOptions& options);
+
+/* Appends to `out` the JPEG of the highest quality whose size is at most
+ * `maxBytes`, found by binary search, and returns that quality; returns 0
+ * and leaves `out` alone if none fits. The image is converted and
+ * transformed once; each search step only quantizes and codes again.
+ * `options.jpegQuality` is ignored. */
+int writeJpegToSize(std::vector<std::uint8_t>& out, std::size_t maxBytes, const std::uint8_t* pixels,
+                    std::size_t width, std::size_t height, std::size_t channels, const EncodeOptions& options);
+
+/* The luma or chroma quantization table, in natural order, writeJpeg uses
+ * for `quality` (1..100): the Annex K one scaled as libjpeg does. */
+std::array<std::uint16_t, 64> jpegQuantTable(int quality, bool chroma);
+
+/* The quality (1..100) whose scaled Annex K tables, as writeJpeg and
+ * libjpeg derive them, come closest to the quantization tables of `file`:
+ * its luma table, and its chroma one when the chroma components use another
+ * table. Exact for files from those encoders; for other tables, the quality
+ * of roughly the same coarseness. Ties go to the higher quality. */
+int estimateJpegQuality(const JpegFile& file);
+
+/* Writes the coefficients of `file` (as from readJpeg) as a baseline JPEG,
+ * or an extended one when a quantization table needs 16 bits, with
+ * Huffman tables fitted to them: the first component gets one pair of
+ * tables, the others share the second. Its segments are copied after SOI.
+ * Returns false for dimensions past 65535 or coefficients that don't cover
+ * the image. */
+bool writeJpegCoefficients(stbi_write_func* func, void* context, const JpegFile& file);
+
+/* The same encoder fed row by row, for StreamEncoder: each MCU row (8 image
+ * rows, 16 with 4:2:0) is encoded and passed on as soon as its rows are in,
+ * on the calling thread.
+ * `options.flipVertically` is ignored. Returns null for unsupported
+ * dimensions, and for `options.jpegOptimizeHuffman` and
+ * `options.jpegProgressive`, which depend on the whole image. */
+std::unique_ptr<RowEncoder> makeJpegRowEncoder(stbi_write_func* func, void* context,
+                                               std::size_t width, std::size_t height, std::size_t channels,
+                                               const EncodeOptions& options);
+
+}
@@ -0,0 +1,788 @@
+#include "stb_image_plus_jpeg_read.h"
+#include <algorithm>
+#include <span>
+
+namespace stb_image_plus::detail
+{
+
+namespace
+{
+
+// Marker codes (the byte after 0xFF).
+constexpr std::uint8_t kSoi = 0xD8;
+constexpr std::uint8_t kEoi = 0xD9;
+constexpr std::uint8_t kSos = 0xDA;
+constexpr std::uint8_t kDqt = 0xDB;
+constexpr std::uint8_t kDht = 0xC4;
+constexpr std::uint8_t kDri = 0xDD;
+constexpr std::uint8_t kSof0 = 0xC0;
+constexpr std::uint8_t kSof1 = 0xC1;
+constexpr std::uint8_t kSof2 = 0xC2;
+constexpr std::uint8_t kApp0 = 0xE0;
+constexpr std::uint8_t kApp1 = 0xE1;
+constexpr std::uint8_t kApp15 = 0xEF;
+constexpr std::uint8_t kCom = 0xFE;
+
+bool isRestart(std::uint8_t marker)
+{
+    return marker >= 0xD0 and marker <= 0xD7;
+}
+
+// Reads one marker segment; every read past its end yields 0 and clears `ok`.
+class SegmentReader
+{
+public:
+    SegmentReader(const std::uint8_t* data, std::size_t size) :
+        mData(data),
+        mSize(size)
+    {
+    }
+
+    std::uint8_t byte()
+    {
+        if (mPosition == mSize)
+        {
+            mOk = false;
+            return 0;
+        }
+        return mData[mPosition++];
+    }
+
+    std::uint16_t word()
+    {
+        const std::uint16_t high = byte();
+        return static_cast<std::uint16_t>(high << 8 | byte());
+    }
+
+    bool atEnd() const { return mPosition == mSize; }
+    bool ok() const { return mOk; }
+
+private:
+    const std::uint8_t* mData;
+    std::size_t mSize;
+    std::size_t mPosition = 0;
+    bool mOk = true;
+};
+
+// A Huffman table set up for decoding: codes up to kFastBits long are
+// looked up directly, longer ones are found by length (T.81 F.2.2.3).
+struct HuffmanDecoder
+{
+    static constexpr int kFastBits = 9;
+
+    bool defined = false;
+    // Code length << 8 | symbol, 0 for codes longer than kFastBits.
+    std::array<std::uint16_t, 1 << kFastBits> fast{};
+    // For AC tables, the AC value, zero run and total length coded by
+    // kFastBits bits that hold a whole code and its value bits, packed as
+    // value << 8 | run << 4 | length; 0 when they don't.
+    std::array<std::int16_t, 1 << kFastBits> fastAc{};
+    // Largest code of each length, -1 for none; symbols[code + offset[length]].
+    std::array<int, 17> maxCode{};
+    std::array<int, 17> offset{};
+    std::array<std::uint8_t, 256> symbols{};
+};
+
+bool buildDecoder(const std::uint8_t (&counts)[16], const std::uint8_t* symbols, int symbolCount,
+                  HuffmanDecoder& decoder)
+{
+    decoder = HuffmanDecoder{};
+    std::copy(symbols, symbols + symbolCount, decoder.symbols.begin());
+    int code = 0, index = 0;
+    for (int length = 1; length <= 16; ++length)
+    {
+        decoder.offset[length] = index - code;
+        for (int i = 0; i < counts[length - 1]; ++i, ++code, ++index)
+        {
+            // More codes than fit in `length` bits: not a prefix code.
+            if (code >= 1 << length)
+                return false;
+            if (length <= HuffmanDecoder::kFastBits)
+            {
+                const int shift = HuffmanDecoder::kFastBits - length;
+                for (int k = 0; k < 1 << shift; ++k)
+                    decoder.fast[code << shift | k] = static_cast<std::uint16_t>(length << 8 | symbols[index]);
+            }
+        }
+        decoder.maxCode[length] = counts[length - 1] != 0 ? code - 1 : -1;
+        code <<= 1;
+    }
+    decoder.defined = true;
+    return true;
+}
+
+// T.81 F.2.2.1: the value coded by `length` additional bits.
+int extend(int value, int length)
+{
+    return length == 0 or value >= 1 << (length - 1) ? value : value - (1 << length) + 1;
+}
+
+void buildFastAc(HuffmanDecoder& decoder)
+{
+    constexpr int bits = HuffmanDecoder::kFastBits;
+    for (int i = 0; i < 1 << bits; ++i)
+    {
+        const int codeLength = decoder.fast[i] >> 8, symbol = decoder.fast[i] & 0xFF;
+        const int run = symbol >> 4, length = symbol & 15;
+        if (codeLength == 0 or length == 0 or codeLength + length > bits)
+            continue;
+        const int value = extend((i << codeLength & ((1 << bits) - 1)) >> (bits - length), length);
+        if (value >= -128 and value <= 127)
+            decoder.fastAc[i] = static_cast<std::int16_t>(value * 256 + run * 16 + codeLength + length);
+    }
+}
+
+std::uint64_t loadBigEndian64(const std::uint8_t* data)
+{
+    std::uint64_t value = 0;
+    for (int i = 0; i < 8; ++i)
+        value = value << 8 | data[i];
+    return value;
+}
+
+// Where the EXIF orientation tag of an APP1 segment sits, if it has one.
+void findOrientation(const std::vector<std::uint8_t>& segment, int index, JpegFile& file)
+{
+    // FF E1, length, "Exif\0\0", then a TIFF file.
+    constexpr std::size_t tiff = 10;
+    if (file.orientationSegment >= 0 or segment.size() < tiff + 8
+        or not std::equal(segment.begin() + 4, segment.begin() + tiff, "Exif\0"))
+        return;
+    const bool bigEndian = segment[tiff] == 'M';
+    if (segment[tiff] != segment[tiff + 1] or (segment[tiff] != 'M' and segment[tiff] != 'I'))
+        return;
+    const auto read = [&](std::size_t at, int bytes)
+    {
+        std::uint32_t value = 0;
+        for (int i = 0; i < bytes; ++i)
+            value |= static_cast<std::uint32_t>(segment[at + i]) << (bigEndian ? (bytes - 1 - i) * 8 : i * 8);
+        return value;
+    };
+    if (read(tiff + 2, 2) != 42)
+        return;
+    const std::size_t ifd = tiff + read(tiff + 4, 4);
+    if (ifd < tiff or ifd + 2 > segment.size())
+        return;
+    const std::size_t entries = read(ifd, 2);
+    for (std::size_t i = 0; i < entries and ifd + 2 + i * 12 + 12 <= segment.size(); ++i)
+    {
+        const std::size_t entry = ifd + 2 + i * 12;
+        // Tag 0x0112, one SHORT.
+        if (read(entry, 2) != 0x0112 or read(entry + 2, 2) != 3 or read(entry + 4, 4) != 1)
+            continue;
+        const int orientation = static_cast<int>(read(entry + 8, 2));
+        if (orientation >= 1 and orientation <= 8)
+        {
+            file.orientation = orientation;
+            file.orientationSegment = index;
+            file.orientationOffset = entry + 8;
+            file.orientationBigEndian = bigEndian;
+        }
+        return;
+    }
+}
+
+// Walks the markers of a JPEG file and, unless asked for the header only,
+// decodes its scans.
+class JpegReader
+{
+public:
+    JpegReader(const std::uint8_t* data, std::size_t size, JpegFile& file) :
+        mData(data),
+        mSize(size),
+        mFile(file)
+    {
+    }
+
+    bool read(bool headerOnly)
+    {
+        mFile = JpegFile{};
+        if (mData == nullptr or mSize < 4 or mData[0] != 0xFF or mData[1] != kSoi)
+            return false;
+
+        mPosition = 2;
+        bool sawScan = false;
+        while (true)
+        {
+            const int marker = nextMarker();
+            // A file that ends without EOI keeps what was decoded; one that
+            // ends before its first scan has no image.
+            if (marker < 0 or marker == kEoi)
+                return sawScan;
+            if (isRestart(static_cast<std::uint8_t>(marker)) or marker == 0x01)
+                continue;
+
+            if (mSize - mPosition < 2)
+                return false;
+            const std::size_t length = static_cast<std::size_t>(mData[mPosition] << 8 | mData[mPosition + 1]);
+            if (length < 2 or mSize - mPosition < length)
+                return false;
+            SegmentReader segment(mData + mPosition + 2, length - 2);
+            const std::size_t start = mPosition - 2;
+            mPosition += length;
+
+            bool ok = true;
+            if (marker == kSos)
+            {
+                if (not sawScan and not startImage(headerOnly))
+                    return false;
+                sawScan = true;
+                if (headerOnly)
+                    return true;
+                ok = readScan(segment);
+            }
+            else if (marker == kDqt)
+                ok = readQuantTables(segment);
+            else if (marker == kDht)
+                ok = readHuffmanTables(segment);
+            else if (marker == kDri)
+            {
+                mRestartInterval = segment.word();
+                ok = segment.ok();
+            }
+            else if (marker == kSof0 or marker == kSof1 or marker == kSof2)
+                ok = readFrame(segment, static_cast<std::uint8_t>(marker));
+            // Any other frame type: lossless, hierarchical or arithmetic coded.
+            else if (marker >= 0xC3 and marker <= 0xCF and marker != 0xC8)
+                ok = false;
+            else if ((marker >= kApp0 and marker <= kApp15) or marker == kCom)
+            {
+                mFile.segments.emplace_back(mData + start, mData + mPosition);
+                if (marker == kApp1)
+                    findOrientation(mFile.segments.back(), static_cast<int>(mFile.segments.size() - 1), mFile);
+            }
+            if (not ok)
+                return false;
+        }
+    }
+
+private:
+    struct ScanComponent
+    {
+        JpegComponent* component = nullptr;
+        const HuffmanDecoder* dc = nullptr;
+        const HuffmanDecoder* ac = nullptr;
+        int dcPrediction = 0;
+    };
+
+    static constexpr int kInvalid = 1 << 30;
+
+    // Finds the next marker from the current position, skipping fill bytes
+    // and anything left over after entropy coded data. Returns -1 at the end.
+    int nextMarker()
+    {
+        while (mPosition + 1 < mSize)
+        {
+            if (mData[mPosition] == 0xFF and mData[mPosition + 1] != 0 and mData[mPosition + 1] != 0xFF)
+            {
+                mPosition += 2;
+                return mData[mPosition - 1];
+            }
+            ++mPosition;
+        }
+        return -1;
+    }
+
+    bool readQuantTables(SegmentReader& segment)
+    {
+        while (segment.ok() and not segment.atEnd())
+        {
+            const std::uint8_t spec = segment.byte();
+            const int precision = spec >> 4, id = spec & 15;
+            if (precision > 1 or id > 3)
+                return false;
+            for (int k = 0; k < 64; ++k)
+                mFile.quantTables[id][kJpegNaturalOrder[k]] = precision == 0 ? segment.byte() : segment.word();
+            mFile.hasQuantTable[id] = true;
+        }
+        return segment.ok();
+    }
+
+    bool readHuffmanTables(SegmentReader& segment)
+    {
+        while (segment.ok() and not segment.atEnd())
+        {
+            const std::uint8_t spec = segment.byte();
+            const int tableClass = spec >> 4, id = spec & 15;
+            if (tableClass > 1 or id > 3)
+                return false;
+            std::uint8_t counts[16];
+            int total = 0;
+            for (std::uint8_t& count : counts)
+                total += count = segment.byte();
+            if (total > 256)
+                return false;
+            std::array<std::uint8_t, 256> symbols;
+            for (std::uint8_t& symbol : std::span(symbols.data(), total))
+                symbol = segment.byte();
+            if (not segment.ok() or not buildDecoder(counts, symbols.data(), total, mHuffman[tableClass][id]))
+                return false;
+            if (tableClass == 1)
+                buildFastAc(mHuffman[tableClass][id]);
+        }
+        return segment.ok();
+    }
+
+    bool readFrame(SegmentReader& segment, std::uint8_t marker)
+    {
+        if (not mFile.components.empty() or segment.byte() != 8)
+            return false;
+        mFile.progressive = marker == kSof2;
+        mFile.height = segment.word();
+        mFile.width = segment.word();
+        const int count = segment.byte();
+        if (mFile.width == 0 or mFile.height == 0 or count < 1 or count > 4)
+            return false;
+        for (int i = 0; i < count; ++i)
+        {
+            JpegComponent component;
+            component.id = segment.byte();
+            const std::uint8_t sampling = segment.byte();
+            component.horizontalSampling = sampling >> 4;
+            component.verticalSampling = sampling & 15;
+            component.quantTable = segment.byte();
+            if (component.horizontalSampling < 1 or component.horizontalSampling > 4
+                or component.verticalSampling < 1 or component.verticalSampling > 4 or component.quantTable > 3)
+                return false;
+            mFile.components.push_back(component);
+        }
+        return segment.ok() and segment.atEnd();
+    }
+
+    // Checks the frame before the first scan and sizes the coefficients.
+    bool startImage(bool headerOnly)
+    {
+        if (mFile.components.empty())
+            return false;
+        for (JpegComponent& component : mFile.components)
+        {
+            if (not mFile.hasQuantTable[component.quantTable])
+                return false;
+            component.blocksWide = mFile.mcusWide() * component.horizontalSampling;
+            component.blocksHigh = mFile.mcusHigh() * component.verticalSampling;
+            if (not headerOnly)
+                component.coefficients.assign(component.blocksWide * component.blocksHigh * 64, 0);
+        }
+        return true;
+    }
+
+    bool readScan(SegmentReader& segment)
+    {
+        const int count = segment.byte();
+        if (count < 1 or count > static_cast<int>(mFile.components.size()))
+            return false;
+        for (int i = 0; i < count; ++i)
+        {
+            const int id = segment.byte();
+            const std::uint8_t tables = segment.byte();
+            const auto found = std::find_if(mFile.components.begin(), mFile.components.end(),
+                                            [&](const JpegComponent& component) { return component.id == id; });
+            if (found == mFile.components.end() or (tables >> 4) > 3 or (tables & 15) > 3)
+                return false;
+            mScan[i] = {&*found, &mHuffman[0][tables >> 4], &mHuffman[1][tables & 15], 0};
+        }
+        mScanCount = count;
+        mSpectralStart = segment.byte();
+        mSpectralEnd = segment.byte();
+        const std::uint8_t approximation = segment.byte();
+        mBitHigh = approximation >> 4;
+        mBitLow = approximation & 15;
+        if (not segment.ok() or not segment.atEnd())
+            return false;
+
+        if (not mFile.progressive)
+        {
+            mSpectralStart = 0;
+            mSpectralEnd = 63;
+            mBitHigh = mBitLow = 0;
+        }
+        else if (mSpectralEnd > 63 or mSpectralStart > mSpectralEnd or (mSpectralStart == 0) != (mSpectralEnd == 0)
+                 or (mSpectralStart > 0 and count != 1) or mBitLow > 13)
+            return false;
+
+        std::size_t blocksBetweenMcus = 0;
+        for (int i = 0; i < count; ++i)
+        {
+            const bool needsDc = mSpectralStart == 0 and mBitHigh == 0;
+            const bool needsAc = mSpectralEnd > 0;
+            if ((needsDc and not mScan[i].dc->defined) or (needsAc and not mScan[i].ac->defined))
+                return false;
+            const JpegComponent& component = *mScan[i].component;
+            blocksBetweenMcus += static_cast<std::size_t>(component.horizontalSampling * component.verticalSampling);
+        }
+        if (count > 1 and blocksBetweenMcus > 10)
+            return false;
+        return decodeScan();
+    }
+
+    bool decodeScan()
+    {
+        mBits = 0;
+        mBitCount = 0;
+        mAtMarker = false;
+        mEobRun = 0;
+
+        // A single component scan codes that component's own blocks, one at
+        // a time; an interleaved one codes whole MCUs.
+        std::size_t unitsWide = mFile.mcusWide(), unitsHigh = mFile.mcusHigh();
+        if (mScanCount == 1)
+        {
+            const JpegComponent& component = *mScan[0].component;
+            const std::size_t width = (mFile.width * component.horizontalSampling + mFile.maxHorizontalSampling() - 1)
+                                      / mFile.maxHorizontalSampling();
+            const std::size_t height = (mFile.height * component.verticalSampling + mFile.maxVerticalSampling() - 1)
+                                       / mFile.maxVerticalSampling();
+            unitsWide = (width + 7) / 8;
+            unitsHigh = (height + 7) / 8;
+        }
+
+        std::size_t sinceRestart = 0;
+        for (std::size_t y = 0; y < unitsHigh; ++y)
+        {
+            for (std::size_t x = 0; x < unitsWide; ++x)
+            {
+                if (mRestartInterval > 0 and sinceRestart == mRestartInterval)
+                {
+                    restart();
+                    sinceRestart = 0;
+                }
+                ++sinceRestart;
+
+                for (int i = 0; i < mScanCount; ++i)
+                {
+                    ScanComponent& scan = mScan[i];
+                    JpegComponent& component = *scan.component;
+                    const int wide = mScanCount == 1 ? 1 : component.horizontalSampling;
+                    const int high = mScanCount == 1 ? 1 : component.verticalSampling;
+                    for (int v = 0; v < high; ++v)
+                    {
+                        for (int h = 0; h < wide; ++h)
+                        {
+                            const std::size_t index = (y * high + v) * component.blocksWide + x * wide + h;
+                            if (not decodeBlock(scan, component.coefficients.data() + index * 64))
+                                return false;
+                        }
+                    }
+                }
+            }
+        }
+        return true;
+    }
+
+    // Skips to the restart marker ending the interval just decoded; the
+    // bits left before it are padding.
+    void restart()
+    {
+        mBits = 0;
+        mBitCount = 0;
+        mAtMarker = false;
+        mEobRun = 0;
+        for (ScanComponent& scan : mScan)
+            scan.dcPrediction = 0;
+        for (std::size_t position = mPosition; position + 1 < mSize; ++position)
+        {
+            if (mData[position] == 0xFF and mData[position + 1] != 0 and mData[position + 1] != 0xFF)
+            {
+                // A marker other than RSTn ends the scan; leave it for later.
+                mPosition = isRestart(mData[position + 1]) ? position + 2 : position;
+                return;
+            }
+        }
+    }
+
+    bool decodeBlock(ScanComponent& scan, std::int16_t* block)
+    {
+        if (not mFile.progressive)
+            return decodeSequential(scan, block);
+        if (mSpectralStart == 0)
+        {
+            if (mBitHigh == 0)
+            {
+                const int delta = decodeValue(*scan.dc);
+                if (delta == kInvalid)
+                    return false;
+                scan.dcPrediction += delta;
+                block[0] = static_cast<std::int16_t>(scan.dcPrediction * (1 << mBitLow));
+            }
+            else if (bits(1) != 0)
+                block[0] = static_cast<std::int16_t>(block[0] | 1 << mBitLow);
+            return true;
+        }
+        return mBitHigh == 0 ? decodeAcFirst(scan, block) : decodeAcRefine(scan, block);
+    }
+
+    bool decodeSequential(ScanComponent& scan, std::int16_t* block)
+    {
+        const int delta = decodeValue(*scan.dc);
+        if (delta == kInvalid)
+            return false;
+        scan.dcPrediction += delta;
+        block[0] = static_cast<std::int16_t>(scan.dcPrediction);
+        for (int k = 1; k < 64; ++k)
+        {
+            if (mBitCount < 16)
+                fill();
+            const int fast = scan.ac->fastAc[mBits >> (64 - HuffmanDecoder::kFastBits)];
+            if (fast != 0)
+            {
+                k += fast >> 4 & 15;
+                if (k > 63)
+                    return false;
+                mBits <<= fast & 15;
+                mBitCount -= fast & 15;
+                block[k] = static_cast<std::int16_t>(fast >> 8);
+                continue;
+            }
+            const int symbol = decodeSymbol(*scan.ac);
+            if (symbol < 0)
+                return false;
+            const int run = symbol >> 4, length = symbol & 15;
+            if (length == 0)
+            {
+                if (run != 15)
+                    break;
+                k += 15;
+                continue;
+            }
+            k += run;
+            if (k > 63)
+                return false;
+            block[k] = static_cast<std::int16_t>(extend(bits(length), length));
+        }
+        return true;
+    }
+
+    // First scan of an AC band (T.81 G.1.2.2): values and end-of-band runs.
+    bool decodeAcFirst(ScanComponent& scan, std::int16_t* block)
+    {
+        if (mEobRun > 0)
+        {
+            --mEobRun;
+            return true;
+        }
+        for (int k = mSpectralStart; k <= mSpectralEnd; ++k)
+        {
+            const int symbol = decodeSymbol(*scan.ac);
+            if (symbol < 0)
+                return false;
+            const int run = symbol >> 4, length = symbol & 15;
+            if (length == 0)
+            {
+                if (run != 15)
+                {
+                    mEobRun = (1u << run) - 1 + bits(run);
+                    break;
+                }
+                k += 15;
+                continue;
+            }
+            k += run;
+            if (k > 63)
+                return false;
+            block[k] = static_cast<std::int16_t>(extend(bits(length), length) * (1 << mBitLow));
+        }
+        return true;
+    }
+
+    // Refinement scan of an AC band (T.81 G.1.2.3): one more bit for the
+    // coefficients already nonzero, new ones of magnitude 1 among the rest.
+    bool decodeAcRefine(ScanComponent& scan, std::int16_t* block)
+    {
+        const int plus = 1 << mBitLow, minus = -plus;
+        const auto refine = [&](std::int16_t& coefficient)
+        {
+            if (bits(1) != 0 and (coefficient & plus) == 0)
+                coefficient = static_cast<std::int16_t>(coefficient + (coefficient >= 0 ? plus : minus));
+        };
+
+        int k = mSpectralStart;
+        if (mEobRun == 0)
+        {
+            for (; k <= mSpectralEnd; ++k)
+            {
+                const int symbol = decodeSymbol(*scan.ac);
+                if (symbol < 0)
+                    return false;
+                int run = symbol >> 4, value = 0;
+                if ((symbol & 15) != 0)
+                    value = bits(1) != 0 ? plus : minus;
+                else if (run != 15)
+                {
+                    mEobRun = (1u << run) + bits(run);
+                    break;
+                }
+                // Skip `run` zero coefficients, refining the nonzero ones passed.
+                for (; k <= mSpectralEnd; ++k)
+                {
+                    std::int16_t& coefficient = block[k];
+                    if (coefficient != 0)
+                        refine(coefficient);
+                    else if (--run < 0)
+                        break;
+                }
+                if (value != 0)
+                {
+                    if (k > mSpectralEnd)
+                        return false;
+                    block[k] = static_cast<std::int16_t>(value);
+                }
+            }
+        }
+        if (mEobRun > 0)
+        {
+            for (; k <= mSpectralEnd; ++k)
+            {
+                std::int16_t& coefficient = block[k];
+                if (coefficient != 0)
+                    refine(coefficient);
+            }
+            --mEobRun;
+        }
+        return true;
+    }
+
+    // Entropy coded bytes, unstuffed, MSB first. At a marker or the end of
+    // the data the buffer fills up with zeros.
+    void fill()
+    {
+        // Whole bytes at once while there is no 0xFF among the next eight.
+        if (not mAtMarker and mSize - mPosition >= 8)
+        {
+            const std::uint64_t word = loadBigEndian64(mData + mPosition);
+            if (((~word - 0x0101010101010101u) & word & 0x8080808080808080u) == 0)
+            {
+                const int count = (63 - mBitCount) / 8;
+                mBits |= word >> (64 - count * 8) << (64 - mBitCount - count * 8);
+                mBitCount += count * 8;
+                mPosition += count;
+                return;
+            }
+        }
+        while (mBitCount <= 56)
+        {
+            std::uint64_t byte = 0;
+            if (not mAtMarker and mPosition < mSize)
+            {
+                byte = mData[mPosition];
+                if (byte != 0xFF)
+                    ++mPosition;
+                else if (mPosition + 1 < mSize and mData[mPosition + 1] == 0)
+                    mPosition += 2;
+                else
+                {
+                    mAtMarker = true;
+                    byte = 0;
+                }
+            }
+            mBits |= byte << (56 - mBitCount);
+            mBitCount += 8;
+        }
+    }
+
+    int bits(int count)
+    {
+        if (count == 0)
+            return 0;
+        if (mBitCount < count)
+            fill();
+        const int value = static_cast<int>(mBits >> (64 - count));
+        mBits <<= count;
+        mBitCount -= count;
+        return value;
+    }
+
+    int decodeSymbol(const HuffmanDecoder& decoder)
+    {
+        if (mBitCount < 16)
+            fill();
+        const std::uint16_t fast = decoder.fast[mBits >> (64 - HuffmanDecoder::kFastBits)];
+        if (fast != 0)
+        {
+            mBits <<= fast >> 8;
+            mBitCount -= fast >> 8;
+            return fast & 0xFF;
+        }
+        for (int length = HuffmanDecoder::kFastBits + 1; length <= 16; ++length)
+        {
+            const int code = static_cast<int>(mBits >> (64 - length));
+            if (code <= decoder.maxCode[length])
+            {
+                mBits <<= length;
+                mBitCount -= length;
+                return decoder.symbols[code + decoder.offset[length]];
+            }
+        }
+        return -1;
+    }
+
+    // A DC difference: its magnitude category, then that many bits.
+    int decodeValue(const HuffmanDecoder& decoder)
+    {
+        const int length = decodeSymbol(decoder);
+        if (length < 0 or length > 16)
+            return kInvalid;
+        return extend(bits(length), length);
+    }
+
+    const std::uint8_t* mData;
+    std::size_t mSize;
+    std::size_t mPosition = 0;
+    JpegFile& mFile;
+    // [0] DC, [1] AC tables.
+    HuffmanDecoder mHuffman[2][4];
+    std::size_t mRestartInterval = 0;
+
+    ScanComponent mScan[4];
+    int mScanCount = 0;
+    int mSpectralStart = 0;
+    int mSpectralEnd = 63;
+    int mBitHigh = 0;
+    int mBitLow = 0;
+    unsigned mEobRun = 0;
+
+    std::uint64_t mBits = 0;
+    int mBitCount = 0;
+    bool mAtMarker = false;
+};
+
+}
+
+int JpegFile::maxHorizontalSampling() const
+{
+    int sampling = 1;
+    for (const JpegComponent& component : components)
+        sampling = std::max(sampling, component.horizontalSampling);
+    return sampling;
+}
+
+int JpegFile::maxVerticalSampling() const
+{
+    int sampling = 1;
+    for (const JpegComponent& component : components)
+        sampling = std::max(sampling, component.verticalSampling);
+    return sampling;
+}
+
+std::size_t JpegFile::mcusWide() const
+{
+    const std::size_t mcuWidth = 8 * static_cast<std::size_t>(maxHorizontalSampling());
+    return (width + mcuWidth - 1) / mcuWidth;
+}
+
+std::size_t JpegFile::mcusHigh() const
+{
+    const std::size_t mcuHeight = 8 * static_cast<std::size_t>(maxVerticalSampling());
+    return (height + mcuHeight - 1) / mcuHeight;
+}
+
+bool readJpegHeader(const std::uint8_t* data, std::size_t size, JpegFile& file)
+{
+    return JpegReader(data, size, file).read(true);
+}
+
+bool readJpeg(const std::uint8_t* data, std::size_t size, JpegFile& file)
+{
+    return JpegReader(data, size, file).read(false);
+}
+
+}
@@ -0,0 +1,73 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace stb_image_plus::detail
+{
+
+/* Natural (row-major) index of the coefficient at each zigzag position. */
+inline constexpr std::uint8_t kJpegNaturalOrder[64] = {
+    0, 1, 8, 16, 9, 2, 3, 10, 17, 24, 32, 25, 18, 11, 4, 5, 12, 19, 26, 33, 40, 48, 41, 34, 27, 20, 13, 6, 7, 14,
+    21, 28, 35, 42, 49, 56, 57, 50, 43, 36, 29, 22, 15, 23, 30, 37, 44, 51, 58, 59, 52, 45, 38, 31, 39, 46, 53, 60,
+    61, 54, 47, 55, 62, 63};
+
+/* One component of a JPEG frame. */
+struct JpegComponent
+{
+    int id = 0;
+    int horizontalSampling = 1;
+    int verticalSampling = 1;
+    int quantTable = 0;
+    /* Quantized DCT coefficients, filled by readJpeg only: 64 per block in
+     * zigzag order, as they are coded, blocks row by row. The grid covers
+     * whole MCUs, so it may extend past the image; blocksWide and blocksHigh
+     * are its size. */
+    std::size_t blocksWide = 0;
+    std::size_t blocksHigh = 0;
+    std::vector<std::int16_t> coefficients;
+};
+
+/* What a JPEG file declares before its first scan, and with readJpeg its
+ * coefficients too. Quantization tables are kept in natural order. */
+struct JpegFile
+{
+    std::size_t width = 0;
+    std::size_t height = 0;
+    bool progressive = false;
+    std::array<std::array<std::uint16_t, 64>, 4> quantTables{};
+    std::array<bool, 4> hasQuantTable{};
+    std::vector<JpegComponent> components;
+    /* APPn and COM segments, marker and length included, in file order. */
+    std::vector<std::vector<std::uint8_t>> segments;
+    /* EXIF orientation (1..8, 1 without one) and where its value sits in
+     * `segments`, to rewrite it: segment index and byte offset of the
+     * 16-bit value; the index is -1 without one. */
+    int orientation = 1;
+    int orientationSegment = -1;
+    std::size_t orientationOffset = 0;
+    bool orientationBigEndian = false;
+
+    int maxHorizontalSampling() const;
+    int maxVerticalSampling() const;
+    /* The image size in MCUs, rounded up. */
+    std::size_t mcusWide() const;
+    std::size_t mcusHigh() const;
+};
+
+/* Parses the markers of a Huffman-coded JPEG (baseline, extended or
+ * progressive, 8-bit) up to its first scan into `file`. Returns false for
+ * anything else, for truncated or inconsistent headers, and when a
+ * component refers to a quantization table that was never defined. */
+bool readJpegHeader(const std::uint8_t* data, std::size_t size, JpegFile& file);
+
+/* readJpegHeader, then entropy decodes every scan into the components'
+ * coefficients: the file as it would be before the inverse DCT. Returns
+ * false for the same reasons and for corrupt entropy coded data. Scans
+ * that end early, as in truncated files, leave the rest of their
+ * coefficients zero. */
+bool readJpeg(const std::uint8_t* data, std::size_t size, JpegFile& file);
+
+}
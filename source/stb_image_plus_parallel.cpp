@@ -0,0 +1,120 @@
+#include "stb_image_plus_parallel.h"
+#include <algorithm>
+
+namespace stb_image_plus::detail
+{
+
+namespace
+{
+// Set on pool threads so that nested parallelFor calls run inline.
+thread_local bool tInsideWorker = false;
+}
+
+WorkerPool& WorkerPool::instance()
+{
+    static WorkerPool pool;
+    return pool;
+}
+
+WorkerPool::WorkerPool()
+{
+    const unsigned int hardwareThreads = std::max(1u, std::thread::hardware_concurrency());
+    mThreads.reserve(hardwareThreads - 1);
+    for (unsigned int i = 1; i < hardwareThreads; ++i)
+        mThreads.emplace_back([this]() { workerLoop(); });
+}
+
+WorkerPool::~WorkerPool()
+{
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        mStopping = true;
+    }
+    mWakeUp.notify_all();
+    for (std::thread& thread : mThreads)
+        thread.join();
+}
+
+void WorkerPool::workerLoop()
+{
+    tInsideWorker = true;
+    for (;;)
+    {
+        Job* job;
+        {
+            std::unique_lock<std::mutex> lock(mMutex);
+            mWakeUp.wait(lock, [this]() { return mStopping or mHead != nullptr; });
+            if (mHead == nullptr)
+                return;
+            job = mHead;
+            job->running++;
+            if (--job->unclaimed == 0)
+                unlink(*job);
+        }
+        drain(*job);
+        {
+            std::lock_guard<std::mutex> lock(mMutex);
+            job->running--;
+        }
+        // Several callers may be waiting, each for its own job.
+        mJobDone.notify_all();
+    }
+}
+
+void WorkerPool::drain(Job& job)
+{
+    for (std::size_t index = job.nextIndex++; index < job.count; index = job.nextIndex++)
+        job.task(index);
+}
+
+// Removes `job` from the queue, if still there. Called under mMutex.
+void WorkerPool::unlink(Job& job)
+{
+    Job* previous = nullptr;
+    for (Job* queued = mHead; queued != nullptr; previous = queued, queued = queued->next)
+    {
+        if (queued != &job)
+            continue;
+        (previous != nullptr ? previous->next : mHead) = job.next;
+        if (mTail == &job)
+            mTail = previous;
+        job.next = nullptr;
+        return;
+    }
+}
+
+void WorkerPool::parallelFor(std::size_t count, FunctionRef<void(std::size_t)> task)
+{
+    if (count == 0)
+        return;
+
+    const std::size_t helpers = std::min(count, concurrency()) - 1;
+    if (helpers == 0 or tInsideWorker)
+    {
+        for (std::size_t index = 0; index < count; ++index)
+            task(index);
+        return;
+    }
+
+    // Indices are handed out through a shared counter so that uneven task
+    // costs balance themselves. Once the caller finds none left, helpers
+    // that haven't started are taken off the job, and the caller waits only
+    // for those inside it.
+    Job job{task, count};
+    job.unclaimed = helpers;
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        (mTail != nullptr ? mTail->next : mHead) = &job;
+        mTail = &job;
+    }
+    mWakeUp.notify_all();
+
+    drain(job);
+
+    std::unique_lock<std::mutex> lock(mMutex);
+    if (job.unclaimed != 0)
+        unlink(job);
+    mJobDone.wait(lock, [&]() { return job.running == 0; });
+}
+
+}
@@ -0,0 +1,95 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace stb_image_plus::detail
+{
+
+/* Non-owning reference to a callable, valid as long as the callable is:
+ * unlike std::function it never allocates, which keeps hot parallelFor
+ * calls allocation-free. */
+template <typename Signature>
+class FunctionRef;
+
+template <typename Result, typename... Args>
+class FunctionRef<Result(Args...)>
+{
+public:
+    template <typename Callable>
+        requires (not std::is_same_v<std::remove_cvref_t<Callable>, FunctionRef>)
+    FunctionRef(Callable&& callable)
+        : mCallable(const_cast<void*>(static_cast<const void*>(std::addressof(callable))))
+        , mCall([](void* target, Args... args) -> Result
+          {
+              return (*static_cast<std::remove_reference_t<Callable>*>(target))(std::forward<Args>(args)...);
+          })
+    {
+    }
+
+    Result operator()(Args... args) const { return mCall(mCallable, std::forward<Args>(args)...); }
+
+private:
+    void* mCallable;
+    Result (*mCall)(void*, Args...);
+};
+
+/* Process-wide pool of worker threads shared by the parallel resizers and
+ * encoders. The calling thread always takes part in the work, so a pool of
+ * N workers runs up to N+1 tasks at a time.
+ *
+ * parallelFor calls issued from inside a pool task run inline on the
+ * calling thread; this keeps nested parallel sections (e.g. a parallel
+ * resize started from a parallel per-frame loop) from deadlocking. */
+class WorkerPool
+{
+public:
+    static WorkerPool& instance();
+
+    /* Maximum number of tasks that can run at the same time, caller included. */
+    std::size_t concurrency() const { return mThreads.size() + 1; }
+
+    /* Runs task(0) .. task(count - 1), spread across the pool, and returns
+     * once every index has been processed. Allocates nothing: the job lives
+     * on the caller's stack until every helper is done with it. */
+    void parallelFor(std::size_t count, FunctionRef<void(std::size_t)> task);
+
+    WorkerPool(const WorkerPool&) = delete;
+    WorkerPool& operator=(const WorkerPool&) = delete;
+    ~WorkerPool();
+
+private:
+    /* One parallelFor call, queued until all the helpers it asked for have
+     * picked it up or its caller has run out of indices. */
+    struct Job
+    {
+        FunctionRef<void(std::size_t)> task;
+        std::size_t count = 0;
+        std::atomic<std::size_t> nextIndex{0};
+        std::size_t unclaimed = 0; // helper slots left, under mMutex
+        std::size_t running = 0;   // helpers inside drain, under mMutex
+        Job* next = nullptr;
+    };
+
+    WorkerPool();
+    void workerLoop();
+    static void drain(Job& job);
+    void unlink(Job& job);
+
+    std::vector<std::thread> mThreads;
+    Job* mHead = nullptr;
+    Job* mTail = nullptr;
+    std::mutex mMutex;
+    std::condition_variable mWakeUp;
+    std::condition_variable mJobDone;
+    bool mStopping = false;
+};
+
+}
@@ -0,0 +1,437 @@
+#include "stb_image_plus_png.h"
+#include "stb_image_plus_deflate.h"
+#include "stb_image_plus_parallel.h"
+#include "stb_image_plus_simd.h"
+#include <algorithm>
+#include <array>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+namespace stb_image_plus::detail
+{
+
+namespace
+{
+
+// Uncompressed bytes per band. Large enough that the 32 KiB dictionary and
+// the sync flush are noise, small enough to keep every worker busy.
+constexpr std::size_t kTargetBandBytes = 256 * 1024;
+constexpr int kFilterCount = 5;
+// Rows scored per band by PngProfile::BandFilter.
+constexpr std::size_t kBandSampleRows = 8;
+
+std::uint8_t paeth(int a, int b, int c)
+{
+    const int p = a + b - c, pa = std::abs(p - a), pb = std::abs(p - b), pc = std::abs(p - c);
+    if (pa <= pb && pa <= pc)
+        return static_cast<std::uint8_t>(a);
+    if (pb <= pc)
+        return static_cast<std::uint8_t>(b);
+    return static_cast<std::uint8_t>(c);
+}
+
+#ifdef STB_IMAGE_PLUS_SSE2
+// Filter residuals for 16 bytes at once. `x` is the current byte, `a` the
+// one to its left, `b` the one above and `c` above-left.
+__m128i floorAverage(__m128i a, __m128i b)
+{
+    // _mm_avg_epu8 rounds up; take the carry back off where a + b is odd.
+    const __m128i odd = _mm_and_si128(_mm_xor_si128(a, b), _mm_set1_epi8(1));
+    return _mm_sub_epi8(_mm_avg_epu8(a, b), odd);
+}
+
+__m128i paethHalf(__m128i a, __m128i b, __m128i c)
+{
+    // 16 bit lanes: pa = |b - c|, pb = |a - c|, pc = |a + b - 2c|.
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i bc = _mm_sub_epi16(b, c), ac = _mm_sub_epi16(a, c);
+    const __m128i abc = _mm_add_epi16(bc, ac);
+    const __m128i pa = _mm_max_epi16(bc, _mm_sub_epi16(zero, bc));
+    const __m128i pb = _mm_max_epi16(ac, _mm_sub_epi16(zero, ac));
+    const __m128i pc = _mm_max_epi16(abc, _mm_sub_epi16(zero, abc));
+    const __m128i notA = _mm_or_si128(_mm_cmpgt_epi16(pa, pb), _mm_cmpgt_epi16(pa, pc));
+    const __m128i notB = _mm_cmpgt_epi16(pb, pc);
+    const __m128i bOrC = _mm_or_si128(_mm_andnot_si128(notB, b), _mm_and_si128(notB, c));
+    return _mm_or_si128(_mm_andnot_si128(notA, a), _mm_and_si128(notA, bOrC));
+}
+
+__m128i paethPredictor(__m128i a, __m128i b, __m128i c)
+{
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i low = paethHalf(_mm_unpacklo_epi8(a, zero), _mm_unpacklo_epi8(b, zero),
+                                  _mm_unpacklo_epi8(c, zero));
+    const __m128i high = paethHalf(_mm_unpackhi_epi8(a, zero), _mm_unpackhi_epi8(b, zero),
+                                   _mm_unpackhi_epi8(c, zero));
+    return _mm_packus_epi16(low, high);
+}
+
+__m128i load(const std::uint8_t* bytes)
+{
+    return _mm_loadu_si128(reinterpret_cast<const __m128i*>(bytes));
+}
+
+// Sum of |residual| with the residual read as a signed byte, added to the
+// two 64 bit lanes of `sum`. min(r, -r) as unsigned bytes is that magnitude.
+__m128i accumulateScore(__m128i sum, __m128i residual)
+{
+    const __m128i magnitude = _mm_min_epu8(residual, _mm_sub_epi8(_mm_setzero_si128(), residual));
+    return _mm_add_epi64(sum, _mm_sad_epu8(magnitude, _mm_setzero_si128()));
+}
+#endif
+
+// Applies PNG filter `type` to `row`. `prior` is the previous scanline,
+// all zeros for the first one. The first `bpp` bytes have no left
+// neighbour, so they are always done by the scalar loop.
+void filterRow(int type, const std::uint8_t* row, const std::uint8_t* prior,
+               std::size_t rowBytes, std::size_t bpp, std::uint8_t* out)
+{
+    if (type == 0)
+    {
+        std::memcpy(out, row, rowBytes);
+        return;
+    }
+    if (type == 2)
+        bpp = 0;
+    std::size_t i = 0;
+    for (; i < std::min(bpp, rowBytes); ++i)
+        out[i] = static_cast<std::uint8_t>(row[i] - (type == 1 ? 0 : type == 3 ? prior[i] >> 1 : prior[i]));
+#ifdef STB_IMAGE_PLUS_SSE2
+    for (; i + 16 <= rowBytes; i += 16)
+    {
+        const __m128i x = load(row + i);
+        __m128i predictor;
+        switch (type)
+        {
+            case 1: predictor = load(row + i - bpp); break;
+            case 2: predictor = load(prior + i); break;
+            case 3: predictor = floorAverage(load(row + i - bpp), load(prior + i)); break;
+            default: predictor = paethPredictor(load(row + i - bpp), load(prior + i), load(prior + i - bpp)); break;
+        }
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(out + i), _mm_sub_epi8(x, predictor));
+    }
+#endif
+    for (; i < rowBytes; ++i)
+    {
+        const int a = row[i - bpp], b = prior[i];
+        switch (type)
+        {
+            case 1: out[i] = static_cast<std::uint8_t>(row[i] - a); break;
+            case 2: out[i] = static_cast<std::uint8_t>(row[i] - b); break;
+            case 3: out[i] = static_cast<std::uint8_t>(row[i] - ((a + b) >> 1)); break;
+            default: out[i] = static_cast<std::uint8_t>(row[i] - paeth(a, b, prior[i - bpp])); break;
+        }
+    }
+}
+
+// Adds each filter's score for `row` to `scores`: the sum of absolute
+// (signed) residuals, the same heuristic as stbi_write_png_to_mem. All five
+// filters are scored in a single pass without writing anything out.
+void scoreFilters(const std::uint8_t* row, const std::uint8_t* prior, std::size_t rowBytes,
+                  std::size_t bpp, std::array<long, kFilterCount>& scores)
+{
+    auto add = [&](int type, int residual)
+    {
+        scores[type] += std::abs(static_cast<int>(static_cast<signed char>(residual)));
+    };
+    std::size_t i = 0;
+    for (; i < std::min(bpp, rowBytes); ++i)
+    {
+        add(0, row[i]);
+        add(1, row[i]);
+        add(2, row[i] - prior[i]);
+        add(3, row[i] - (prior[i] >> 1));
+        add(4, row[i] - prior[i]);
+    }
+#ifdef STB_IMAGE_PLUS_SSE2
+    __m128i sums[kFilterCount];
+    for (__m128i& sum : sums)
+        sum = _mm_setzero_si128();
+    for (; i + 16 <= rowBytes; i += 16)
+    {
+        const __m128i x = load(row + i), a = load(row + i - bpp);
+        const __m128i b = load(prior + i), c = load(prior + i - bpp);
+        sums[0] = accumulateScore(sums[0], x);
+        sums[1] = accumulateScore(sums[1], _mm_sub_epi8(x, a));
+        sums[2] = accumulateScore(sums[2], _mm_sub_epi8(x, b));
+        sums[3] = accumulateScore(sums[3], _mm_sub_epi8(x, floorAverage(a, b)));
+        sums[4] = accumulateScore(sums[4], _mm_sub_epi8(x, paethPredictor(a, b, c)));
+    }
+    for (int type = 0; type < kFilterCount; ++type)
+    {
+        alignas(16) std::uint64_t lanes[2];
+        _mm_store_si128(reinterpret_cast<__m128i*>(lanes), sums[type]);
+        scores[type] += static_cast<long>(lanes[0] + lanes[1]);
+    }
+#endif
+    for (; i < rowBytes; ++i)
+    {
+        const int a = row[i - bpp], b = prior[i];
+        add(0, row[i]);
+        add(1, row[i] - a);
+        add(2, row[i] - b);
+        add(3, row[i] - ((a + b) >> 1));
+        add(4, row[i] - paeth(a, b, prior[i - bpp]));
+    }
+}
+
+int bestFilter(const std::array<long, kFilterCount>& scores)
+{
+    return static_cast<int>(std::min_element(scores.begin(), scores.end()) - scores.begin());
+}
+
+void put32(std::vector<std::uint8_t>& out, std::uint32_t value)
+{
+    out.push_back(static_cast<std::uint8_t>(value >> 24));
+    out.push_back(static_cast<std::uint8_t>(value >> 16));
+    out.push_back(static_cast<std::uint8_t>(value >> 8));
+    out.push_back(static_cast<std::uint8_t>(value));
+}
+
+// Wraps `data` as a PNG chunk: length, tag, data, crc32(tag + data).
+void putChunk(std::vector<std::uint8_t>& out, const char* tag, const std::uint8_t* data, std::size_t size)
+{
+    put32(out, static_cast<std::uint32_t>(size));
+    const std::size_t tagOffset = out.size();
+    out.insert(out.end(), tag, tag + 4);
+    out.insert(out.end(), data, data + size);
+    put32(out, crc32(0, out.data() + tagOffset, size + 4));
+}
+
+// Filters and deflates a window of bands at a time, on the worker pool.
+class PngEncoder final : public RowEncoder
+{
+public:
+    PngEncoder(stbi_write_func* func, void* context, std::size_t width, std::size_t height,
+               std::size_t channels, const EncodeOptions& options) :
+        mFunc(func),
+        mContext(context),
+        mHeight(height),
+        mChannels(channels),
+        mRowBytes(width * channels),
+        mFast(options.pngProfile == PngProfile::Fast),
+        mPerBand(options.pngProfile == PngProfile::BandFilter),
+        mLevel(mFast ? 1 : options.pngLevel),
+        mForcedFilter(options.pngFilter >= 0 and options.pngFilter < kFilterCount ? options.pngFilter : -1),
+        mStrategy(mFast ? DeflateStrategy::Rle : DeflateStrategy::Default),
+        mRowsPerBand(std::max<std::size_t>(1, kTargetBandBytes / (mRowBytes + 1))),
+        mWindowRows(mRowsPerBand * WorkerPool::instance().concurrency()),
+        mZeroRow(mRowBytes, 0),
+        mBands(std::min(WorkerPool::instance().concurrency(), (height + mRowsPerBand - 1) / mRowsPerBand))
+    {
+        // Signature and header
+        static const int colorType[] = {-1, 0, 4, 2, 6};
+        const std::uint8_t signature[] = {137, 80, 78, 71, 13, 10, 26, 10};
+        std::vector<std::uint8_t> header(signature, signature + 8);
+        std::vector<std::uint8_t> ihdr;
+        put32(ihdr, static_cast<std::uint32_t>(width));
+        put32(ihdr, static_cast<std::uint32_t>(height));
+        ihdr.insert(ihdr.end(), {8, static_cast<std::uint8_t>(colorType[channels]), 0, 0, 0});
+        putChunk(header, "IHDR", ihdr.data(), ihdr.size());
+        emit(header);
+    }
+
+    bool pushRows(const std::uint8_t* rows, std::size_t count) override
+    {
+        if (count > mHeight - rowsPushed())
+            return false;
+        mPending.reserve(std::min(mWindowRows, mHeight) * mRowBytes);
+        while (count > 0)
+        {
+            const std::size_t take = std::min(count, mWindowRows - mPending.size() / mRowBytes);
+            mPending.insert(mPending.end(), rows, rows + take * mRowBytes);
+            rows += take * mRowBytes;
+            count -= take;
+            if (mPending.size() < mWindowRows * mRowBytes and rowsPushed() < mHeight)
+                break;
+
+            // Rows before the staged ones are only ever needed as the prior
+            // row of the first staged one.
+            const std::size_t firstStaged = mNextRow;
+            encodeWindow([&](std::size_t y)
+            {
+                return y < firstStaged ? mPriorRow.data() : mPending.data() + (y - firstStaged) * mRowBytes;
+            }, mPending.size() / mRowBytes);
+            mPriorRow.assign(mPending.end() - static_cast<std::ptrdiff_t>(mRowBytes), mPending.end());
+            mPending.clear();
+        }
+        return true;
+    }
+
+    std::size_t rowsPushed() const override
+    {
+        return mNextRow + mPending.size() / mRowBytes;
+    }
+
+    // Encodes the whole image straight from `pixels`, without staging.
+    void encode(const std::uint8_t* pixels, bool flip)
+    {
+        const auto rowAt = [&](std::size_t y)
+        {
+            return pixels + (flip ? mHeight - 1 - y : y) * mRowBytes;
+        };
+        while (mNextRow < mHeight)
+            encodeWindow(rowAt, std::min(mWindowRows, mHeight - mNextRow));
+    }
+
+private:
+    struct Band
+    {
+        std::size_t firstRow = 0;
+        std::size_t rows = 0;
+        std::vector<std::uint8_t> filtered;
+        std::vector<std::uint8_t> dictionary;
+        std::vector<std::uint8_t> chunk;
+        std::uint32_t adler = 1;
+    };
+
+    void emit(std::vector<std::uint8_t>& bytes)
+    {
+        mFunc(mContext, bytes.data(), static_cast<int>(bytes.size()));
+        bytes.clear();
+    }
+
+    // Encodes the next `rowCount` rows, a multiple of the band height unless
+    // they end the image. `rowAt(y)` returns row y, for those rows and the
+    // one before them.
+    template <typename RowAt>
+    void encodeWindow(const RowAt& rowAt, std::size_t rowCount)
+    {
+        WorkerPool& pool = WorkerPool::instance();
+        const std::size_t firstRow = mNextRow;
+        const std::size_t count = (rowCount + mRowsPerBand - 1) / mRowsPerBand;
+        const bool lastWindow = firstRow + rowCount == mHeight;
+
+        pool.parallelFor(count, [&](std::size_t i)
+        {
+            Band& band = mBands[i];
+            band.firstRow = firstRow + i * mRowsPerBand;
+            band.rows = std::min(mRowsPerBand, firstRow + rowCount - band.firstRow);
+            band.filtered.resize(band.rows * (mRowBytes + 1));
+            auto priorOf = [&](std::size_t y)
+            {
+                return y > 0 ? rowAt(y - 1) : mZeroRow.data();
+            };
+
+            // Per band selection scores a sample of the band's rows and
+            // applies the winner to all of them.
+            int bandFilter = mForcedFilter;
+            if (bandFilter < 0 and mPerBand)
+            {
+                std::array<long, kFilterCount> scores{};
+                const std::size_t step = std::max<std::size_t>(1, band.rows / kBandSampleRows);
+                for (std::size_t r = 0; r < band.rows; r += step)
+                {
+                    const std::size_t y = band.firstRow + r;
+                    scoreFilters(rowAt(y), priorOf(y), mRowBytes, mChannels, scores);
+                }
+                bandFilter = bestFilter(scores);
+            }
+
+            for (std::size_t r = 0; r < band.rows; ++r)
+            {
+                const std::size_t y = band.firstRow + r;
+                const std::uint8_t* row = rowAt(y);
+                std::uint8_t* out = band.filtered.data() + r * (mRowBytes + 1);
+                int filter = bandFilter;
+                if (mFast)
+                {
+                    // Sub on the first row (Up would be a no-op), Up after.
+                    filter = y > 0 ? 2 : 1;
+                }
+                else if (filter < 0)
+                {
+                    std::array<long, kFilterCount> scores{};
+                    scoreFilters(row, priorOf(y), mRowBytes, mChannels, scores);
+                    filter = bestFilter(scores);
+                }
+                out[0] = static_cast<std::uint8_t>(filter);
+                filterRow(filter, row, priorOf(y), mRowBytes, mChannels, out + 1);
+            }
+            band.adler = adler32(1, band.filtered.data(), band.filtered.size());
+        });
+
+        // Dictionaries chain each band to the tail of the one before it.
+        for (std::size_t i = 0; i < count; ++i)
+        {
+            Band& band = mBands[i];
+            band.dictionary = mHistory;
+            mHistory.insert(mHistory.end(), band.filtered.begin(), band.filtered.end());
+            if (mHistory.size() > kDeflateWindow)
+                mHistory.erase(mHistory.begin(), mHistory.end() - kDeflateWindow);
+            mAdler = adler32Combine(mAdler, band.adler, band.filtered.size());
+        }
+
+        pool.parallelFor(count, [&](std::size_t i)
+        {
+            Band& band = mBands[i];
+            const bool firstOfStream = band.firstRow == 0;
+            const bool lastOfStream = lastWindow and i + 1 == count;
+
+            std::vector<std::uint8_t> zlib;
+            if (firstOfStream)
+                putZlibHeader(mLevel, zlib);
+            deflate(band.dictionary, band.filtered, mLevel, lastOfStream, zlib, mStrategy);
+            if (lastOfStream)
+                put32(zlib, mAdler);
+
+            band.chunk.clear();
+            putChunk(band.chunk, "IDAT", zlib.data(), zlib.size());
+        });
+
+        for (std::size_t i = 0; i < count; ++i)
+            emit(mBands[i].chunk);
+        mNextRow += rowCount;
+
+        if (lastWindow)
+        {
+            std::vector<std::uint8_t> trailer;
+            putChunk(trailer, "IEND", nullptr, 0);
+            emit(trailer);
+        }
+    }
+
+    stbi_write_func* mFunc;
+    void* mContext;
+    std::size_t mHeight, mChannels, mRowBytes;
+    bool mFast, mPerBand;
+    int mLevel, mForcedFilter;
+    DeflateStrategy mStrategy;
+    std::size_t mRowsPerBand, mWindowRows;
+    std::vector<std::uint8_t> mZeroRow;
+    std::vector<Band> mBands;
+    std::vector<std::uint8_t> mHistory; // last 32 KiB of the filtered stream
+    std::uint32_t mAdler = 1;
+    std::size_t mNextRow = 0;           // rows encoded so far
+    std::vector<std::uint8_t> mPending; // rows pushed but not yet encoded
+    std::vector<std::uint8_t> mPriorRow;
+};
+
+bool validGeometry(std::size_t width, std::size_t height, std::size_t channels)
+{
+    return width > 0 and height > 0 and width <= 0x7FFFFFFF and height <= 0x7FFFFFFF
+       and channels >= 1 and channels <= 4;
+}
+
+}
+
+bool writePng(stbi_write_func* func, void* context, const std::uint8_t* pixels,
+              std::size_t width, std::size_t height, std::size_t channels,
+              const EncodeOptions& options)
+{
+    if (pixels == nullptr or not validGeometry(width, height, channels))
+        return false;
+    PngEncoder(func, context, width, height, channels, options).encode(pixels, options.flipVertically);
+    return true;
+}
+
+std::unique_ptr<RowEncoder> makePngRowEncoder(stbi_write_func* func, void* context,
+                                              std::size_t width, std::size_t height, std::size_t channels,
+                                              const EncodeOptions& options)
+{
+    if (not validGeometry(width, height, channels))
+        return nullptr;
+    return std::make_unique<PngEncoder>(func, context, width, height, channels, options);
+}
+
+}
@@ -0,0 +1,36 @@
+#pragma once
+
+#include <stb_image_plus.h>
+#include "stb_image_plus_row_encoder.h"
+#include <stb_image_write.h>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+
+namespace stb_image_plus::detail
+{
+
+/* PNG encoder behind ImageData::write, pigz style: the rows are cut into
+ * bands that are filtered and deflated on the worker pool, each band as its
+ * own sync-flushed deflate piece primed with the previous 32 KiB of the
+ * stream, and emitted as one IDAT chunk per band. Bands are processed a
+ * pool-sized window at a time and streamed to `func`, so only that window
+ * is held in memory. The zlib adler32 is stitched from per-band sums.
+ *
+ * Profile, compression level, filter and flipping come from `options`;
+ * PngProfile::Fast ignores the level and filter, and PngProfile::BandFilter
+ * only applies when no filter is forced. `pixels` holds `channels` (1..4)
+ * interleaved bytes per pixel, rows packed. */
+bool writePng(stbi_write_func* func, void* context, const std::uint8_t* pixels,
+              std::size_t width, std::size_t height, std::size_t channels,
+              const EncodeOptions& options);
+
+/* The same encoder fed row by row, for StreamEncoder: the rows pushed are
+ * staged until they fill a window of bands. Produces the same file as
+ * writePng given the same rows; `options.flipVertically` is ignored.
+ * Returns null for unsupported dimensions. */
+std::unique_ptr<RowEncoder> makePngRowEncoder(stbi_write_func* func, void* context,
+                                              std::size_t width, std::size_t height, std::size_t channels,
+                                              const EncodeOptions& options);
+
+}
@@ -0,0 +1,374 @@
+#include <stb_image_plus_pyramid.h>
+#include "stb_image_plus_resize.h"
+#include "stb_image_plus_simd.h"
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include <utility>
+
+namespace stb_image_plus
+{
+
+namespace
+{
+
+// Samples are widened to 16 bits before summing four of them. sRGB colours
+// become linear light in 14 bits, [0, kLinearOne]; other channels are
+// shifted up by 6 bits. Either way the sum of four fits in 16 bits.
+constexpr int kLinearOne = 16383;
+constexpr int kPlainShift = 6;
+
+struct SrgbTables
+{
+    std::array<std::uint16_t, 256> toLinear;
+    std::array<std::uint8_t, kLinearOne + 1> fromLinear;
+};
+
+const SrgbTables& srgbTables()
+{
+    static const SrgbTables tables = []
+    {
+        SrgbTables t;
+        for (int i = 0; i < 256; ++i)
+        {
+            const double c = i / 255.0;
+            const double linear = c <= 0.04045 ? c / 12.92 : std::pow((c + 0.055) / 1.055, 2.4);
+            t.toLinear[i] = static_cast<std::uint16_t>(std::lround(linear * kLinearOne));
+        }
+        for (int i = 0; i <= kLinearOne; ++i)
+        {
+            const double linear = static_cast<double>(i) / kLinearOne;
+            const double c = linear <= 0.0031308 ? linear * 12.92 : 1.055 * std::pow(linear, 1.0 / 2.4) - 0.055;
+            t.fromLinear[i] = static_cast<std::uint8_t>(std::lround(std::clamp(c, 0.0, 1.0) * 255.0));
+        }
+        return t;
+    }();
+    return tables;
+}
+
+// Channels 2 and 4 carry alpha last; it is never sRGB.
+template <std::size_t Channels>
+constexpr bool isColour(std::size_t channel)
+{
+    return not ((Channels == 2 or Channels == 4) and channel == Channels - 1);
+}
+
+#ifdef STB_IMAGE_PLUS_SSE2
+// Replaces the colour lanes of `v`, eight samples from a multiple of 8, with
+// lookup(lane). SSE2 has no gather, so table lookups go in lane by lane.
+template <std::size_t Channels, typename Lookup, std::size_t... Lanes>
+__m128i insertColours(__m128i v, const Lookup& lookup, std::index_sequence<Lanes...>)
+{
+    ((v = isColour<Channels>(Lanes % Channels) ? _mm_insert_epi16(v, lookup(Lanes), Lanes) : v), ...);
+    return v;
+}
+#endif
+
+// Sums the `count` vertically adjacent samples of two parent rows, widened
+// to 16 bits.
+template <std::size_t Channels>
+void sumRows(const std::uint8_t* top, const std::uint8_t* bottom, std::size_t count, bool srgb,
+             std::uint16_t* out)
+{
+    const std::array<std::uint16_t, 256>& toLinear = srgbTables().toLinear;
+    const auto sum = [&](std::size_t i, std::size_t c)
+    {
+        return static_cast<std::uint16_t>(srgb and isColour<Channels>(c) ? toLinear[top[i]] + toLinear[bottom[i]]
+                                                                         : (top[i] + bottom[i]) << kPlainShift);
+    };
+    std::size_t i = 0;
+#ifdef STB_IMAGE_PLUS_SSE2
+    const __m128i zero = _mm_setzero_si128();
+    for (; i + 16 <= count; i += 16)
+    {
+        const __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(top + i));
+        const __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(bottom + i));
+        const __m128i low = _mm_add_epi16(_mm_unpacklo_epi8(a, zero), _mm_unpacklo_epi8(b, zero));
+        const __m128i high = _mm_add_epi16(_mm_unpackhi_epi8(a, zero), _mm_unpackhi_epi8(b, zero));
+        __m128i sums0 = _mm_slli_epi16(low, kPlainShift), sums1 = _mm_slli_epi16(high, kPlainShift);
+        if (srgb)
+        {
+            // Alpha keeps the plain sums. With 3 channels every lane is a
+            // colour, so the lane to channel mapping only matters for 2
+            // and 4, which divide 8.
+            const std::uint8_t *top0 = top + i, *bottom0 = bottom + i;
+            const std::uint8_t *top1 = top0 + 8, *bottom1 = bottom0 + 8;
+            const auto lanes = std::make_index_sequence<8>();
+            sums0 = insertColours<Channels>(
+                sums0, [&](std::size_t k) { return toLinear[top0[k]] + toLinear[bottom0[k]]; }, lanes);
+            sums1 = insertColours<Channels>(
+                sums1, [&](std::size_t k) { return toLinear[top1[k]] + toLinear[bottom1[k]]; }, lanes);
+        }
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(out + i), sums0);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(out + i + 8), sums1);
+    }
+#endif
+    for (; i < count; ++i)
+        out[i] = sum(i, i % Channels);
+}
+
+#ifdef STB_IMAGE_PLUS_SSE2
+// Sums horizontally adjacent pixels of `v0` then `v1`, 16 samples, into 8.
+template <std::size_t Channels>
+__m128i sumPixelPairs(__m128i v0, __m128i v1)
+{
+    if constexpr (Channels == 1)
+    {
+        // Pairs of 16 bit samples summed in 32 bits, then packed back,
+        // offset by 0x8000 around the signed saturating pack.
+        const __m128i low = _mm_set1_epi32(0xFFFF), bias = _mm_set1_epi32(0x8000);
+        const __m128i sums0 = _mm_add_epi32(_mm_and_si128(v0, low), _mm_srli_epi32(v0, 16));
+        const __m128i sums1 = _mm_add_epi32(_mm_and_si128(v1, low), _mm_srli_epi32(v1, 16));
+        const __m128i packed = _mm_packs_epi32(_mm_sub_epi32(sums0, bias), _mm_sub_epi32(sums1, bias));
+        return _mm_add_epi16(packed, _mm_set1_epi16(static_cast<short>(0x8000)));
+    }
+    else if constexpr (Channels == 2)
+    {
+        const __m128 f0 = _mm_castsi128_ps(v0), f1 = _mm_castsi128_ps(v1);
+        return _mm_add_epi16(_mm_castps_si128(_mm_shuffle_ps(f0, f1, _MM_SHUFFLE(2, 0, 2, 0))),
+                             _mm_castps_si128(_mm_shuffle_ps(f0, f1, _MM_SHUFFLE(3, 1, 3, 1))));
+    }
+    else
+    {
+        return _mm_add_epi16(_mm_unpacklo_epi64(v0, v1), _mm_unpackhi_epi64(v0, v1));
+    }
+}
+#endif
+
+// Completes the 2x2 sums of the `width` output pixels from the vertical
+// sums of their parent row: columns 2x and 2x + step. `step` is 0 for a
+// parent one pixel wide, which then counts twice.
+template <std::size_t Channels>
+void sumColumns(const std::uint16_t* rows, std::size_t width, std::size_t step, std::uint16_t* out)
+{
+    std::size_t x = 0;
+#ifdef STB_IMAGE_PLUS_SSE2
+    if constexpr (Channels == 3)
+    {
+        // Pixels don't line up with lanes. A load from the first sample of a
+        // pair summed with itself shifted by one pixel holds the output in
+        // its first 3 lanes; two of those make 6 samples, and the last 2
+        // lanes stored are rewritten by the next pair.
+        if (step == 1)
+        {
+            const __m128i firstPixel = _mm_setr_epi16(-1, -1, -1, 0, 0, 0, 0, 0);
+            for (; x + 3 <= width; x += 2)
+            {
+                const __m128i v0 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(rows + 6 * x));
+                const __m128i v1 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(rows + 6 * x + 6));
+                const __m128i sums0 = _mm_add_epi16(v0, _mm_srli_si128(v0, 6));
+                const __m128i sums1 = _mm_add_epi16(v1, _mm_srli_si128(v1, 6));
+                _mm_storeu_si128(reinterpret_cast<__m128i*>(out + 3 * x),
+                                 _mm_or_si128(_mm_and_si128(sums0, firstPixel), _mm_slli_si128(sums1, 6)));
+            }
+        }
+    }
+    else
+    {
+        if (step == 1)
+        {
+            const std::size_t count = width * Channels;
+            std::size_t i = 0;
+            for (; i + 8 <= count; i += 8)
+            {
+                const __m128i v0 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(rows + 2 * i));
+                const __m128i v1 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(rows + 2 * i + 8));
+                _mm_storeu_si128(reinterpret_cast<__m128i*>(out + i), sumPixelPairs<Channels>(v0, v1));
+            }
+            x = i / Channels;
+        }
+    }
+#endif
+    for (; x < width; ++x)
+        for (std::size_t c = 0; c < Channels; ++c)
+            out[x * Channels + c] = static_cast<std::uint16_t>(rows[2 * x * Channels + c]
+                                                               + rows[(2 * x + step) * Channels + c]);
+}
+
+// Turns the `count` sums of four samples back into averaged bytes.
+template <std::size_t Channels>
+void averageSums(const std::uint16_t* sums, std::size_t count, bool srgb, std::uint8_t* out)
+{
+    // Rounded to nearest: the plain sums are 4 * 64 = 256 times the average.
+    // sRGB sums are 4 times the linear average.
+    const std::array<std::uint8_t, kLinearOne + 1>& fromLinear = srgbTables().fromLinear;
+    const auto average = [&](std::uint16_t sum, std::size_t c)
+    {
+        return srgb and isColour<Channels>(c) ? fromLinear[(sum + 2) >> 2]
+                                              : static_cast<std::uint8_t>((sum + 128) >> 8);
+    };
+    std::size_t i = 0;
+#ifdef STB_IMAGE_PLUS_SSE2
+    const __m128i half = _mm_set1_epi16(128), two = _mm_set1_epi16(2);
+    for (; i + 16 <= count; i += 16)
+    {
+        const __m128i s0 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(sums + i));
+        const __m128i s1 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(sums + i + 8));
+        __m128i a0 = _mm_srli_epi16(_mm_add_epi16(s0, half), 8);
+        __m128i a1 = _mm_srli_epi16(_mm_add_epi16(s1, half), 8);
+        if (srgb)
+        {
+            alignas(16) std::uint16_t index[16];
+            _mm_store_si128(reinterpret_cast<__m128i*>(index), _mm_srli_epi16(_mm_add_epi16(s0, two), 2));
+            _mm_store_si128(reinterpret_cast<__m128i*>(index + 8), _mm_srli_epi16(_mm_add_epi16(s1, two), 2));
+            const auto lanes = std::make_index_sequence<8>();
+            a0 = insertColours<Channels>(a0, [&](std::size_t k) { return fromLinear[index[k]]; }, lanes);
+            a1 = insertColours<Channels>(a1, [&](std::size_t k) { return fromLinear[index[8 + k]]; }, lanes);
+        }
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(out + i), _mm_packus_epi16(a0, a1));
+    }
+#endif
+    for (; i < count; ++i)
+        out[i] = average(sums[i], i % Channels);
+}
+
+// Averages each 2x2 block of `parent` into a pixel of `child`, half its size
+// rounded down. Odd sides drop their last column or row.
+template <std::size_t Channels>
+void halveLevel(const std::uint8_t* parent, std::size_t parentWidth, std::size_t parentHeight,
+                std::uint8_t* child, std::size_t width, std::size_t height, bool srgb,
+                std::vector<std::uint16_t>& scratch)
+{
+    const std::size_t parentRow = parentWidth * Channels, childRow = width * Channels;
+    scratch.resize(parentRow + childRow);
+    std::uint16_t* rows = scratch.data();
+    std::uint16_t* sums = rows + parentRow;
+    const std::size_t bottomOffset = parentHeight > 1 ? parentRow : 0;
+    for (std::size_t y = 0; y < height; ++y)
+    {
+        const std::uint8_t* top = parent + 2 * y * parentRow;
+        sumRows<Channels>(top, top + bottomOffset, parentRow, srgb, rows);
+        sumColumns<Channels>(rows, width, parentWidth > 1 ? 1 : 0, sums);
+        averageSums<Channels>(sums, childRow, srgb, child + y * childRow);
+    }
+}
+
+// Box-filters `parent` down to `child` with stb_image_resize2, for parents
+// with an odd side. Alpha is filtered like the other channels, as in
+// halveLevel.
+bool resampleLevel(const std::uint8_t* parent, std::size_t parentWidth, std::size_t parentHeight,
+                   std::uint8_t* child, std::size_t width, std::size_t height, std::size_t channels, bool srgb)
+{
+    ResizeOptions options;
+    options.filter = ResizeFilter::Box;
+    options.srgb = srgb;
+    options.alpha = ResizeAlpha::Premultiplied;
+    STBIR_RESIZE resize;
+    return detail::initResize(resize, channels, parent, parentWidth, parentHeight, parentWidth * channels,
+                              child, width, height, width * channels, options)
+        and detail::resizeInParallel(resize, options.threads, options.profile);
+}
+
+bool isOdd(std::size_t side)
+{
+    return side > 1 and side % 2 != 0;
+}
+
+}
+
+template <std::size_t Channels>
+ImageData<Channels> ImageView<Channels>::copy() const
+{
+    if (not isValid())
+        return {};
+    // Allocated with malloc so that the ImageData destructor (stbi_image_free) can release it.
+    auto* pixels = static_cast<Pixel*>(std::malloc(mPixels.size_bytes()));
+    if (pixels == nullptr)
+        return {};
+    std::memcpy(pixels, mPixels.data(), mPixels.size_bytes());
+    return {std::span<Pixel>(pixels, mPixels.size()), mWidth, mHeight};
+}
+
+template <std::size_t Channels>
+ImagePyramid<Channels>::ImagePyramid(const ImageData<Channels>& image, const PyramidOptions& options)
+{
+    if (not image.isValid())
+        return;
+
+    std::vector<Level> levels;
+    std::size_t width = image.width(), height = image.height(), pixelCount = 0;
+    while (true)
+    {
+        levels.push_back({pixelCount, width, height});
+        pixelCount += width * height;
+        if ((width == 1 and height == 1) or levels.size() == options.maxLevels)
+            break;
+        width = std::max<std::size_t>(width / 2, 1);
+        height = std::max<std::size_t>(height / 2, 1);
+    }
+
+    std::unique_ptr<Pixel[]> pixels(new (std::nothrow) Pixel[pixelCount]);
+    if (pixels == nullptr)
+        return;
+    std::memcpy(pixels.get(), image.pixelSpan().data(), image.pixelSpan().size_bytes());
+
+    auto* bytes = reinterpret_cast<std::uint8_t*>(pixels.get());
+    std::vector<std::uint16_t> scratch;
+    for (std::size_t i = 1; i < levels.size(); ++i)
+    {
+        const Level& parent = levels[i - 1];
+        const Level& child = levels[i];
+        const std::uint8_t* parentBytes = bytes + parent.offset * Channels;
+        std::uint8_t* childBytes = bytes + child.offset * Channels;
+        if (options.resampleOddLevels and (isOdd(parent.width) or isOdd(parent.height)))
+        {
+            if (not resampleLevel(parentBytes, parent.width, parent.height, childBytes, child.width,
+                                  child.height, Channels, options.srgb))
+                return;
+        }
+        else
+        {
+            halveLevel<Channels>(parentBytes, parent.width, parent.height, childBytes, child.width,
+                                 child.height, options.srgb, scratch);
+        }
+    }
+
+    mPixels = std::move(pixels);
+    mPixelCount = pixelCount;
+    mLevels = std::move(levels);
+}
+
+template <std::size_t Channels>
+bool ImagePyramid<Channels>::isValid() const
+{
+    return mPixels != nullptr;
+}
+
+template <std::size_t Channels>
+std::size_t ImagePyramid<Channels>::levelCount() const
+{
+    return mLevels.size();
+}
+
+template <std::size_t Channels>
+ImageView<Channels> ImagePyramid<Channels>::level(std::size_t index) const
+{
+    if (index >= mLevels.size())
+        return {};
+    const Level& level = mLevels[index];
+    return {pixelSpan().subspan(level.offset, level.width * level.height), level.width, level.height};
+}
+
+template <std::size_t Channels>
+std::span<const typename ImagePyramid<Channels>::Pixel> ImagePyramid<Channels>::pixelSpan() const
+{
+    return {mPixels.get(), mPixelCount};
+}
+
+// template instantiations
+
+template class ImageView<1>;
+template class ImageView<2>;
+template class ImageView<3>;
+template class ImageView<4>;
+
+template class ImagePyramid<1>;
+template class ImagePyramid<2>;
+template class ImagePyramid<3>;
+template class ImagePyramid<4>;
+
+}
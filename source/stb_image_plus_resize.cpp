@@ -0,0 +1,413 @@
+#include <stb_image_plus_resize_plan.h>
+#include "stb_image_plus_resize.h"
+#include "stb_image_plus_parallel.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <climits>
+#include <cstdlib>
+#include <mutex>
+#include <vector>
+
+namespace stb_image_plus
+{
+
+namespace detail
+{
+
+namespace
+{
+// Output pixels below which another split costs more to set up (its own
+// ring buffers and a pool hand-off) than it saves.
+constexpr std::size_t kMinPixelsPerSplit = 64 * 1024;
+
+stbir_pixel_layout pixelLayout(std::size_t channels, ResizeAlpha alpha)
+{
+    const bool premultiplied = alpha == ResizeAlpha::Premultiplied;
+    switch (channels)
+    {
+        case 1: return STBIR_1CHANNEL;
+        case 2: return premultiplied ? STBIR_RA_PM : STBIR_RA;
+        case 3: return STBIR_RGB;
+    }
+    return premultiplied ? STBIR_RGBA_PM : STBIR_RGBA;
+}
+
+stbir_filter filterFor(ResizeFilter filter)
+{
+    switch (filter)
+    {
+        case ResizeFilter::Default: return STBIR_FILTER_DEFAULT;
+        case ResizeFilter::Point: return STBIR_FILTER_POINT_SAMPLE;
+        case ResizeFilter::Box: return STBIR_FILTER_BOX;
+        case ResizeFilter::Triangle: return STBIR_FILTER_TRIANGLE;
+        case ResizeFilter::CubicBSpline: return STBIR_FILTER_CUBICBSPLINE;
+        case ResizeFilter::CatmullRom: return STBIR_FILTER_CATMULLROM;
+        case ResizeFilter::Mitchell: return STBIR_FILTER_MITCHELL;
+    }
+    return STBIR_FILTER_DEFAULT;
+}
+
+stbir_edge edgeFor(ResizeEdge edge)
+{
+    switch (edge)
+    {
+        case ResizeEdge::Clamp: return STBIR_EDGE_CLAMP;
+        case ResizeEdge::Reflect: return STBIR_EDGE_REFLECT;
+        case ResizeEdge::Wrap: return STBIR_EDGE_WRAP;
+        case ResizeEdge::Zero: return STBIR_EDGE_ZERO;
+    }
+    return STBIR_EDGE_CLAMP;
+}
+
+// The STBIR_PROFILE counters are only compiled into stbir with the
+// STB_IMAGE_PLUS_RESIZE_PROFILE build option.
+void recordBuild([[maybe_unused]] const STBIR_RESIZE& resize, std::chrono::nanoseconds time,
+                 ResizeProfile& profile)
+{
+    profile.buildTime = time;
+#ifdef STBIR_PROFILE
+    STBIR_PROFILE_INFO info;
+    stbir_resize_build_profile_info(&info, &resize);
+    profile.build = {info.total_clocks, info.clocks[0], info.clocks[1], info.clocks[2],
+                     info.clocks[3], info.clocks[4], info.clocks[5]};
+    profile.phasesAvailable = true;
+#endif
+}
+
+void recordResample([[maybe_unused]] const STBIR_RESIZE& resize, std::chrono::nanoseconds time,
+                    ResizeProfile& profile)
+{
+    profile.resampleTime = time;
+#ifdef STBIR_PROFILE
+    // stbir reports the total of the first split of a range only, so the
+    // splits are read one at a time.
+    ResizeProfile::ResamplePhases& phases = profile.resample;
+    phases = {};
+    for (int split = 0; split < resize.splits; ++split)
+    {
+        STBIR_PROFILE_INFO info;
+        stbir_resize_split_profile_info(&info, &resize, split, 1);
+        phases.total += info.total_clocks;
+        phases.looping += info.clocks[0];
+        phases.vertical += info.clocks[1];
+        phases.horizontal += info.clocks[2];
+        phases.decode += info.clocks[3];
+        phases.encode += info.clocks[4];
+        phases.alpha += info.clocks[5];
+        phases.unalpha += info.clocks[6];
+    }
+    profile.phasesAvailable = true;
+#endif
+}
+
+// The samplers a thread last built in resizeWithCachedSamplers.
+struct CachedSamplers
+{
+    STBIR_RESIZE resize;
+    bool built = false;
+    std::size_t channels = 0;
+    ResizeOptions options;
+
+    ~CachedSamplers()
+    {
+        if (built)
+            stbir_free_samplers(&resize);
+    }
+
+    bool matches(std::size_t channels, std::size_t inputWidth, std::size_t inputHeight, std::size_t outputWidth,
+                 std::size_t outputHeight, const ResizeOptions& options) const
+    {
+        return built and this->channels == channels
+            and static_cast<std::size_t>(resize.input_w) == inputWidth
+            and static_cast<std::size_t>(resize.input_h) == inputHeight
+            and static_cast<std::size_t>(resize.output_w) == outputWidth
+            and static_cast<std::size_t>(resize.output_h) == outputHeight
+            and this->options.threads == options.threads and this->options.filter == options.filter
+            and this->options.edge == options.edge and this->options.srgb == options.srgb
+            and this->options.alpha == options.alpha
+            and this->options.fastStraightAlpha == options.fastStraightAlpha;
+    }
+};
+
+}
+
+bool fitsResize(std::size_t channels, std::size_t width, std::size_t height)
+{
+    return width <= INT_MAX / channels and height <= INT_MAX;
+}
+
+bool initResize(STBIR_RESIZE& resize, std::size_t channels, const void* input, std::size_t inputWidth,
+                std::size_t inputHeight, std::size_t inputStride, void* output, std::size_t outputWidth,
+                std::size_t outputHeight, std::size_t outputStride, const ResizeOptions& options)
+{
+    if (not fitsResize(channels, inputWidth, inputHeight) or not fitsResize(channels, outputWidth, outputHeight)
+        or inputStride > INT_MAX or outputStride > INT_MAX)
+        return false;
+    stbir_resize_init(&resize,
+                      input, static_cast<int>(inputWidth), static_cast<int>(inputHeight),
+                      static_cast<int>(inputStride),
+                      output, static_cast<int>(outputWidth), static_cast<int>(outputHeight),
+                      static_cast<int>(outputStride),
+                      pixelLayout(channels, options.alpha),
+                      options.srgb ? STBIR_TYPE_UINT8_SRGB : STBIR_TYPE_UINT8);
+    stbir_set_filters(&resize, filterFor(options.filter), filterFor(options.filter));
+    stbir_set_edgemodes(&resize, edgeFor(options.edge), edgeFor(options.edge));
+    stbir_set_non_pm_alpha_speed_over_quality(&resize, options.fastStraightAlpha ? 1 : 0);
+    return true;
+}
+
+bool buildSplitSamplers(STBIR_RESIZE& resize, std::size_t threads, ResizeProfile* profile)
+{
+    const std::size_t outputPixels = static_cast<std::size_t>(resize.output_w) * resize.output_h;
+    std::size_t splits = threads != 0 ? threads : WorkerPool::instance().concurrency();
+    splits = std::clamp<std::size_t>(std::min(splits, outputPixels / kMinPixelsPerSplit), 1, 256);
+
+    // stbir may settle for fewer splits than asked for, keeping at least a
+    // few output rows in each; resize.splits holds the count.
+    const auto start = std::chrono::steady_clock::now();
+    if (stbir_build_samplers_with_splits(&resize, static_cast<int>(splits)) == 0)
+        return false;
+    if (profile != nullptr)
+        recordBuild(resize, std::chrono::steady_clock::now() - start, *profile);
+    return true;
+}
+
+bool runSplits(STBIR_RESIZE& resize, ResizeProfile* profile)
+{
+    const auto start = std::chrono::steady_clock::now();
+    std::atomic<bool> failed{false};
+    WorkerPool::instance().parallelFor(static_cast<std::size_t>(resize.splits), [&](std::size_t split)
+    {
+        if (not stbir_resize_extended_split(&resize, static_cast<int>(split), 1))
+            failed = true;
+    });
+    if (failed)
+        return false;
+    if (profile != nullptr)
+        recordResample(resize, std::chrono::steady_clock::now() - start, *profile);
+    return true;
+}
+
+bool resizeInParallel(STBIR_RESIZE& resize, std::size_t threads, ResizeProfile* profile)
+{
+    if (profile != nullptr)
+        *profile = {};
+    if (not buildSplitSamplers(resize, threads, profile))
+        return false;
+    const bool resized = runSplits(resize, profile);
+    stbir_free_samplers(&resize);
+    return resized;
+}
+
+bool resizeWithCachedSamplers(std::size_t channels, const void* input, std::size_t inputWidth,
+                              std::size_t inputHeight, std::size_t inputStride, void* output,
+                              std::size_t outputWidth, std::size_t outputHeight, std::size_t outputStride,
+                              const ResizeOptions& options)
+{
+    if (options.profile != nullptr)
+        *options.profile = {};
+    thread_local CachedSamplers cache;
+    if (not cache.matches(channels, inputWidth, inputHeight, outputWidth, outputHeight, options))
+    {
+        if (cache.built)
+        {
+            stbir_free_samplers(&cache.resize);
+            cache.built = false;
+        }
+        if (not initResize(cache.resize, channels, input, inputWidth, inputHeight, inputStride,
+                           output, outputWidth, outputHeight, outputStride, options)
+            or not buildSplitSamplers(cache.resize, options.threads, options.profile))
+            return false;
+        cache.built = true;
+        cache.channels = channels;
+        cache.options = options;
+    }
+    stbir_set_buffer_ptrs(&cache.resize, input, static_cast<int>(inputStride),
+                          output, static_cast<int>(outputStride));
+    return runSplits(cache.resize, options.profile);
+}
+
+}
+
+namespace
+{
+
+// An STBIR_RESIZE with built samplers, freed along with it.
+struct FreeSamplers
+{
+    void operator()(STBIR_RESIZE* resize) const
+    {
+        stbir_free_samplers(resize);
+        delete resize;
+    }
+};
+
+using Samplers = std::unique_ptr<STBIR_RESIZE, FreeSamplers>;
+
+}
+
+template <std::size_t Channels>
+struct ResizePlan<Channels>::State
+{
+    std::size_t inputWidth = 0;
+    std::size_t inputHeight = 0;
+    std::size_t outputWidth = 0;
+    std::size_t outputHeight = 0;
+    std::size_t threads = 0;
+    ResizeProfile* profile = nullptr;
+    // The settings every set of samplers is built from; never built itself.
+    STBIR_RESIZE prototype;
+
+    // Samplers not in use by a run. A run takes one, or builds one when all
+    // are taken, and gives it back when done.
+    std::mutex mutex;
+    std::vector<Samplers> idle;
+
+    // `profile` records a build, if there is one.
+    Samplers acquire(ResizeProfile* profile)
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (not idle.empty())
+            {
+                Samplers samplers = std::move(idle.back());
+                idle.pop_back();
+                return samplers;
+            }
+        }
+        Samplers samplers(new STBIR_RESIZE(prototype));
+        if (not detail::buildSplitSamplers(*samplers, threads, profile))
+            return nullptr;
+        return samplers;
+    }
+
+    void release(Samplers samplers)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        idle.push_back(std::move(samplers));
+    }
+};
+
+template <std::size_t Channels>
+ResizePlan<Channels>::ResizePlan(std::size_t inputWidth, std::size_t inputHeight, std::size_t outputWidth,
+                                 std::size_t outputHeight, const ResizeOptions& options)
+{
+    if (inputWidth == 0 or inputHeight == 0 or outputWidth == 0 or outputHeight == 0)
+        return;
+
+    auto state = std::make_unique<State>();
+    state->inputWidth = inputWidth;
+    state->inputHeight = inputHeight;
+    state->outputWidth = outputWidth;
+    state->outputHeight = outputHeight;
+    state->threads = options.threads;
+    state->profile = options.profile;
+    if (not detail::initResize(state->prototype, Channels, nullptr, inputWidth, inputHeight,
+                               inputWidth * Channels, nullptr, outputWidth, outputHeight,
+                               outputWidth * Channels, options))
+        return;
+
+    // Build the first set now, so that isValid tells whether runs can work.
+    Samplers samplers = state->acquire(nullptr);
+    if (samplers == nullptr)
+        return;
+    state->release(std::move(samplers));
+    mState = std::move(state);
+}
+
+template <std::size_t Channels>
+ResizePlan<Channels>::ResizePlan(ResizePlan&&) noexcept = default;
+
+template <std::size_t Channels>
+ResizePlan<Channels>& ResizePlan<Channels>::operator=(ResizePlan&&) noexcept = default;
+
+template <std::size_t Channels>
+ResizePlan<Channels>::~ResizePlan() = default;
+
+template <std::size_t Channels>
+bool ResizePlan<Channels>::isValid() const
+{
+    return mState != nullptr;
+}
+
+template <std::size_t Channels>
+std::size_t ResizePlan<Channels>::inputWidth() const
+{
+    return isValid() ? mState->inputWidth : 0;
+}
+
+template <std::size_t Channels>
+std::size_t ResizePlan<Channels>::inputHeight() const
+{
+    return isValid() ? mState->inputHeight : 0;
+}
+
+template <std::size_t Channels>
+std::size_t ResizePlan<Channels>::outputWidth() const
+{
+    return isValid() ? mState->outputWidth : 0;
+}
+
+template <std::size_t Channels>
+std::size_t ResizePlan<Channels>::outputHeight() const
+{
+    return isValid() ? mState->outputHeight : 0;
+}
+
+template <std::size_t Channels>
+ImageData<Channels> ResizePlan<Channels>::run(const ImageData<Channels>& input) const
+{
+    if (not isValid() or not input.isValid() or input.width() != mState->inputWidth
+        or input.height() != mState->inputHeight)
+        return {};
+
+    const std::size_t pixelCount = mState->outputWidth * mState->outputHeight;
+    // Allocated with malloc so that the ImageData destructor (stbi_image_free) can release it.
+    auto* pixels = static_cast<Pixel*>(std::malloc(pixelCount * sizeof(Pixel)));
+    if (pixels == nullptr)
+        return {};
+    std::span<Pixel> output(pixels, pixelCount);
+    if (not run(input.pixelSpan(), 0, output, 0))
+    {
+        std::free(pixels);
+        return {};
+    }
+    return {output, mState->outputWidth, mState->outputHeight};
+}
+
+template <std::size_t Channels>
+bool ResizePlan<Channels>::run(std::span<const Pixel> input, std::size_t inputStride, std::span<Pixel> output,
+                               std::size_t outputStride) const
+{
+    if (not isValid())
+        return false;
+    const State& state = *mState;
+    inputStride = inputStride != 0 ? inputStride : state.inputWidth;
+    outputStride = outputStride != 0 ? outputStride : state.outputWidth;
+    if (inputStride < state.inputWidth or outputStride < state.outputWidth
+        or inputStride > INT_MAX / sizeof(Pixel) or outputStride > INT_MAX / sizeof(Pixel)
+        or input.size() < (state.inputHeight - 1) * inputStride + state.inputWidth
+        or output.size() < (state.outputHeight - 1) * outputStride + state.outputWidth)
+        return false;
+
+    if (state.profile != nullptr)
+        *state.profile = {};
+    Samplers samplers = mState->acquire(state.profile);
+    if (samplers == nullptr)
+        return false;
+    stbir_set_buffer_ptrs(samplers.get(), input.data(), static_cast<int>(inputStride * sizeof(Pixel)),
+                          output.data(), static_cast<int>(outputStride * sizeof(Pixel)));
+    const bool resized = detail::runSplits(*samplers, state.profile);
+    mState->release(std::move(samplers));
+    return resized;
+}
+
+// template instantiations
+
+template class ResizePlan<1>;
+template class ResizePlan<2>;
+template class ResizePlan<3>;
+template class ResizePlan<4>;
+
+}
@@ -0,0 +1,50 @@
+#pragma once
+
+#include <stb_image_plus.h>
+#include <stb_image_resize2.h>
+#include <cstddef>
+
+namespace stb_image_plus::detail
+{
+
+/* Whether stbir, which counts in ints, can take an image of `width` x
+ * `height` pixels of `channels` uint8 channels. */
+bool fitsResize(std::size_t channels, std::size_t width, std::size_t height);
+
+/* stbir_resize_init for `channels` (1..4) interleaved uint8 channels,
+ * followed by the stbir settings `options` asks for. Strides are in bytes;
+ * the buffers may be null, to be set before running. Returns false, with
+ * `resize` left unset, for sizes or strides that don't fit stbir's ints. */
+bool initResize(STBIR_RESIZE& resize, std::size_t channels, const void* input, std::size_t inputWidth,
+                std::size_t inputHeight, std::size_t inputStride, void* output, std::size_t outputWidth,
+                std::size_t outputHeight, std::size_t outputStride, const ResizeOptions& options);
+
+/* Builds the samplers of `resize` for up to `threads` horizontal bands of
+ * the output (stbir splits); 0 asks for one band per pool thread, caller
+ * included. Small outputs get fewer bands, as each costs its own scratch
+ * rows. Records the build in `profile` if not null. Returns false if stbir
+ * fails. */
+bool buildSplitSamplers(STBIR_RESIZE& resize, std::size_t threads, ResizeProfile* profile);
+
+/* Resizes the bands of `resize`, whose samplers are built and buffers set,
+ * in parallel on the worker pool. Records the resampling in `profile` if
+ * not null. Returns false if stbir fails. */
+bool runSplits(STBIR_RESIZE& resize, ResizeProfile* profile);
+
+/* Resets `profile` if not null, then buildSplitSamplers, runSplits and
+ * frees the samplers: a one-off parallel resize. */
+bool resizeInParallel(STBIR_RESIZE& resize, std::size_t threads, ResizeProfile* profile);
+
+/* A parallel resize with the arguments of initResize, profiled in
+ * options.profile like resizeInParallel, reusing the samplers
+ * the calling thread built for its previous call when the channels, sizes
+ * and options are the same; only the buffers and strides may differ. A
+ * thread repeating one resize thus allocates nothing after its first call,
+ * at the cost of keeping those samplers until it resizes differently or
+ * exits. */
+bool resizeWithCachedSamplers(std::size_t channels, const void* input, std::size_t inputWidth,
+                              std::size_t inputHeight, std::size_t inputStride, void* output,
+                              std::size_t outputWidth, std::size_t outputHeight, std::size_t outputStride,
+                              const ResizeOptions& options);
+
+}
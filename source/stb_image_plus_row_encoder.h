@@ -0,0 +1,36 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace stb_image_plus::detail
+{
+
+/* stbi_write_func adapter for encoders that append to the
+ * std::vector<std::uint8_t> passed as `context`. */
+inline void writeToVector(void* context, void* data, int size)
+{
+    std::vector<std::uint8_t>& out = *static_cast<std::vector<std::uint8_t>*>(context);
+    const std::uint8_t* bytes = static_cast<const std::uint8_t*>(data);
+    out.insert(out.end(), bytes, bytes + size);
+}
+
+/* An encode in progress that is fed the image a few rows at a time, top to
+ * bottom, and passes the encoded bytes on as soon as they are final.
+ * Implementations buffer no more than what their format needs to make
+ * progress (a window of bands for PNG, one MCU row for JPEG). */
+class RowEncoder
+{
+public:
+    virtual ~RowEncoder() = default;
+
+    /* Appends `count` packed rows. Returns false if that would run past the
+     * image height. The file is complete once every row has been pushed. */
+    virtual bool pushRows(const std::uint8_t* rows, std::size_t count) = 0;
+
+    /* Rows pushed so far. */
+    virtual std::size_t rowsPushed() const = 0;
+};
+
+}
@@ -0,0 +1,19 @@
+#pragma once
+
+/* Compile-time SIMD selection shared by the encoders. SSE2 is baseline on
+ * x86-64; the AVX2 and PCLMUL paths need the STB_IMAGE_PLUS_AVX2 build
+ * option. Every SIMD path has a scalar fallback. */
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+    #define STB_IMAGE_PLUS_SSE2
+#endif
+#if defined(__AVX2__)
+    #define STB_IMAGE_PLUS_AVX2
+#endif
+#if (defined(__PCLMUL__) && defined(__SSE2__)) || (defined(_MSC_VER) && defined(__AVX2__))
+    #define STB_IMAGE_PLUS_PCLMUL
+#endif
+
+#if defined(STB_IMAGE_PLUS_SSE2) || defined(STB_IMAGE_PLUS_AVX2) || defined(STB_IMAGE_PLUS_PCLMUL)
+    #include <immintrin.h>
+#endif
@@ -0,0 +1,77 @@
+#include <stb_image_plus_stream.h>
+#include "stb_image_plus_jpeg.h"
+#include "stb_image_plus_png.h"
+#include "stb_image_plus_row_encoder.h"
+
+namespace stb_image_plus
+{
+
+struct StreamEncoder::State
+{
+    StreamSink sink;
+    bool sinkFailed = false;
+    std::size_t height = 0;
+    std::size_t rowBytes = 0;
+    std::unique_ptr<detail::RowEncoder> encoder;
+
+    // stbi_write_func adapter; once the sink refuses bytes nothing more is
+    // sent to it.
+    static void write(void* context, void* data, int size)
+    {
+        State& state = *static_cast<State*>(context);
+        if (state.sinkFailed)
+            return;
+        const std::uint8_t* bytes = static_cast<const std::uint8_t*>(data);
+        state.sinkFailed = not state.sink(std::span<const std::uint8_t>(bytes, static_cast<std::size_t>(size)));
+    }
+};
+
+StreamEncoder::StreamEncoder(ImageFormat format, std::size_t width, std::size_t height, std::size_t channels,
+                             StreamSink sink, const EncodeOptions& options) :
+    mState(std::make_unique<State>())
+{
+    mState->sink = std::move(sink);
+    mState->height = height;
+    mState->rowBytes = width * channels;
+    if (not mState->sink or options.flipVertically)
+        return;
+    if (format == ImageFormat::Png)
+        mState->encoder = detail::makePngRowEncoder(State::write, mState.get(), width, height, channels, options);
+    else if (format == ImageFormat::Jpeg)
+        mState->encoder = detail::makeJpegRowEncoder(State::write, mState.get(), width, height, channels, options);
+}
+
+StreamEncoder::StreamEncoder(StreamEncoder&&) noexcept = default;
+StreamEncoder& StreamEncoder::operator=(StreamEncoder&&) noexcept = default;
+StreamEncoder::~StreamEncoder() = default;
+
+bool StreamEncoder::pushRows(std::span<const std::uint8_t> rows)
+{
+    if (not isValid())
+        return false;
+    if (rows.size() % mState->rowBytes != 0
+        or not mState->encoder->pushRows(rows.data(), rows.size() / mState->rowBytes)
+        or mState->sinkFailed)
+    {
+        mState->encoder.reset();
+        return false;
+    }
+    return true;
+}
+
+bool StreamEncoder::isValid() const
+{
+    return mState != nullptr and mState->encoder != nullptr and not mState->sinkFailed;
+}
+
+bool StreamEncoder::finished() const
+{
+    return isValid() and mState->encoder->rowsPushed() == mState->height;
+}
+
+std::size_t StreamEncoder::rowsPushed() const
+{
+    return isValid() ? mState->encoder->rowsPushed() : 0;
+}
+
+}
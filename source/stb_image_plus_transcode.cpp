@@ -0,0 +1,305 @@
+#include <stb_image_plus_transcode.h>
+#include "stb_image_plus_jpeg.h"
+#include "stb_image_plus_jpeg_read.h"
+#include "stb_image_plus_parallel.h"
+#include <stb_image.h>
+#include <algorithm>
+#include <array>
+#include <climits>
+#include <utility>
+
+namespace stb_image_plus
+{
+
+namespace
+{
+
+// A JpegTransform as a transpose followed by flips of the result.
+struct Orientation
+{
+    bool transpose = false;
+    bool flipX = false;
+    bool flipY = false;
+};
+
+Orientation orientationFor(int exifOrientation)
+{
+    switch (exifOrientation)
+    {
+        case 2: return {false, true, false};
+        case 3: return {false, true, true};
+        case 4: return {false, false, true};
+        case 5: return {true, false, false};
+        case 6: return {true, true, false};
+        case 7: return {true, true, true};
+        case 8: return {true, false, true};
+    }
+    return {};
+}
+
+// Crops `source` to whole MCUs from (x, y) over width x height pixels, then
+// applies `orientation` to the blocks and their coefficients.
+bool transformCoefficients(const detail::JpegFile& source, std::size_t x, std::size_t y, std::size_t width,
+                           std::size_t height, Orientation orientation, detail::JpegFile& result)
+{
+    const std::size_t mcuWidth = 8 * static_cast<std::size_t>(source.maxHorizontalSampling());
+    const std::size_t mcuHeight = 8 * static_cast<std::size_t>(source.maxVerticalSampling());
+    const std::size_t mcuX = x / mcuWidth, mcuY = y / mcuHeight;
+    width += x - mcuX * mcuWidth;
+    height += y - mcuY * mcuHeight;
+
+    result.quantTables = source.quantTables;
+    result.hasQuantTable = source.hasQuantTable;
+    result.segments = source.segments;
+    result.components = source.components;
+    result.width = orientation.transpose ? height : width;
+    result.height = orientation.transpose ? width : height;
+    for (detail::JpegComponent& component : result.components)
+    {
+        if (orientation.transpose)
+            std::swap(component.horizontalSampling, component.verticalSampling);
+        component.coefficients.clear();
+    }
+    if (orientation.transpose)
+    {
+        // Coefficient (u, v) moves to (v, u), and its quantizer with it.
+        for (std::array<std::uint16_t, 64>& table : result.quantTables)
+        {
+            for (int v = 0; v < 8; ++v)
+            {
+                for (int u = 0; u < v; ++u)
+                    std::swap(table[v * 8 + u], table[u * 8 + v]);
+            }
+        }
+    }
+
+    // A flip needs whole MCUs along its axis; drop the partial one.
+    const std::size_t resultMcuWidth = 8 * static_cast<std::size_t>(result.maxHorizontalSampling());
+    const std::size_t resultMcuHeight = 8 * static_cast<std::size_t>(result.maxVerticalSampling());
+    if (orientation.flipX)
+        result.width -= result.width % resultMcuWidth;
+    if (orientation.flipY)
+        result.height -= result.height % resultMcuHeight;
+    if (result.width == 0 or result.height == 0)
+        return false;
+
+    // Where each coefficient of a result block comes from, both in zigzag
+    // order; mirroring negates the odd frequencies along that axis.
+    std::array<std::uint8_t, 64> zigzagIndex, sourceIndex;
+    std::array<bool, 64> negate;
+    for (int k = 0; k < 64; ++k)
+        zigzagIndex[detail::kJpegNaturalOrder[k]] = static_cast<std::uint8_t>(k);
+    for (int k = 0; k < 64; ++k)
+    {
+        const int v = detail::kJpegNaturalOrder[k] / 8, u = detail::kJpegNaturalOrder[k] % 8;
+        sourceIndex[k] = zigzagIndex[orientation.transpose ? u * 8 + v : v * 8 + u];
+        negate[k] = (orientation.flipX and u % 2 == 1) != (orientation.flipY and v % 2 == 1);
+    }
+
+    for (std::size_t c = 0; c < result.components.size(); ++c)
+    {
+        const detail::JpegComponent& from = source.components[c];
+        detail::JpegComponent& to = result.components[c];
+        to.blocksWide = result.mcusWide() * to.horizontalSampling;
+        to.blocksHigh = result.mcusHigh() * to.verticalSampling;
+        to.coefficients.assign(to.blocksWide * to.blocksHigh * 64, 0);
+        const std::size_t offsetX = mcuX * from.horizontalSampling, offsetY = mcuY * from.verticalSampling;
+
+        detail::WorkerPool::instance().parallelFor(to.blocksHigh, [&](std::size_t row)
+        {
+            for (std::size_t column = 0; column < to.blocksWide; ++column)
+            {
+                // Undo the flips, then the transpose, to find the source block.
+                const std::size_t flippedX = orientation.flipX ? to.blocksWide - 1 - column : column;
+                const std::size_t flippedY = orientation.flipY ? to.blocksHigh - 1 - row : row;
+                const std::size_t sourceX = (orientation.transpose ? flippedY : flippedX) + offsetX;
+                const std::size_t sourceY = (orientation.transpose ? flippedX : flippedY) + offsetY;
+                if (sourceX >= from.blocksWide or sourceY >= from.blocksHigh)
+                    continue;
+
+                const std::int16_t* block = from.coefficients.data() + (sourceY * from.blocksWide + sourceX) * 64;
+                std::int16_t* out = to.coefficients.data() + (row * to.blocksWide + column) * 64;
+                for (int k = 0; k < 64; ++k)
+                {
+                    const int value = block[sourceIndex[k]];
+                    out[k] = static_cast<std::int16_t>(negate[k] ? -value : value);
+                }
+            }
+        });
+    }
+    return true;
+}
+
+// Requantizes the coefficients of `file` to the tables of `quality`: the
+// luma one for the first component, the chroma one for the others.
+void requantize(detail::JpegFile& file, int quality)
+{
+    const std::array<std::uint16_t, 64> luma = detail::jpegQuantTable(quality, false);
+    const std::array<std::uint16_t, 64> chroma = detail::jpegQuantTable(quality, true);
+    std::array<std::array<std::uint16_t, 64>, 4> tables;
+    for (std::size_t c = 0; c < file.components.size(); ++c)
+    {
+        detail::JpegComponent& component = file.components[c];
+        const std::array<std::uint16_t, 64>& from = file.quantTables[component.quantTable];
+        const std::array<std::uint16_t, 64>& target = c == 0 ? luma : chroma;
+        std::array<std::uint16_t, 64>& to = tables[c];
+        for (int i = 0; i < 64; ++i)
+            to[i] = std::max(target[i], from[i]);
+
+        if (to == from)
+            continue;
+
+        // Zigzag ordered steps, as the coefficients are stored.
+        std::array<std::uint32_t, 64> fromStep, toStep;
+        std::array<double, 64> reciprocal;
+        for (int k = 0; k < 64; ++k)
+        {
+            fromStep[k] = from[detail::kJpegNaturalOrder[k]];
+            toStep[k] = to[detail::kJpegNaturalOrder[k]];
+            reciprocal[k] = 1.0 / toStep[k];
+        }
+        detail::WorkerPool::instance().parallelFor(component.blocksHigh, [&](std::size_t row)
+        {
+            std::int16_t* block = component.coefficients.data() + row * component.blocksWide * 64;
+            for (std::size_t column = 0; column < component.blocksWide; ++column, block += 64)
+            {
+                // Rounds to nearest, ties toward zero: values sit closer to zero
+                // than their quantized magnitude more often than not, and
+                // rounding ties up would grow every odd value when the step
+                // doubles. The division goes through a reciprocal, which can
+                // only come out one low, when the quotient is whole. There are
+                // no branches on the values, which are too random to predict;
+                // zeros and unchanged steps come out as they went in.
+                for (int k = 0; k < 64; ++k)
+                {
+                    const int value = block[k];
+                    const std::uint32_t magnitude = static_cast<std::uint32_t>(value < 0 ? -value : value);
+                    const std::uint32_t dividend = magnitude * fromStep[k] + (toStep[k] - 1) / 2;
+                    std::uint32_t result = static_cast<std::uint32_t>(dividend * reciprocal[k]);
+                    result += (result + 1) * toStep[k] <= dividend ? 1 : 0;
+                    block[k] = static_cast<std::int16_t>(value < 0 ? -static_cast<int>(result) : static_cast<int>(result));
+                }
+            }
+        });
+    }
+
+    // Components with the same steps share a table.
+    file.hasQuantTable = {};
+    for (std::size_t c = 0; c < file.components.size(); ++c)
+    {
+        std::size_t same = 0;
+        while (tables[same] != tables[c])
+            ++same;
+        file.components[c].quantTable = static_cast<int>(same);
+        file.quantTables[same] = tables[same];
+        file.hasQuantTable[same] = true;
+    }
+}
+
+template <std::size_t Channels>
+bool decodeAndEncode(const std::uint8_t* data, std::size_t size, std::vector<std::uint8_t>& out,
+                     const TranscodeOptions& options)
+{
+    ImageData<Channels> image;
+    if (not image.readFromMemory(data, size))
+        return false;
+    const std::size_t width = options.width != 0 ? options.width : image.width();
+    const std::size_t height = options.height != 0 ? options.height : image.height();
+    if (width == image.width() and height == image.height())
+        return image.writeToMemory(options.format, out, options.encode);
+    const ImageData<Channels> resized = image.resize(width, height);
+    return resized.isValid() and resized.writeToMemory(options.format, out, options.encode);
+}
+
+}
+
+int estimateJpegQuality(const std::uint8_t* data, std::size_t size)
+{
+    detail::JpegFile file;
+    if (not detail::readJpegHeader(data, size, file))
+        return 0;
+    return detail::estimateJpegQuality(file);
+}
+
+bool transformJpeg(const std::uint8_t* data, std::size_t size, std::vector<std::uint8_t>& out,
+                   const JpegTransformOptions& options)
+{
+    detail::JpegFile source;
+    if (not detail::readJpeg(data, size, source) or options.cropX >= source.width or options.cropY >= source.height)
+        return false;
+
+    const bool fromExif = options.transform == JpegTransform::FromExif;
+    const Orientation orientation = orientationFor(fromExif ? source.orientation : static_cast<int>(options.transform));
+    const std::size_t width = options.cropWidth != 0 ? std::min(options.cropWidth, source.width - options.cropX)
+                                                     : source.width - options.cropX;
+    const std::size_t height = options.cropHeight != 0 ? std::min(options.cropHeight, source.height - options.cropY)
+                                                       : source.height - options.cropY;
+    detail::JpegFile result;
+    if (not transformCoefficients(source, options.cropX, options.cropY, width, height, orientation, result))
+        return false;
+    if (fromExif and source.orientationSegment >= 0)
+    {
+        std::vector<std::uint8_t>& segment = result.segments[source.orientationSegment];
+        segment[source.orientationOffset + (source.orientationBigEndian ? 0 : 1)] = 0;
+        segment[source.orientationOffset + (source.orientationBigEndian ? 1 : 0)] = 1;
+    }
+
+    const std::size_t previousSize = out.size();
+    if (detail::writeJpegCoefficients(detail::writeToVector, &out, result))
+        return true;
+    out.resize(previousSize);
+    return false;
+}
+
+bool requantizeJpeg(const std::uint8_t* data, std::size_t size, int quality, std::vector<std::uint8_t>& out)
+{
+    detail::JpegFile file;
+    if (not detail::readJpeg(data, size, file))
+        return false;
+    requantize(file, quality);
+
+    const std::size_t previousSize = out.size();
+    if (detail::writeJpegCoefficients(detail::writeToVector, &out, file))
+        return true;
+    out.resize(previousSize);
+    return false;
+}
+
+bool transcode(const std::uint8_t* data, std::size_t size, std::vector<std::uint8_t>& out,
+               const TranscodeOptions& options)
+{
+    if (data == nullptr or size > INT_MAX)
+        return false;
+
+    // A JPEG that only needs its quality changed can skip the pixels.
+    detail::JpegFile file;
+    if (options.format == ImageFormat::Jpeg and not options.encode.flipVertically
+        and (options.jpegPassthrough or options.jpegRequantize) and detail::readJpegHeader(data, size, file)
+        and (options.width == 0 or options.width == file.width)
+        and (options.height == 0 or options.height == file.height))
+    {
+        const int quality = options.encode.jpegQuality;
+        if (options.jpegPassthrough and quality >= detail::estimateJpegQuality(file))
+        {
+            out.insert(out.end(), data, data + size);
+            return true;
+        }
+        if (options.jpegRequantize and quality < detail::estimateJpegQuality(file)
+            and requantizeJpeg(data, size, quality, out))
+            return true;
+    }
+
+    int width = 0, height = 0, channels = 0;
+    if (not stbi_info_from_memory(data, static_cast<int>(size), &width, &height, &channels))
+        return false;
+    switch (channels)
+    {
+        case 1: return decodeAndEncode<1>(data, size, out, options);
+        case 2: return decodeAndEncode<2>(data, size, out, options);
+        case 3: return decodeAndEncode<3>(data, size, out, options);
+        case 4: return decodeAndEncode<4>(data, size, out, options);
+    }
+    return false;
+}
+
+}
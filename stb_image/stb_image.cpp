@@ -15,6 +15,11 @@
 #if defined(_WIN32)
     #define STBIW_WINDOWS_UTF8
 #endif
+/* PNG compression (stbi_zlib_compress) and chunk CRCs are routed to the
+   stb_image_plus deflate engine, which is built into this same library. */
+#include "stb_image_plus_deflate.h"
+#define STBIW_ZLIB_COMPRESS stb_image_plus::detail::zlibCompress
+#define STBIW_CRC32(buffer, len) stb_image_plus::detail::crc32(0, buffer, static_cast<std::size_t>(len))
 #include "stb_image_write.h"
 
 #define STB_IMAGE_RESIZE_IMPLEMENTATION
@@ -517,12 +517,18 @@ STBIDEF void stbi_convert_iphone_png_to_rgb(int flag_true_if_should_convert);
 // flip the image vertically, so the first pixel in the output array is the bottom left
 STBIDEF void stbi_set_flip_vertically_on_load(int flag_true_if_should_flip);
 
+// rotate and flip JPEG images as their EXIF orientation tag says, so they come out
+// upright; *x and *y report the upright size (swapped for orientations 5 to 8, which
+// stbi_info doesn't do). applied before stbi_set_flip_vertically_on_load
+STBIDEF void stbi_set_exif_orientation_on_load(int flag_true_if_should_orient);
+
 // as above, but only applies to images loaded on the thread that calls the function
 // this function is only available if your compiler supports thread-local variables;
 // calling it will fail to link if your compiler doesn't
 STBIDEF void stbi_set_unpremultiply_on_load_thread(int flag_true_if_should_unpremultiply);
 STBIDEF void stbi_convert_iphone_png_to_rgb_thread(int flag_true_if_should_convert);
 STBIDEF void stbi_set_flip_vertically_on_load_thread(int flag_true_if_should_flip);
+STBIDEF void stbi_set_exif_orientation_on_load_thread(int flag_true_if_should_orient);
 
 // ZLIB client - used by PNG, available for other purposes
 
@@ -1134,6 +1140,29 @@ STBIDEF void stbi_set_flip_vertically_on_load_thread(int flag_true_if_should_fli
                                          : stbi__vertically_flip_on_load_global)
 #endif // STBI_THREAD_LOCAL
 
+static int stbi__exif_orientation_on_load_global = 0;
+
+STBIDEF void stbi_set_exif_orientation_on_load(int flag_true_if_should_orient)
+{
+   stbi__exif_orientation_on_load_global = flag_true_if_should_orient;
+}
+
+#ifndef STBI_THREAD_LOCAL
+#define stbi__exif_orientation_on_load  stbi__exif_orientation_on_load_global
+#else
+static STBI_THREAD_LOCAL int stbi__exif_orientation_on_load_local, stbi__exif_orientation_on_load_set;
+
+STBIDEF void stbi_set_exif_orientation_on_load_thread(int flag_true_if_should_orient)
+{
+   stbi__exif_orientation_on_load_local = flag_true_if_should_orient;
+   stbi__exif_orientation_on_load_set = 1;
+}
+
+#define stbi__exif_orientation_on_load  (stbi__exif_orientation_on_load_set     \
+                                          ? stbi__exif_orientation_on_load_local \
+                                          : stbi__exif_orientation_on_load_global)
+#endif // STBI_THREAD_LOCAL
+
 static void *stbi__load_main(stbi__context *s, int *x, int *y, int *comp, int req_comp, stbi__result_info *ri, int bpc)
 {
    memset(ri, 0, sizeof(*ri)); // make sure it's initialized if we add new fields
@@ -1698,7 +1727,7 @@ static int stbi__get16be(stbi__context *s)
 }
 #endif
 
-#if defined(STBI_NO_PNG) && defined(STBI_NO_PSD) && defined(STBI_NO_PIC)
+#if defined(STBI_NO_PNG) && defined(STBI_NO_PSD) && defined(STBI_NO_PIC) && defined(STBI_NO_JPEG)
 // nothing
 #else
 static stbi__uint32 stbi__get32be(stbi__context *s)
@@ -1708,7 +1737,7 @@ static stbi__uint32 stbi__get32be(stbi__context *s)
 }
 #endif
 
-#if defined(STBI_NO_BMP) && defined(STBI_NO_TGA) && defined(STBI_NO_GIF)
+#if defined(STBI_NO_BMP) && defined(STBI_NO_TGA) && defined(STBI_NO_GIF) && defined(STBI_NO_JPEG)
 // nothing
 #else
 static int stbi__get16le(stbi__context *s)
@@ -1718,7 +1747,7 @@ static int stbi__get16le(stbi__context *s)
 }
 #endif
 
-#ifndef STBI_NO_BMP
+#if !defined(STBI_NO_BMP) || !defined(STBI_NO_JPEG)
 static stbi__uint32 stbi__get32le(stbi__context *s)
 {
    stbi__uint32 z = stbi__get16le(s);
@@ -1989,6 +2018,7 @@ typedef struct
    int            eob_run;
    int            jfif;
    int            app14_color_transform; // Adobe APP14 tag
+   int            exif_orientation;      // EXIF APP1 orientation tag, 1..8
    int            rgb;
 
    int scan_n, order[4];
@@ -3096,6 +3126,47 @@ static void stbi__jpeg_finish(stbi__jpeg *z)
    }
 }
 
+// reads the orientation tag (0x0112) of IFD0 from an EXIF APP1 segment of L bytes,
+// reading forward only so callback streams work too; returns the bytes left
+static int stbi__process_exif(stbi__jpeg *z, int L)
+{
+   static const unsigned char tag[6] = {'E','x','i','f','\0','\0'};
+   int ok = 1, big_endian, offset, count, i;
+   for (i=0; i < 6; ++i)
+      if (stbi__get8(z->s) != tag[i])
+         ok = 0;
+   L -= 6;
+   if (!ok) return L;
+
+   // TIFF header: byte order, 42, offset of IFD0 from the header
+   big_endian = stbi__get8(z->s) == 'M';
+   stbi__get8(z->s);
+   stbi__get16be(z->s);
+   offset = big_endian ? (int) stbi__get32be(z->s) : (int) stbi__get32le(z->s);
+   L -= 8;
+   if (offset < 8 || offset - 8 > L - 2) return L;
+   stbi__skip(z->s, offset - 8);
+   L -= offset - 8;
+
+   count = big_endian ? stbi__get16be(z->s) : stbi__get16le(z->s);
+   L -= 2;
+   for (i=0; i < count && L >= 12; ++i) {
+      int id    = big_endian ? stbi__get16be(z->s) : stbi__get16le(z->s);
+      int type  = big_endian ? stbi__get16be(z->s) : stbi__get16le(z->s);
+      int value;
+      stbi__skip(z->s, 4); // count
+      value = big_endian ? stbi__get16be(z->s) : stbi__get16le(z->s); // SHORTs sit left-aligned
+      stbi__skip(z->s, 2);
+      L -= 12;
+      if (id == 0x0112) {
+         if (type == 3 && value >= 1 && value <= 8)
+            z->exif_orientation = value;
+         break;
+      }
+   }
+   return L;
+}
+
 static int stbi__process_marker(stbi__jpeg *z, int m)
 {
    int L;
@@ -3190,6 +3261,8 @@ static int stbi__process_marker(stbi__jpeg *z, int m)
             z->app14_color_transform = stbi__get8(z->s); // color transform
             L -= 6;
          }
+      } else if (m == 0xE1 && L >= 14) { // EXIF APP1 segment
+         L = stbi__process_exif(z, L);
       }
 
       stbi__skip(z->s, L);
@@ -3367,6 +3440,7 @@ static int stbi__decode_jpeg_header(stbi__jpeg *z, int scan)
    int m;
    z->jfif = 0;
    z->app14_color_transform = -1; // valid values are 0,1,2
+   z->exif_orientation = 1;
    z->marker = STBI__MARKER_none; // initialize cached marker to empty
    m = stbi__get_marker(z);
    if (!stbi__SOI(m)) return stbi__err("no SOI","Corrupt JPEG");
@@ -3862,6 +3936,51 @@ static stbi_uc stbi__blinn_8x8(stbi_uc x, stbi_uc y)
    return (stbi_uc) ((t + (t >>8)) >> 8);
 }
 
+// rows of a transposing EXIF orientation are gathered into strips this many rows
+// high, then written out as columns: the strip and the output rows it reaches
+// stay in cache, which writing each row straight out as a column wouldn't
+#define STBI__ORIENT_STRIP_ROWS 16
+
+// copies one pixel of n bytes; the switch lets each case compile to plain moves
+static void stbi__copy_pixel(stbi_uc *dest, const stbi_uc *src, int n)
+{
+   switch (n) {
+      case 4: dest[3] = src[3]; // fallthrough
+      case 3: dest[2] = src[2]; // fallthrough
+      case 2: dest[1] = src[1]; // fallthrough
+      default: dest[0] = src[0];
+   }
+}
+
+// reverses the order of the w pixels of n bytes in row
+static void stbi__reverse_row(stbi_uc *row, stbi__uint32 w, int n)
+{
+   stbi_uc *a = row, *b = row + (w-1)*n;
+   stbi_uc t[4];
+   for (; a < b; a += n, b -= n) {
+      stbi__copy_pixel(t, a, n);
+      stbi__copy_pixel(a, b, n);
+      stbi__copy_pixel(b, t, n);
+   }
+}
+
+// writes the strip of rows (w pixels of n bytes) that starts at source row first
+// into output, which is h pixels wide and w high: transposed, then mirrored
+// left-right and/or top-bottom
+static void stbi__transpose_strip(stbi_uc *output, stbi_uc *strip, stbi__uint32 first, int rows,
+                                  stbi__uint32 w, stbi__uint32 h, int n, int flip_x, int flip_y)
+{
+   stbi__uint32 x;
+   int r;
+   ptrdiff_t step = flip_x ? -n : n;
+   for (x=0; x < w; ++x) {
+      stbi_uc *dest = output + ((size_t) (flip_y ? w-1-x : x) * h + (flip_x ? h-1-first : first)) * n;
+      stbi_uc *src = strip + (size_t) x * n;
+      for (r=0; r < rows; ++r, dest += step, src += (size_t) w * n)
+         stbi__copy_pixel(dest, src, n);
+   }
+}
+
 static stbi_uc *load_jpeg_image(stbi__jpeg *z, int *out_x, int *out_y, int *comp, int req_comp)
 {
    int n, decode_n, is_rgb;
@@ -3893,6 +4012,11 @@ static stbi_uc *load_jpeg_image(stbi__jpeg *z, int *out_x, int *out_y, int *comp
       unsigned int i,j;
       stbi_uc *output;
       stbi_uc *coutput[4] = { NULL, NULL, NULL, NULL };
+      stbi_uc *strip = NULL;
+      int orientation = stbi__exif_orientation_on_load ? z->exif_orientation : 1;
+      int transpose = orientation >= 5;
+      int flip_x = orientation == 2 || orientation == 3 || orientation == 6 || orientation == 7;
+      int flip_y = orientation == 3 || orientation == 4 || orientation == 7 || orientation == 8;
 
       stbi__resample res_comp[4];
 
@@ -3921,10 +4045,19 @@ static stbi_uc *load_jpeg_image(stbi__jpeg *z, int *out_x, int *out_y, int *comp
       // can't error after this so, this is safe
       output = (stbi_uc *) stbi__malloc_mad3(n, z->s->img_x, z->s->img_y, 1);
       if (!output) { stbi__cleanup_jpeg(z); return stbi__errpuc("outofmem", "Out of memory"); }
+      if (transpose) {
+         strip = (stbi_uc *) stbi__malloc_mad3(n, z->s->img_x, STBI__ORIENT_STRIP_ROWS, 1);
+         if (!strip) { STBI_FREE(output); stbi__cleanup_jpeg(z); return stbi__errpuc("outofmem", "Out of memory"); }
+      }
 
       // now go ahead and resample
       for (j=0; j < z->s->img_y; ++j) {
-         stbi_uc *out = output + n * z->s->img_x * j;
+         stbi_uc *row = transpose ? strip + n * z->s->img_x * (j % STBI__ORIENT_STRIP_ROWS)
+                                  : output + n * z->s->img_x * (flip_y ? z->s->img_y-1-j : j);
+         stbi_uc *out = row;
+         // the 3-channel converters write a byte past the row, which lands on a
+         // finished row when they are written bottom up
+         stbi_uc next = (flip_y && !transpose && j > 0) ? row[n * z->s->img_x] : 0;
          for (k=0; k < decode_n; ++k) {
             stbi__resample *r = &res_comp[k];
             int y_bot = r->ystep >= (r->vs >> 1);
@@ -4016,10 +4149,19 @@ static stbi_uc *load_jpeg_image(stbi__jpeg *z, int *out_x, int *out_y, int *comp
                   for (i=0; i < z->s->img_x; ++i) { *out++ = y[i]; *out++ = 255; }
             }
          }
+         if (transpose) {
+            if (j % STBI__ORIENT_STRIP_ROWS == STBI__ORIENT_STRIP_ROWS-1 || j == z->s->img_y-1)
+               stbi__transpose_strip(output, strip, j - j % STBI__ORIENT_STRIP_ROWS, j % STBI__ORIENT_STRIP_ROWS + 1,
+                                     z->s->img_x, z->s->img_y, n, flip_x, flip_y);
+         } else {
+            if (flip_y && j > 0) row[n * z->s->img_x] = next;
+            if (flip_x) stbi__reverse_row(row, z->s->img_x, n);
+         }
       }
+      STBI_FREE(strip);
       stbi__cleanup_jpeg(z);
-      *out_x = z->s->img_x;
-      *out_y = z->s->img_y;
+      *out_x = transpose ? z->s->img_y : z->s->img_x;
+      *out_y = transpose ? z->s->img_x : z->s->img_y;
       if (comp) *comp = z->s->img_n >= 3 ? 3 : 1; // report original components, not output
       return output;
    }
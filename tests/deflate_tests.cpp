@@ -0,0 +1,225 @@
+#include "stb_image_plus_tests.h"
+#include "stb_image_plus_deflate.h"
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <string>
+#include <vector>
+#ifdef STB_IMAGE_PLUS_TESTS_ZLIB
+#include <zlib.h>
+#else
+#include <stb_image.h>
+#endif
+
+namespace stb_image_plus::tests
+{
+
+namespace
+{
+
+using Bytes = std::vector<std::uint8_t>;
+
+// Inflates a zlib stream, or raw deflate blocks, with zlib when the build
+// found it, or else with stb_image's decoder. Returns false unless it ends
+// with a final block and inflates to exactly `expectedSize` bytes.
+bool inflate(const Bytes& compressed, bool zlibHeader, std::size_t expectedSize, Bytes& out)
+{
+    out.assign(expectedSize + 1, 0);
+#ifdef STB_IMAGE_PLUS_TESTS_ZLIB
+    z_stream stream{};
+    if (inflateInit2(&stream, zlibHeader ? 15 : -15) != Z_OK)
+        return false;
+    stream.next_in = const_cast<Bytef*>(compressed.data());
+    stream.avail_in = static_cast<uInt>(compressed.size());
+    stream.next_out = out.data();
+    stream.avail_out = static_cast<uInt>(out.size());
+    const int result = ::inflate(&stream, Z_FINISH);
+    const std::size_t size = stream.total_out;
+    inflateEnd(&stream);
+    if (result != Z_STREAM_END)
+        return false;
+#else
+    int size = 0;
+    char* inflated = stbi_zlib_decode_malloc_guesssize_headerflag(
+        reinterpret_cast<const char*>(compressed.data()), static_cast<int>(compressed.size()),
+        static_cast<int>(expectedSize + 1), &size, zlibHeader ? 1 : 0);
+    if (inflated == nullptr)
+        return false;
+    std::memcpy(out.data(), inflated, std::min<std::size_t>(static_cast<std::size_t>(size), out.size()));
+    std::free(inflated);
+#endif
+    if (static_cast<std::size_t>(size) != expectedSize)
+        return false;
+    out.resize(expectedSize);
+    return true;
+}
+
+std::uint32_t referenceCrc32(std::uint32_t crc, const std::uint8_t* data, std::size_t size)
+{
+    crc = ~crc;
+    for (std::size_t i = 0; i < size; ++i)
+    {
+        crc ^= data[i];
+        for (int bit = 0; bit < 8; ++bit)
+            crc = (crc >> 1) ^ (0xEDB88320u & (0u - (crc & 1)));
+    }
+    return ~crc;
+}
+
+std::uint32_t referenceAdler32(std::uint32_t adler, const std::uint8_t* data, std::size_t size)
+{
+    std::uint32_t a = adler & 0xFFFF, b = adler >> 16;
+    for (std::size_t i = 0; i < size; ++i)
+    {
+        a = (a + data[i]) % 65521;
+        b = (b + a) % 65521;
+    }
+    return b << 16 | a;
+}
+
+// Inputs that exercise stored, fixed and dynamic blocks, long matches and
+// runs, and matches reaching across the 32 KiB window.
+std::vector<Bytes> sampleInputs()
+{
+    std::mt19937 random(29);
+    std::vector<Bytes> inputs;
+    inputs.push_back({});
+    inputs.push_back({42});
+    inputs.push_back(Bytes(100000, 0));
+
+    Bytes noise(70000);
+    for (std::uint8_t& byte : noise)
+        byte = static_cast<std::uint8_t>(random());
+    inputs.push_back(noise);
+
+    const std::string words[] = {"deflate ", "stream ", "window ", "match ", "literal ", "huffman "};
+    Bytes text;
+    while (text.size() < 150000)
+    {
+        const std::string& word = words[random() % 6];
+        text.insert(text.end(), word.begin(), word.end());
+    }
+    inputs.push_back(text);
+
+    // Filtered image rows: mostly small values, with runs.
+    Bytes rows(200000);
+    for (std::size_t i = 0; i < rows.size(); ++i)
+        rows[i] = static_cast<std::uint8_t>(i % 997 < 300 ? 0 : (i / 7) % 5 + random() % 3);
+    inputs.push_back(rows);
+
+    // A block repeated past the window, then noise, then the block again.
+    Bytes repeats(noise.begin(), noise.begin() + 40000);
+    repeats.insert(repeats.end(), text.begin(), text.begin() + 50000);
+    repeats.insert(repeats.end(), noise.begin(), noise.begin() + 40000);
+    inputs.push_back(repeats);
+    return inputs;
+}
+
+void checksums()
+{
+    const std::uint8_t check[] = {'1', '2', '3', '4', '5', '6', '7', '8', '9'};
+    STB_IMAGE_PLUS_CHECK(detail::crc32(0, check, sizeof(check)) == 0xCBF43926u);
+    STB_IMAGE_PLUS_CHECK(detail::adler32(1, check, sizeof(check)) == 0x091E01DEu);
+    STB_IMAGE_PLUS_CHECK(detail::crc32(0, check, 0) == 0);
+    STB_IMAGE_PLUS_CHECK(detail::adler32(1, check, 0) == 1);
+
+    // Every length up to a few folding blocks and unaligned starts, for the
+    // PCLMUL path; and adler32's 5552 byte reduction interval.
+    std::mt19937 random(32);
+    Bytes data(70000);
+    for (std::uint8_t& byte : data)
+        byte = static_cast<std::uint8_t>(random());
+    std::fill(data.begin() + 20000, data.begin() + 30000, 0xFF);
+    for (std::size_t offset = 0; offset < 16; ++offset)
+        for (std::size_t size = 0; size < 300; ++size)
+        {
+            const std::uint8_t* start = data.data() + offset;
+            STB_IMAGE_PLUS_CHECK(detail::crc32(0, start, size) == referenceCrc32(0, start, size));
+            STB_IMAGE_PLUS_CHECK(detail::adler32(1, start, size) == referenceAdler32(1, start, size));
+        }
+    for (std::size_t size : {5551u, 5552u, 5553u, 65536u, 69990u})
+    {
+        const std::uint8_t* start = data.data() + 3;
+        STB_IMAGE_PLUS_CHECK(detail::crc32(0, start, size) == referenceCrc32(0, start, size));
+        STB_IMAGE_PLUS_CHECK(detail::adler32(1, start, size) == referenceAdler32(1, start, size));
+    }
+
+    // Running checksums and adler32Combine match one pass over the whole.
+    for (std::size_t split : {0u, 1u, 100u, 5552u, 40000u, 70000u})
+    {
+        const std::size_t rest = data.size() - split;
+        STB_IMAGE_PLUS_CHECK(detail::crc32(detail::crc32(0, data.data(), split), data.data() + split, rest)
+                             == detail::crc32(0, data.data(), data.size()));
+        const std::uint32_t head = detail::adler32(1, data.data(), split);
+        const std::uint32_t tail = detail::adler32(1, data.data() + split, rest);
+        STB_IMAGE_PLUS_CHECK(detail::adler32(head, data.data() + split, rest)
+                             == detail::adler32(1, data.data(), data.size()));
+        STB_IMAGE_PLUS_CHECK(detail::adler32Combine(head, tail, rest) == detail::adler32(1, data.data(), data.size()));
+    }
+}
+
+// zlibCompress, as stb_image_write calls it, at every level.
+void zlibStreams()
+{
+    for (const Bytes& input : sampleInputs())
+        for (int level = 0; level <= 9; ++level)
+        {
+            int size = 0;
+            unsigned char* compressed = detail::zlibCompress(const_cast<std::uint8_t*>(input.data()),
+                                                             static_cast<int>(input.size()), &size, level);
+            STB_IMAGE_PLUS_CHECK(compressed != nullptr and size >= 6);
+            if (compressed == nullptr)
+                continue;
+            const Bytes stream(compressed, compressed + size);
+            std::free(compressed);
+
+            STB_IMAGE_PLUS_CHECK((stream[0] * 256 + stream[1]) % 31 == 0 and (stream[0] & 15) == 8);
+            const std::uint32_t adler = detail::adler32(1, input.data(), input.size());
+            STB_IMAGE_PLUS_CHECK(stream[size - 4] == (adler >> 24) and stream[size - 3] == ((adler >> 16) & 0xFF)
+                                 and stream[size - 2] == ((adler >> 8) & 0xFF) and stream[size - 1] == (adler & 0xFF));
+            Bytes inflated;
+            STB_IMAGE_PLUS_CHECK(inflate(stream, true, input.size(), inflated) and inflated == input);
+        }
+}
+
+// Raw deflate at every level and strategy, whole and in pieces compressed
+// separately with the preceding 32 KiB as dictionary, as the PNG encoder's
+// bands are.
+void rawBlocks()
+{
+    for (const Bytes& input : sampleInputs())
+        for (detail::DeflateStrategy strategy : {detail::DeflateStrategy::Default, detail::DeflateStrategy::Rle})
+            for (int level = 0; level <= 9; ++level)
+            {
+                Bytes whole;
+                detail::deflate({}, input, level, true, whole, strategy);
+                Bytes inflated;
+                STB_IMAGE_PLUS_CHECK(inflate(whole, false, input.size(), inflated) and inflated == input);
+
+                const std::size_t pieceSize = 45000;
+                Bytes pieces;
+                for (std::size_t begin = 0; begin < input.size(); begin += pieceSize)
+                {
+                    const std::size_t end = std::min(input.size(), begin + pieceSize);
+                    const std::size_t dictionaryBegin = begin > detail::kDeflateWindow ? begin - detail::kDeflateWindow
+                                                                                       : 0;
+                    const std::span<const std::uint8_t> all(input);
+                    detail::deflate(all.subspan(dictionaryBegin, begin - dictionaryBegin),
+                                    all.subspan(begin, end - begin), level, end == input.size(), pieces, strategy);
+                }
+                if (input.size() > pieceSize)
+                    STB_IMAGE_PLUS_CHECK(inflate(pieces, false, input.size(), inflated) and inflated == input);
+            }
+}
+
+}
+
+void deflateTests()
+{
+    checksums();
+    zlibStreams();
+    rawBlocks();
+}
+
+}
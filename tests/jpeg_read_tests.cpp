@@ -0,0 +1,221 @@
+#include "stb_image_plus_tests.h"
+#include <stb_image_plus.h>
+#include "stb_image_plus_jpeg.h"
+#include "stb_image_plus_jpeg_read.h"
+#include <algorithm>
+#include <cstdlib>
+#include <random>
+#include <vector>
+
+namespace stb_image_plus::tests
+{
+
+namespace
+{
+
+// A gradient with noise on top, so that both low and high frequency
+// coefficients are coded.
+template <std::size_t Channels>
+ImageData<Channels> testImage(std::size_t width, std::size_t height, unsigned seed)
+{
+    std::mt19937 random(seed);
+    // Allocated with malloc, which ImageData frees with stbi_image_free.
+    auto* pixels = static_cast<PixelT<Channels>*>(std::malloc(width * height * sizeof(PixelT<Channels>)));
+    auto* bytes = reinterpret_cast<std::uint8_t*>(pixels);
+    for (std::size_t y = 0; y < height; ++y)
+        for (std::size_t x = 0; x < width; ++x)
+            for (std::size_t c = 0; c < Channels; ++c)
+            {
+                const std::size_t gradient = (x * 200 / width + y * 120 / height + c * 60) % 224;
+                bytes[(y * width + x) * Channels + c] = static_cast<std::uint8_t>(gradient + random() % 32);
+            }
+    return {std::span<PixelT<Channels>>(pixels, width * height), width, height};
+}
+
+std::vector<std::uint8_t> rewrite(const detail::JpegFile& file)
+{
+    std::vector<std::uint8_t> out;
+    if (not detail::writeJpegCoefficients(detail::writeToVector, &out, file))
+        out.clear();
+    return out;
+}
+
+bool sameCoefficients(const detail::JpegFile& a, const detail::JpegFile& b)
+{
+    if (a.width != b.width or a.height != b.height or a.components.size() != b.components.size())
+        return false;
+    for (std::size_t i = 0; i < a.components.size(); ++i)
+    {
+        const detail::JpegComponent& ca = a.components[i];
+        const detail::JpegComponent& cb = b.components[i];
+        if (ca.horizontalSampling != cb.horizontalSampling or ca.verticalSampling != cb.verticalSampling
+            or ca.blocksWide != cb.blocksWide or ca.blocksHigh != cb.blocksHigh
+            or ca.coefficients != cb.coefficients
+            or a.quantTables[ca.quantTable] != b.quantTables[cb.quantTable])
+            return false;
+    }
+    return true;
+}
+
+// What a successful readJpeg must always hold, whatever the input.
+bool consistent(const detail::JpegFile& file)
+{
+    return std::all_of(file.components.begin(), file.components.end(), [](const detail::JpegComponent& c)
+    {
+        return c.coefficients.size() == c.blocksWide * c.blocksHigh * 64;
+    });
+}
+
+template <std::size_t Channels>
+bool sameDecodedPixels(const std::vector<std::uint8_t>& a, const std::vector<std::uint8_t>& b)
+{
+    ImageData<Channels> imageA, imageB;
+    if (not imageA.readFromMemory(a.data(), a.size()) or not imageB.readFromMemory(b.data(), b.size())
+        or imageA.width() != imageB.width() or imageA.height() != imageB.height())
+        return false;
+    const auto pixelsA = std::as_bytes(imageA.pixelSpan()), pixelsB = std::as_bytes(imageB.pixelSpan());
+    return std::equal(pixelsA.begin(), pixelsA.end(), pixelsB.begin(), pixelsB.end());
+}
+
+std::vector<EncodeOptions> encoderVariants()
+{
+    std::vector<EncodeOptions> variants;
+    EncodeOptions options;
+    variants.push_back(options);
+    options.jpegQuality = 97;
+    options.jpegSubsampling = JpegSubsampling::Chroma444;
+    variants.push_back(options);
+    options.jpegQuality = 60;
+    options.jpegSubsampling = JpegSubsampling::Chroma422;
+    options.jpegOptimizeHuffman = true;
+    variants.push_back(options);
+    options = {};
+    options.jpegSubsampling = JpegSubsampling::Chroma420;
+    options.jpegRestartRows = 1;
+    variants.push_back(options);
+    options = {};
+    options.jpegProgressive = true;
+    variants.push_back(options);
+    options.jpegQuality = 40;
+    options.jpegSubsampling = JpegSubsampling::Chroma444;
+    variants.push_back(options);
+    return variants;
+}
+
+// readJpeg then writeJpegCoefficients must keep every coefficient, so the
+// rewritten (baseline) file decodes to the very same pixels.
+template <std::size_t Channels>
+void roundTrips()
+{
+    const std::pair<std::size_t, std::size_t> sizes[] = {{61, 47}, {128, 96}, {17, 9}, {1, 1}};
+    for (const auto& [width, height] : sizes)
+    {
+        const ImageData<Channels> image = testImage<Channels>(width, height, static_cast<unsigned>(width));
+        for (const EncodeOptions& options : encoderVariants())
+        {
+            std::vector<std::uint8_t> original;
+            STB_IMAGE_PLUS_CHECK(image.writeToMemory(ImageFormat::Jpeg, original, options));
+
+            detail::JpegFile file;
+            STB_IMAGE_PLUS_CHECK(detail::readJpeg(original.data(), original.size(), file));
+            STB_IMAGE_PLUS_CHECK(file.width == width and file.height == height);
+            // Grey images are written as YCbCr too, as stb_image_write does.
+            STB_IMAGE_PLUS_CHECK(file.components.size() == 3);
+            STB_IMAGE_PLUS_CHECK(file.progressive == options.jpegProgressive);
+            STB_IMAGE_PLUS_CHECK(consistent(file));
+
+            const std::vector<std::uint8_t> rewritten = rewrite(file);
+            STB_IMAGE_PLUS_CHECK(not rewritten.empty());
+            detail::JpegFile reread;
+            STB_IMAGE_PLUS_CHECK(detail::readJpeg(rewritten.data(), rewritten.size(), reread));
+            STB_IMAGE_PLUS_CHECK(not reread.progressive);
+            STB_IMAGE_PLUS_CHECK(sameCoefficients(file, reread));
+            STB_IMAGE_PLUS_CHECK(sameDecodedPixels<Channels>(original, rewritten));
+        }
+    }
+}
+
+std::size_t firstScanOffset(const std::vector<std::uint8_t>& jpeg)
+{
+    for (std::size_t i = 0; i + 1 < jpeg.size(); ++i)
+        if (jpeg[i] == 0xFF and jpeg[i + 1] == 0xDA)
+            return i;
+    return jpeg.size();
+}
+
+std::vector<std::vector<std::uint8_t>> sampleFiles()
+{
+    const ImageData3 image = testImage<3>(45, 38, 7);
+    std::vector<std::vector<std::uint8_t>> files;
+    for (const EncodeOptions& options : encoderVariants())
+    {
+        files.emplace_back();
+        image.writeToMemory(ImageFormat::Jpeg, files.back(), options);
+    }
+    return files;
+}
+
+// Cut anywhere: headers cut short are rejected, scans cut short decode what
+// they hold.
+void truncatedInputs()
+{
+    for (const std::vector<std::uint8_t>& jpeg : sampleFiles())
+    {
+        // Every cut in the headers, every few bytes in the scans.
+        const std::size_t firstScan = firstScanOffset(jpeg);
+        for (std::size_t size = 0; size < jpeg.size(); size += size <= firstScan + 8 ? 1 : 5)
+        {
+            detail::JpegFile file;
+            const bool read = detail::readJpeg(jpeg.data(), size, file);
+            if (size <= firstScan)
+                STB_IMAGE_PLUS_CHECK(not read);
+            else if (read)
+            {
+                STB_IMAGE_PLUS_CHECK(consistent(file));
+                STB_IMAGE_PLUS_CHECK(not rewrite(file).empty());
+            }
+        }
+    }
+}
+
+// Random bytes overwritten, in headers and entropy coded data alike: the
+// reader must either fail or return coefficients that can be written out.
+void corruptedInputs()
+{
+    std::mt19937 random(41);
+    for (const std::vector<std::uint8_t>& jpeg : sampleFiles())
+        for (int attempt = 0; attempt < 400; ++attempt)
+        {
+            std::vector<std::uint8_t> corrupted = jpeg;
+            const int changes = 1 + static_cast<int>(random() % 4);
+            for (int i = 0; i < changes; ++i)
+                corrupted[random() % corrupted.size()] = static_cast<std::uint8_t>(random());
+            detail::JpegFile file;
+            if (detail::readJpeg(corrupted.data(), corrupted.size(), file))
+            {
+                STB_IMAGE_PLUS_CHECK(consistent(file));
+                rewrite(file);
+            }
+        }
+
+    const std::uint8_t notJpeg[] = {'G', 'I', 'F', '8', '9', 'a', 0, 0};
+    const std::uint8_t soiOnly[] = {0xFF, 0xD8};
+    const std::uint8_t soiEoi[] = {0xFF, 0xD8, 0xFF, 0xD9};
+    detail::JpegFile file;
+    STB_IMAGE_PLUS_CHECK(not detail::readJpeg(nullptr, 0, file));
+    STB_IMAGE_PLUS_CHECK(not detail::readJpeg(notJpeg, sizeof(notJpeg), file));
+    STB_IMAGE_PLUS_CHECK(not detail::readJpeg(soiOnly, sizeof(soiOnly), file));
+    STB_IMAGE_PLUS_CHECK(not detail::readJpeg(soiEoi, sizeof(soiEoi), file));
+}
+
+}
+
+void jpegReadTests()
+{
+    roundTrips<1>();
+    roundTrips<3>();
+    truncatedInputs();
+    corruptedInputs();
+}
+
+}
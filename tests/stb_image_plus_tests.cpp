@@ -0,0 +1,54 @@
+#include "stb_image_plus_tests.h"
+#include <cstdio>
+#include <cstring>
+
+namespace stb_image_plus::tests
+{
+
+namespace
+{
+
+int failures = 0;
+
+}
+
+void fail(const char* condition, const char* file, int line)
+{
+    std::fprintf(stderr, "%s:%d: check failed: %s\n", file, line, condition);
+    ++failures;
+}
+
+int failureCount()
+{
+    return failures;
+}
+
+}
+
+// Runs the groups named on the command line, or all of them.
+int main(int argc, char** argv)
+{
+    using namespace stb_image_plus::tests;
+    struct Group
+    {
+        const char* name;
+        void (*run)();
+    };
+    const Group groups[] = {
+        {"deflate", deflateTests},
+        {"jpeg_read", jpegReadTests},
+    };
+
+    for (const Group& group : groups)
+    {
+        bool selected = argc < 2;
+        for (int i = 1; i < argc; ++i)
+            selected = selected or std::strcmp(argv[i], group.name) == 0;
+        if (not selected)
+            continue;
+        const int failuresBefore = failureCount();
+        group.run();
+        std::printf("%s: %s\n", group.name, failureCount() == failuresBefore ? "passed" : "FAILED");
+    }
+    return failureCount() == 0 ? 0 : 1;
+}
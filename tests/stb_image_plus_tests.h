@@ -0,0 +1,21 @@
+#pragma once
+
+namespace stb_image_plus::tests
+{
+
+/* Reports a failed check, with where it is, and counts it. */
+void fail(const char* condition, const char* file, int line);
+
+/* Failed checks so far, for every group. */
+int failureCount();
+
+/* Groups of checks, run by name from the command line (see main). */
+void deflateTests();
+void jpegReadTests();
+
+}
+
+/* Checks `condition`, carrying on after a failure so that one run reports
+ * every broken check. */
+#define STB_IMAGE_PLUS_CHECK(condition) \
+    ((condition) ? void() : stb_image_plus::tests::fail(#condition, __FILE__, __LINE__))